@@ -0,0 +1,551 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "libjdx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Header reads are too quick to time one at a time, so each run times this many
+#define HEADER_READS 1000
+
+// Upper bound on the number of JDX_GetImage calls timed per run
+#define MAX_IMAGE_GETS 100000
+
+#define LABEL_COUNT 10
+
+typedef struct {
+	uint16_t width;
+	uint16_t height;
+	uint8_t bit_depth;
+} Shape;
+
+typedef enum {
+	FORMAT_TABLE,
+	FORMAT_CSV,
+	FORMAT_JSON
+} OutputFormat;
+
+typedef struct {
+	OutputFormat format;
+	uint64_t max_bytes;
+	uint32_t repeat;
+	uint32_t thread_count;
+	const char *path;
+	uint64_t seed;
+} BenchOptions;
+
+typedef struct {
+	const BenchOptions *options;
+	JDXDataset *dataset;
+	size_t image_size;
+	size_t header_size;
+} BenchContext;
+
+typedef struct {
+	const char *name;
+
+	// Times one run of the operation, leaving out any setup and teardown around it
+	JDXError (*run)(double *seconds, BenchContext *context);
+
+	// Bytes and images processed by one run
+	uint64_t (*get_bytes)(const BenchContext *context);
+	uint64_t (*get_images)(const BenchContext *context);
+} Operation;
+
+typedef struct {
+	JDXError error;
+	double best_seconds;
+	uint64_t peak_rss_kb;
+} OperationResult;
+
+static const uint64_t image_counts[] = { 1000, 10000, 100000, 1000000, 10000000 };
+
+static const Shape shapes[] = {
+	{ 32, 32, 8 },
+	{ 32, 32, 24 },
+	{ 64, 64, 32 },
+	{ 224, 224, 24 }
+};
+
+static const BenchOptions default_options = {
+	.format = FORMAT_TABLE,
+	.max_bytes = (uint64_t) 256 << 20,
+	.repeat = 3,
+	.thread_count = 1,
+	.path = "./bench.jdx",
+	.seed = 1
+};
+
+static double get_time(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static uint64_t get_peak_rss_kb(void) {
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	// macOS reports bytes where Linux reports kilobytes
+#ifdef __APPLE__
+	return (uint64_t) usage.ru_maxrss / 1024;
+#else
+	return (uint64_t) usage.ru_maxrss;
+#endif
+}
+
+static uint64_t next_random(uint64_t *state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+	return z ^ (z >> 31);
+}
+
+// Fills images with gradients and a little noise, which compress about as well as natural images do
+static JDXDataset *generate_dataset(const Shape *shape, uint64_t image_count, uint64_t seed) {
+	static char *labels[LABEL_COUNT] = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9" };
+
+	JDXHeader header = {
+		.version = JDX_VERSION,
+		.image_width = shape->width,
+		.image_height = shape->height,
+		.bit_depth = shape->bit_depth,
+		.labels = labels,
+		.label_count = LABEL_COUNT,
+		.image_count = image_count
+	};
+
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	if (dataset == NULL || (dataset->header = JDX_AllocHeader()) == NULL) {
+		JDX_FreeDataset(dataset);
+		return NULL;
+	}
+
+	JDX_CopyHeader(dataset->header, &header);
+
+	size_t image_size = JDX_GetImageSize(&header);
+	size_t row_size = image_size / shape->height;
+
+	dataset->_raw_image_data = malloc(image_size * (size_t) image_count);
+	dataset->_raw_labels = malloc(sizeof(JDXLabel) * (size_t) image_count);
+
+	if (dataset->_raw_image_data == NULL || dataset->_raw_labels == NULL) {
+		JDX_FreeDataset(dataset);
+		return NULL;
+	}
+
+	uint64_t random_state = seed;
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		uint8_t *image = dataset->_raw_image_data + image_size * (size_t) i;
+		uint64_t random = next_random(&random_state);
+
+		for (size_t y = 0; y < shape->height; y++) {
+			for (size_t x = 0; x < row_size; x++) {
+				if (x % 8 == 0) {
+					random = next_random(&random_state);
+				}
+
+				image[y * row_size + x] = (uint8_t) (x + y * 2 + i * 7 + ((random >> (x % 8 * 8)) & 0x07));
+			}
+		}
+
+		dataset->_raw_labels[i] = (JDXLabel) (next_random(&random_state) % LABEL_COUNT);
+	}
+
+	return dataset;
+}
+
+static uint64_t get_body_bytes(const BenchContext *context) {
+	return (uint64_t) (context->image_size + sizeof(JDXLabel)) * context->dataset->header->image_count;
+}
+
+static uint64_t get_header_bytes(const BenchContext *context) {
+	return (uint64_t) context->header_size * HEADER_READS;
+}
+
+static uint64_t get_image_gets(const BenchContext *context) {
+	uint64_t image_count = context->dataset->header->image_count;
+	return image_count < MAX_IMAGE_GETS ? image_count : MAX_IMAGE_GETS;
+}
+
+static uint64_t get_image_get_bytes(const BenchContext *context) {
+	return get_image_gets(context) * context->image_size;
+}
+
+static uint64_t get_image_count(const BenchContext *context) {
+	return context->dataset->header->image_count;
+}
+
+static uint64_t get_no_images(const BenchContext *context) {
+	return 0;
+}
+
+static JDXError run_write(double *seconds, BenchContext *context) {
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.thread_count = context->options->thread_count;
+
+	double start = get_time();
+	JDXError error = JDX_WriteDatasetToPathWithOptions(context->dataset, context->options->path, &options);
+	*seconds = get_time() - start;
+
+	return error;
+}
+
+static JDXError run_read_header(double *seconds, BenchContext *context) {
+	JDXHeader *header = JDX_AllocHeader();
+	JDXError error = JDXError_NONE;
+
+	if (header == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	double start = get_time();
+
+	// Each read replaces the labels of the previous one, so the header is only freed once
+	for (int r = 0; r < HEADER_READS && !error; r++) {
+		error = JDX_ReadHeaderFromPath(header, context->options->path);
+	}
+
+	*seconds = get_time() - start;
+
+	JDX_FreeHeader(header);
+	return error;
+}
+
+static JDXError run_read(double *seconds, BenchContext *context) {
+	JDXReadOptions options = JDX_DEFAULT_READ_OPTIONS;
+	options.thread_count = context->options->thread_count;
+
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	double start = get_time();
+	JDXError error = JDX_ReadDatasetFromPathWithOptions(dataset, context->options->path, &options);
+	*seconds = get_time() - start;
+
+	JDX_FreeDataset(dataset);
+	return error;
+}
+
+static JDXError run_get_image(double *seconds, BenchContext *context) {
+	uint64_t image_count = context->dataset->header->image_count;
+	uint64_t get_count = get_image_gets(context);
+	uint64_t *indices = malloc((size_t) get_count * sizeof(uint64_t));
+
+	if (indices == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	// Random indices defeat the prefetching that a sequential walk would get for free
+	uint64_t random_state = context->options->seed;
+
+	for (uint64_t g = 0; g < get_count; g++) {
+		indices[g] = next_random(&random_state) % image_count;
+	}
+
+	JDXError error = JDXError_NONE;
+	double start = get_time();
+
+	for (uint64_t g = 0; g < get_count && !error; g++) {
+		JDXImage *image = JDX_GetImage(context->dataset, indices[g]);
+
+		if (image == NULL) {
+			error = JDXError_MEMORY_FAILURE;
+		} else {
+			JDX_FreeImage(image);
+		}
+	}
+
+	*seconds = get_time() - start;
+
+	free(indices);
+	return error;
+}
+
+static JDXError run_append(double *seconds, BenchContext *context) {
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	if (dataset == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	JDX_CopyDataset(dataset, context->dataset);
+
+	double start = get_time();
+	JDXError error = JDX_AppendDataset(dataset, context->dataset);
+	*seconds = get_time() - start;
+
+	JDX_FreeDataset(dataset);
+	return error;
+}
+
+static JDXError run_copy(double *seconds, BenchContext *context) {
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	if (dataset == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	double start = get_time();
+	JDX_CopyDataset(dataset, context->dataset);
+	*seconds = get_time() - start;
+
+	JDXError error = dataset->_raw_image_data && dataset->_raw_labels ? JDXError_NONE : JDXError_MEMORY_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	return error;
+}
+
+// Reads need the file that the write leaves behind, so the write always goes first
+static const Operation operations[] = {
+	{ "write", run_write, get_body_bytes, get_image_count },
+	{ "read_header", run_read_header, get_header_bytes, get_no_images },
+	{ "read", run_read, get_body_bytes, get_image_count },
+	{ "get_image", run_get_image, get_image_get_bytes, get_image_gets },
+	{ "append", run_append, get_body_bytes, get_image_count },
+	{ "copy", run_copy, get_body_bytes, get_image_count }
+};
+
+static void print_preamble(const BenchOptions *options) {
+	switch (options->format) {
+	case FORMAT_TABLE:
+		printf(
+			"%-12s %10s %6s %6s %4s %12s %12s %14s %12s\n",
+			"operation", "images", "width", "height", "bits", "seconds", "MB/s", "images/s", "peak RSS KB"
+		);
+		break;
+	case FORMAT_CSV:
+		printf("operation,images,width,height,bit_depth,seconds,mb_per_s,images_per_s,peak_rss_kb\n");
+		break;
+	case FORMAT_JSON:
+		break;
+	}
+}
+
+static void print_result(
+	const BenchOptions *options,
+	const char *name,
+	const JDXHeader *header,
+	double seconds,
+	uint64_t bytes,
+	uint64_t images,
+	uint64_t peak_rss_kb
+) {
+	double mb_per_s = seconds > 0 ? (double) bytes / 1e6 / seconds : 0;
+	double images_per_s = seconds > 0 ? (double) images / seconds : 0;
+
+	switch (options->format) {
+	case FORMAT_TABLE:
+		printf(
+			"%-12s %10llu %6u %6u %4u %12.6f %12.1f %14.0f %12llu\n",
+			name, (unsigned long long) header->image_count, header->image_width, header->image_height, header->bit_depth,
+			seconds, mb_per_s, images_per_s, (unsigned long long) peak_rss_kb
+		);
+		break;
+	case FORMAT_CSV:
+		printf(
+			"%s,%llu,%u,%u,%u,%.9f,%.3f,%.3f,%llu\n",
+			name, (unsigned long long) header->image_count, header->image_width, header->image_height, header->bit_depth,
+			seconds, mb_per_s, images_per_s, (unsigned long long) peak_rss_kb
+		);
+		break;
+	case FORMAT_JSON:
+		printf(
+			"{\"operation\":\"%s\",\"images\":%llu,\"width\":%u,\"height\":%u,\"bit_depth\":%u,"
+			"\"seconds\":%.9f,\"mb_per_s\":%.3f,\"images_per_s\":%.3f,\"peak_rss_kb\":%llu}\n",
+			name, (unsigned long long) header->image_count, header->image_width, header->image_height, header->bit_depth,
+			seconds, mb_per_s, images_per_s, (unsigned long long) peak_rss_kb
+		);
+		break;
+	}
+
+	fflush(stdout);
+}
+
+// Runs every repeat of an operation in a child process and reports the peak RSS of that child, since the peak of this
+// process would still hold that of the largest dataset benchmarked before
+static OperationResult measure_operation(const Operation *operation, BenchContext *context) {
+	OperationResult result = { .error = JDXError_NONE };
+	int result_pipe[2];
+
+	if (pipe(result_pipe) != 0) {
+		result.error = JDXError_MEMORY_FAILURE;
+		return result;
+	}
+
+	pid_t child = fork();
+
+	if (child == 0) {
+		close(result_pipe[0]);
+
+		// The fastest run is the least disturbed by the rest of the system
+		for (uint32_t r = 0; r < context->options->repeat && !result.error; r++) {
+			double seconds;
+			result.error = operation->run(&seconds, context);
+
+			if (r == 0 || seconds < result.best_seconds) {
+				result.best_seconds = seconds;
+			}
+		}
+
+		result.peak_rss_kb = get_peak_rss_kb();
+
+		bool sent = write(result_pipe[1], &result, sizeof(result)) == (ssize_t) sizeof(result);
+		_exit(sent ? 0 : 1);
+	}
+
+	close(result_pipe[1]);
+
+	// A child that could not start or report back counts as an operation that ran out of memory
+	if (child < 0 || read(result_pipe[0], &result, sizeof(result)) != (ssize_t) sizeof(result)) {
+		result.error = JDXError_MEMORY_FAILURE;
+	}
+
+	close(result_pipe[0]);
+
+	if (child > 0) {
+		waitpid(child, NULL, 0);
+	}
+
+	return result;
+}
+
+static bool bench_dataset(const BenchOptions *options, const Shape *shape, uint64_t image_count) {
+	JDXDataset *dataset = generate_dataset(shape, image_count, options->seed);
+
+	if (dataset == NULL) {
+		fprintf(stderr, "Failed to generate %llu images of %ux%u.\n", (unsigned long long) image_count, shape->width, shape->height);
+		return false;
+	}
+
+	// The header written to disk is the fixed fields, the labels with their terminators, and the image count
+	size_t header_size = 14 + sizeof(uint64_t);
+
+	for (uint16_t l = 0; l < dataset->header->label_count; l++) {
+		header_size += strlen(dataset->header->labels[l]) + 1;
+	}
+
+	BenchContext context = {
+		.options = options,
+		.dataset = dataset,
+		.image_size = JDX_GetImageSize(dataset->header),
+		.header_size = header_size
+	};
+
+	bool succeeded = true;
+
+	for (size_t o = 0; o < sizeof(operations) / sizeof(operations[0]) && succeeded; o++) {
+		const Operation *operation = &operations[o];
+		OperationResult result = measure_operation(operation, &context);
+
+		if (result.error) {
+			fprintf(stderr, "Operation '%s' failed with error %d.\n", operation->name, (int) result.error);
+			succeeded = false;
+		} else {
+			print_result(
+				options,
+				operation->name,
+				dataset->header,
+				result.best_seconds,
+				operation->get_bytes(&context),
+				operation->get_images(&context),
+				result.peak_rss_kb
+			);
+		}
+	}
+
+	remove(options->path);
+	JDX_FreeDataset(dataset);
+
+	return succeeded;
+}
+
+static void print_usage(const char *program) {
+	fprintf(
+		stderr,
+		"Usage: %s [options]\n"
+		"  --format=table|csv|json  Output format (default: table)\n"
+		"  --max-bytes=N            Skip datasets with more than N bytes of pixels (default: 268435456)\n"
+		"  --repeat=N               Runs per operation, of which the fastest is reported (default: 3)\n"
+		"  --threads=N              Threads used to read and write, or 0 for one per processor (default: 1)\n"
+		"  --path=PATH              File written and read by the benchmarks (default: ./bench.jdx)\n"
+		"  --seed=N                 Seed of the synthetic images (default: 1)\n",
+		program
+	);
+}
+
+static bool parse_options(BenchOptions *dest, int argc, char **argv) {
+	*dest = default_options;
+
+	for (int a = 1; a < argc; a++) {
+		const char *arg = argv[a];
+
+		if (strcmp(arg, "--format=table") == 0) {
+			dest->format = FORMAT_TABLE;
+		} else if (strcmp(arg, "--format=csv") == 0) {
+			dest->format = FORMAT_CSV;
+		} else if (strcmp(arg, "--format=json") == 0) {
+			dest->format = FORMAT_JSON;
+		} else if (strncmp(arg, "--max-bytes=", 12) == 0) {
+			dest->max_bytes = strtoull(arg + 12, NULL, 10);
+		} else if (strncmp(arg, "--repeat=", 9) == 0) {
+			dest->repeat = (uint32_t) strtoul(arg + 9, NULL, 10);
+		} else if (strncmp(arg, "--threads=", 10) == 0) {
+			dest->thread_count = (uint32_t) strtoul(arg + 10, NULL, 10);
+		} else if (strncmp(arg, "--path=", 7) == 0) {
+			dest->path = arg + 7;
+		} else if (strncmp(arg, "--seed=", 7) == 0) {
+			dest->seed = strtoull(arg + 7, NULL, 10);
+		} else {
+			return false;
+		}
+	}
+
+	return dest->repeat > 0;
+}
+
+int main(int argc, char **argv) {
+	BenchOptions options;
+
+	if (!parse_options(&options, argc, argv)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	print_preamble(&options);
+
+	bool succeeded = true;
+
+	for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+		for (size_t c = 0; c < sizeof(image_counts) / sizeof(image_counts[0]); c++) {
+			JDXHeader header = {
+				.image_width = shapes[s].width,
+				.image_height = shapes[s].height,
+				.bit_depth = shapes[s].bit_depth
+			};
+
+			// Larger datasets are left out unless the machine is known to have the memory for them
+			if ((uint64_t) JDX_GetImageSize(&header) * image_counts[c] > options.max_bytes) {
+				continue;
+			}
+
+			succeeded = bench_dataset(&options, &shapes[s], image_counts[c]) && succeeded;
+		}
+	}
+
+	return succeeded ? 0 : 1;
+}
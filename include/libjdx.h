@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -31,9 +32,91 @@ typedef enum {
 
 	JDXError_UNEQUAL_WIDTHS,
 	JDXError_UNEQUAL_HEIGHTS,
-	JDXError_UNEQUAL_BIT_DEPTHS
+	JDXError_UNEQUAL_BIT_DEPTHS,
+
+	JDXError_OUT_OF_BOUNDS,
+	JDXError_UNKNOWN_LABEL,
+	JDXError_UNSUPPORTED_CONVERSION
 } JDXError;
 
+// How the chunks of a body are encoded, which is recorded in the file
+typedef enum {
+	JDXCodec_DEFLATE,
+	JDXCodec_STORED,
+
+	// Deflate streams wrapped with a checksum, for chunks that are handed to other zlib or gzip tools
+	JDXCodec_ZLIB,
+	JDXCodec_GZIP
+} JDXCodec;
+
+// Prediction applied to each row of an image before compression, as in PNG, which is recorded in the file
+typedef enum {
+	JDXFilter_NONE,
+	JDXFilter_SUB,
+	JDXFilter_UP,
+	JDXFilter_PAETH
+} JDXFilter;
+
+// Access pattern hint given to the operating system for memory-mapped files
+typedef enum {
+	JDXMapAdvice_NORMAL,
+	JDXMapAdvice_SEQUENTIAL,
+	JDXMapAdvice_RANDOM,
+	JDXMapAdvice_WILL_NEED
+} JDXMapAdvice;
+
+// Channel order of converted pixels, either interleaved per pixel or one plane per channel
+typedef enum {
+	JDXLayout_HWC,
+	JDXLayout_CHW
+} JDXLayout;
+
+// Phases that instrumented calls break their time down into
+typedef enum {
+	JDXPhase_READ,
+	JDXPhase_DECOMPRESS,
+	JDXPhase_FILTER,
+	JDXPhase_COPY,
+	JDXPhase_COMPRESS,
+	JDXPhase_WRITE,
+	JDXPhase_ALLOCATE,
+	JDXPhase_HASH,
+	JDXPhase_COUNT
+} JDXPhase;
+
+typedef struct {
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+
+	// Sizes of the streams on either side of the codec, whether they were compressed or decompressed
+	uint64_t compressed_bytes;
+	uint64_t uncompressed_bytes;
+
+	// Only the large buffers of a call are counted, such as image data, chunk buffers and the compressed body
+	uint64_t allocated_bytes;
+	uint64_t allocation_count;
+
+	// Images written as references to an identical image earlier in the body instead of being stored again
+	uint64_t duplicate_images;
+
+	// Nanoseconds spent in each phase, summed over every thread, so their total can exceed the duration of the call
+	uint64_t phase_ns[JDXPhase_COUNT];
+} JDXStats;
+
+// Called at the end of every instrumented call with its stats, where operation is "read", "write" or "append"
+typedef void (*JDXStatsCallback)(const char *operation, const JDXStats *stats, void *user_data);
+
+// Every allocation of the library goes through these, each receiving the context
+typedef struct {
+	void *(*alloc)(size_t size, void *context);
+	void *(*realloc)(void *pointer, size_t size, void *context);
+	void (*free)(void *pointer, void *context);
+	void *context;
+} JDXAllocator;
+
+// Codec state and scratch buffers that are kept between the calls given it, which must never run concurrently
+typedef struct JDXContext JDXContext;
+
 typedef struct {
 	uint8_t build_type, patch, minor, major;
 } JDXVersion;
@@ -47,6 +130,9 @@ typedef struct {
 
 	char **labels;
 	uint16_t label_count;
+
+	// Hash index of labels, built wherever the library sets them and freed with the header
+	struct JDXLabelTable *_label_table;
 } JDXHeader;
 
 typedef struct {
@@ -54,6 +140,12 @@ typedef struct {
 
 	JDXLabel *_raw_labels;
 	uint8_t *_raw_image_data;
+
+	// Set when _raw_image_data points into a memory-mapped file rather than owned memory
+	struct JDXMapping *_mapping;
+
+	// Set when the header, labels and images all live in this single allocation
+	void *_arena;
 } JDXDataset;
 
 typedef struct {
@@ -66,16 +158,141 @@ typedef struct {
 	JDXLabel label_num;
 } JDXImage;
 
+// Borrowed view of an image whose pointers refer to the memory of the dataset or reader it came from
+typedef struct {
+	const uint8_t *raw_data;
+
+	uint16_t width, height;
+	uint8_t bit_depth;
+
+	const char *label_str;
+	JDXLabel label_num;
+} JDXImageView;
+
+typedef struct {
+	JDXHeader *header;
+
+	// Index of the image returned by the next call to JDX_ReadNextImage
+	uint64_t position;
+
+	struct JDXReaderState *_state;
+} JDXReader;
+
+typedef struct {
+	// Shape and labels of the images being written, with image_count counting the images written so far
+	JDXHeader *header;
+
+	struct JDXWriterState *_state;
+} JDXWriter;
+
+// Batch of images gathered from a dataset, which remains valid until the next call to JDX_NextBatch
+typedef struct {
+	// image_count images of JDX_GetImageSize bytes each, in iteration order
+	const uint8_t *pixels;
+	const JDXLabel *labels;
+
+	// Equal to the batch size, except possibly for the last batch of an epoch
+	uint64_t image_count;
+} JDXBatch;
+
+typedef struct {
+	// Dataset being iterated over, which must not be modified or freed until the iterator is closed
+	const JDXDataset *dataset;
+
+	// Number of epochs completed so far
+	uint64_t epoch;
+
+	struct JDXIteratorState *_state;
+} JDXIterator;
+
+typedef struct {
+	// Number of threads that decompress chunks or gather batches concurrently, or 0 to use one per online processor
+	uint32_t thread_count;
+
+	// Only used when the file is memory-mapped
+	JDXMapAdvice map_advice;
+
+	// Reads the whole dataset into one allocation, which is only resized by copying it first
+	bool arena;
+
+	// Decompressors and scratch buffers are reused from this if not NULL, instead of being allocated for the call
+	JDXContext *context;
+
+	// Stats of the call are added to these if not NULL, and are only gathered if these or a callback want them
+	JDXStats *stats;
+} JDXReadOptions;
+
+typedef struct {
+	// Number of images in each independently compressed chunk of the body, or 0 to size chunks automatically
+	uint32_t chunk_image_count;
+
+	// Number of threads that compress chunks concurrently, or 0 to use one per online processor
+	uint32_t thread_count;
+
+	// JDXCodec_STORED skips compression entirely, trading file size for the fastest reads and writes
+	JDXCodec codec;
+
+	// From 1 (fastest) to 12 (smallest), or 0 for the default of 12, and ignored by JDXCodec_STORED
+	uint8_t compression_level;
+
+	// Filters make pixels more compressible, and split_channels stores each channel of an image as its own plane
+	JDXFilter filter;
+	bool split_channels;
+
+	// Stores each distinct image once, writing later copies as references to an earlier one, which are found by a hash
+	// of their bytes and then compared byte for byte. The number of copies found is counted in the duplicate_images of the stats
+	bool deduplicate;
+
+	// Compressors and scratch buffers are reused from this if not NULL, and are held by a writer until it is closed
+	JDXContext *context;
+
+	// Stats of the call are added to these if not NULL, and are only gathered if these or a callback want them
+	JDXStats *stats;
+} JDXWriteOptions;
+
+typedef struct {
+	uint32_t batch_size;
+
+	// Each epoch visits the images in a new permutation derived from the seed and the epoch, or in order if not shuffled
+	bool shuffle;
+	uint64_t seed;
+
+	// Number of threads that gather batches ahead of the consumer, or 0 to use one per online processor
+	uint32_t thread_count;
+
+	// Number of batches that can be gathered ahead of the consumer
+	uint32_t ring_size;
+} JDXIteratorOptions;
+
 extern const JDXVersion JDX_VERSION;
+extern const JDXReadOptions JDX_DEFAULT_READ_OPTIONS;
+extern const JDXWriteOptions JDX_DEFAULT_WRITE_OPTIONS;
+extern const JDXIteratorOptions JDX_DEFAULT_ITERATOR_OPTIONS;
 
 int32_t JDX_CompareVersions(JDXVersion v1, JDXVersion v2);
 
+// Sets a callback for the stats of every read, write and append, or NULL to stop, before any of them are started
+void JDX_SetStatsCallback(JDXStatsCallback callback, void *user_data);
+
+// Replaces the allocator of the library, or restores the default with NULL, before any other call
+void JDX_SetAllocator(const JDXAllocator *allocator);
+
+// Frees memory returned by the library, such as labels, with the current allocator
+void JDX_Free(void *pointer);
+
+JDXContext *JDX_AllocContext(void);
+void JDX_FreeContext(JDXContext *context);
+
 JDXHeader *JDX_AllocHeader(void);
 void JDX_FreeHeader(JDXHeader *header);
 void JDX_CopyHeader(JDXHeader *dest, const JDXHeader *src);
 
 size_t JDX_GetImageSize(const JDXHeader *header);
 
+// Finds the number of a label by its string, returning JDXError_UNKNOWN_LABEL if the header does not have it. Lookups
+// never modify the header, so any number of threads can look up labels in the same header at once
+JDXError JDX_FindLabel(JDXLabel *dest, const JDXHeader *header, const char *label);
+
 JDXError JDX_ReadHeaderFromFile(JDXHeader *dest, FILE *file);
 JDXError JDX_ReadHeaderFromPath(JDXHeader *dest, const char *path);
 JDXError JDX_WriteHeaderToFile(JDXHeader *header, FILE *file);
@@ -88,13 +305,103 @@ JDXError JDX_AppendDataset(JDXDataset *dest, const JDXDataset *src);
 
 JDXImage *JDX_GetImage(const JDXDataset *dataset, uint64_t index);
 
+// Views are valid until the dataset is modified or freed, and must not be freed themselves
+JDXError JDX_GetImageView(JDXImageView *dest, const JDXDataset *dataset, uint64_t index);
+
+// Gathers the images and labels at the given indices into contiguous caller-provided buffers, either of which may be NULL
+JDXError JDX_GetBatch(
+	uint8_t *pixel_dest,
+	JDXLabel *label_dest,
+	const JDXDataset *dataset,
+	const uint64_t *indices,
+	uint64_t index_count
+);
+
+JDXError JDX_GetBatchWithOptions(
+	uint8_t *pixel_dest,
+	JDXLabel *label_dest,
+	const JDXDataset *dataset,
+	const uint64_t *indices,
+	uint64_t index_count,
+	const JDXReadOptions *options
+);
+
+// Converts consecutive images shaped like the header, so a single image and a gathered batch are handled alike.
+// Bit depths other than 8, 24 and 32 and unknown layouts return JDXError_UNSUPPORTED_CONVERSION
+JDXError JDX_ConvertToFloat(float *dest, JDXLayout layout, const uint8_t *src, const JDXHeader *header, uint64_t image_count);
+JDXError JDX_ConvertToPlanar(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint64_t image_count);
+JDXError JDX_ConvertBitDepth(uint8_t *dest, uint8_t dest_bit_depth, const uint8_t *src, const JDXHeader *header, uint64_t image_count);
+
+JDXError JDX_ReadImageFromFile(JDXImage **dest, FILE *file, uint64_t index);
+JDXError JDX_ReadImageFromPath(JDXImage **dest, const char *path, uint64_t index);
+
 JDXError JDX_ReadDatasetFromFile(JDXDataset *dest, FILE *file);
 JDXError JDX_ReadDatasetFromPath(JDXDataset *dest, const char *path);
+JDXError JDX_ReadDatasetFromFileWithOptions(JDXDataset *dest, FILE *file, const JDXReadOptions *options);
+JDXError JDX_ReadDatasetFromPathWithOptions(JDXDataset *dest, const char *path, const JDXReadOptions *options);
+
+// Decodes chunks straight from a read-only mapping of the file. The pixels of stored, unfiltered files point into the
+// mapping itself, so they must not be written to, and since they are never copied their checksums are not checked
+JDXError JDX_MapDatasetFromPath(JDXDataset *dest, const char *path, const JDXReadOptions *options);
+
+// Reads the header and the label of every image without decompressing any pixels, with the labels freed by JDX_Free
+JDXError JDX_ReadLabelsFromFile(JDXLabel **dest, JDXHeader *header_dest, FILE *file);
+JDXError JDX_ReadLabelsFromPath(JDXLabel **dest, JDXHeader *header_dest, const char *path);
+
+// Loads only the images with one of the given labels, decompressing only the chunks that contain them
+JDXError JDX_ReadDatasetWithLabelsFromPath(JDXDataset *dest, const char *path, const JDXLabel *labels, uint16_t label_count);
+
+// Checks every stream of a file against its checksum without decompressing it, returning JDXError_CORRUPT_FILE on any
+// mismatch or truncation. Files from before 0.5.1 have no checksums, so they are decoded in full instead
+JDXError JDX_VerifyFile(FILE *file);
+JDXError JDX_VerifyPath(const char *path);
+JDXError JDX_VerifyFileWithOptions(FILE *file, const JDXReadOptions *options);
+JDXError JDX_VerifyPathWithOptions(const char *path, const JDXReadOptions *options);
+
+// Manifests list shard files that share one shape and label table, which are loaded concurrently into one dataset
+// Writing one returns JDXError_OUT_OF_BOUNDS for labels or shard paths that contain a line break
+JDXError JDX_ReadDatasetFromManifest(JDXDataset *dest, const char *path, const JDXReadOptions *options);
+JDXError JDX_WriteManifestToPath(const JDXHeader *header, const char *const *shard_paths, uint32_t shard_count, const char *path);
+
+// Writing a dataset to a stream that cannot seek, such as a pipe, goes through a temporary file that is then copied to it
 JDXError JDX_WriteDatasetToFile(JDXDataset *dataset, FILE *file);
 JDXError JDX_WriteDatasetToPath(JDXDataset *dataset, const char *path);
+JDXError JDX_WriteDatasetToFileWithOptions(JDXDataset *dataset, FILE *file, const JDXWriteOptions *options);
+JDXError JDX_WriteDatasetToPathWithOptions(JDXDataset *dataset, const char *path, const JDXWriteOptions *options);
+
+// Appends to a file in place, rewriting only its last partial chunk, its label streams and its offset table. Labels are
+// matched by name and must already be in the file. Files since 0.5 keep their codec, filters, chunk size and
+// deduplication, so only the thread count of the options applies to them. A failed append can leave the file unreadable.
+JDXError JDX_AppendDatasetToPath(JDXDataset *dataset, const char *path);
+JDXError JDX_AppendDatasetToPathWithOptions(JDXDataset *dataset, const char *path, const JDXWriteOptions *options);
 
 void JDX_FreeImage(JDXImage *image);
 
+JDXError JDX_OpenReaderFromFile(JDXReader **dest, FILE *file);
+JDXError JDX_OpenReaderFromPath(JDXReader **dest, const char *path);
+JDXError JDX_CloseReader(JDXReader *reader);
+
+// Views point into the reader and remain valid until the reader moves to another chunk or is closed
+JDXError JDX_ReadNextImage(JDXReader *reader, JDXImageView *dest);
+JDXError JDX_SeekReader(JDXReader *reader, uint64_t index);
+
+// Writers seek back to fill in the header when they are closed, so their files must be able to seek
+JDXError JDX_OpenWriterToFile(JDXWriter **dest, FILE *file, const JDXHeader *header, const JDXWriteOptions *options);
+JDXError JDX_OpenWriterToPath(JDXWriter **dest, const char *path, const JDXHeader *header, const JDXWriteOptions *options);
+// Continues the body of an existing file, whose header becomes the header of the writer. The image count and body size
+// in the file are only replaced once everything else is written on close, and the end of the file that the append
+// overwrites is kept in memory and put back if any write or the close fails. A crash or power loss partway through
+// can still leave the file unreadable, since that end is overwritten in place, as is the whole body of a legacy file
+JDXError JDX_OpenWriterForAppend(JDXWriter **dest, const char *path, const JDXWriteOptions *options);
+JDXError JDX_WriteNextImage(JDXWriter *writer, const uint8_t *image_data, JDXLabel label);
+JDXError JDX_CloseWriter(JDXWriter *writer);
+
+JDXError JDX_OpenIterator(JDXIterator **dest, const JDXDataset *dataset, const JDXIteratorOptions *options);
+JDXError JDX_CloseIterator(JDXIterator *iterator);
+
+// Returns JDXError_OUT_OF_BOUNDS once at the end of each epoch, after which batches of the next epoch follow
+JDXError JDX_NextBatch(JDXIterator *iterator, JDXBatch *dest);
+
 #ifdef __cplusplus
 }
 #endif
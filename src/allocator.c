@@ -0,0 +1,85 @@
+#include "libjdx.h"
+#include "allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libdeflate.h>
+
+static void *default_alloc(size_t size, void *context) {
+	return malloc(size);
+}
+
+static void *default_realloc(void *pointer, size_t size, void *context) {
+	return realloc(pointer, size);
+}
+
+static void default_free(void *pointer, void *context) {
+	free(pointer);
+}
+
+static JDXAllocator allocator = {
+	.alloc = default_alloc,
+	.realloc = default_realloc,
+	.free = default_free,
+	.context = NULL
+};
+
+void JDX_SetAllocator(const JDXAllocator *new_allocator) {
+	if (new_allocator) {
+		allocator = *new_allocator;
+	} else {
+		allocator = (JDXAllocator) { default_alloc, default_realloc, default_free, NULL };
+	}
+
+	// libdeflate allocates its compressors and decompressors itself, so they are routed through the same allocator
+	libdeflate_set_memory_allocator(allocate, deallocate);
+}
+
+void JDX_Free(void *pointer) {
+	deallocate(pointer);
+}
+
+void *allocate(size_t size) {
+	// Zero-sized requests may legitimately return NULL from malloc, which callers would mistake for a failure
+	return allocator.alloc(size > 0 ? size : 1, allocator.context);
+}
+
+void *allocate_zeroed(size_t count, size_t size) {
+	if (size > 0 && count > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	void *pointer = allocate(count * size);
+
+	if (pointer) {
+		memset(pointer, 0, count * size);
+	}
+
+	return pointer;
+}
+
+void *reallocate(void *pointer, size_t size) {
+	if (pointer == NULL) {
+		return allocate(size);
+	}
+
+	return allocator.realloc(pointer, size > 0 ? size : 1, allocator.context);
+}
+
+void deallocate(void *pointer) {
+	if (pointer) {
+		allocator.free(pointer, allocator.context);
+	}
+}
+
+char *duplicate_string(const char *string) {
+	size_t size = strlen(string) + 1;
+	char *copy = allocate(size);
+
+	if (copy) {
+		memcpy(copy, string, size);
+	}
+
+	return copy;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+// Every allocation of the library goes through the allocator set with JDX_SetAllocator
+void *allocate(size_t size);
+void *allocate_zeroed(size_t count, size_t size);
+void *reallocate(void *pointer, size_t size);
+void deallocate(void *pointer);
+
+char *duplicate_string(const char *string);
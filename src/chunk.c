@@ -0,0 +1,1169 @@
+#include "trycatch.h"
+#include "libjdx.h"
+#include "parallel.h"
+#include "chunk.h"
+#include "context.h"
+#include "filter.h"
+#include "leio.h"
+#include "loader.h"
+#include "stats.h"
+#include "allocator.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libdeflate.h>
+
+// First version whose body is split into independently compressed chunks
+static const JDXVersion CHUNKED_BODY_VERSION = { JDX_BUILD_DEV, 0, 5, 0 };
+
+// First version that stores a checksum of every stream after the offset table
+static const JDXVersion CHECKSUMMED_BODY_VERSION = { JDX_BUILD_DEV, 1, 5, 0 };
+
+bool has_chunked_body(const JDXHeader *header) {
+	return JDX_CompareVersions(header->version, CHUNKED_BODY_VERSION) >= 0;
+}
+
+bool has_checksummed_body(const JDXHeader *header) {
+	return JDX_CompareVersions(header->version, CHECKSUMMED_BODY_VERSION) >= 0;
+}
+
+JDXError resolve_compression(uint8_t *level_dest, JDXCodec codec, uint8_t level) {
+	if (codec > JDXCodec_GZIP || level > MAX_COMPRESSION_LEVEL) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	// Stored bodies record a level of 0, since nothing was compressed
+	if (codec == JDXCodec_STORED) {
+		*level_dest = 0;
+	} else {
+		*level_dest = level ? level : DEFAULT_COMPRESSION_LEVEL;
+	}
+
+	return JDXError_NONE;
+}
+
+uint32_t default_chunk_image_count(size_t image_size) {
+	size_t chunk_image_count = DEFAULT_CHUNK_SIZE / (image_size + sizeof(JDXLabel));
+
+	if (chunk_image_count == 0) {
+		return 1;
+	} else if (chunk_image_count > UINT32_MAX) {
+		return UINT32_MAX;
+	}
+
+	return (uint32_t) chunk_image_count;
+}
+
+uint64_t get_chunk_count(uint64_t image_count, uint64_t chunk_image_count) {
+	return chunk_image_count ? (image_count + chunk_image_count - 1) / chunk_image_count : 0;
+}
+
+uint64_t get_images_in_chunk(const ChunkIndex *index, const JDXHeader *header, uint64_t chunk) {
+	uint64_t first_image = chunk * index->chunk_image_count;
+	uint64_t remaining = header->image_count - first_image;
+
+	return remaining < index->chunk_image_count ? remaining : index->chunk_image_count;
+}
+
+uint64_t get_stream_count(const ChunkIndex *index) {
+	if (index->interleaved) {
+		return index->chunk_count;
+	}
+
+	return (index->deduplicated ? 3 : 2) * index->chunk_count;
+}
+
+JDXError read_body_descriptor(ChunkIndex *dest, const JDXHeader *header, FILE *file) {
+	ChunkIndex index = { .offsets = NULL };
+
+	if (!has_chunked_body(header)) {
+		// Bodies before 0.5 are one compressed stream preceded by its size, so treat them as a single chunk
+		uint64_t compressed_size;
+		if (fread(&compressed_size, sizeof(compressed_size), 1, file) != 1) {
+			return JDXError_READ_FILE;
+		}
+
+		index.offsets = allocate(2 * sizeof(uint64_t));
+
+		if (index.offsets == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+
+		index.codec = JDXCodec_DEFLATE;
+		index.compression_level = DEFAULT_COMPRESSION_LEVEL;
+		index.interleaved = true;
+		index.chunk_image_count = header->image_count;
+		index.chunk_count = 1;
+		index.data_size = compressed_size;
+		index.offsets[0] = 0;
+		index.offsets[1] = compressed_size;
+
+		*dest = index;
+		return JDXError_NONE;
+	}
+
+	uint8_t codec;
+	uint32_t chunk_image_count;
+	if (
+		fread_le(&codec, sizeof(codec), file) == EOF ||
+		fread_le(&index.compression_level, sizeof(index.compression_level), file) == EOF ||
+		fread_le(&index.filters, sizeof(index.filters), file) == EOF ||
+		fread_le(&chunk_image_count, sizeof(chunk_image_count), file) == EOF ||
+		fread_le(&index.data_size, sizeof(index.data_size), file) == EOF
+	) { return JDXError_READ_FILE; }
+
+	index.deduplicated = index.filters & BODY_DEDUPLICATED;
+	index.filters &= ~BODY_DEDUPLICATED;
+
+	if (codec > JDXCodec_GZIP || !are_filter_flags_valid(index.filters) || (chunk_image_count == 0 && header->image_count > 0)) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	index.codec = (JDXCodec) codec;
+	index.checksummed = has_checksummed_body(header);
+	index.chunk_image_count = chunk_image_count;
+	index.chunk_count = get_chunk_count(header->image_count, chunk_image_count);
+
+	*dest = index;
+	return JDXError_NONE;
+}
+
+JDXError read_chunk_offsets(ChunkIndex *index, FILE *file) {
+	// Legacy bodies have their only chunk filled in by read_body_descriptor
+	if (index->offsets) {
+		return JDXError_NONE;
+	}
+
+	uint64_t stream_count = get_stream_count(index);
+	size_t checksum_count = index->checksummed ? (size_t) stream_count : 0;
+	uint64_t *offsets = allocate((size_t) (stream_count + 1) * sizeof(uint64_t) + checksum_count * sizeof(uint32_t));
+
+	if (offsets == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	uint32_t *checksums = index->checksummed ? (uint32_t *) (offsets + stream_count + 1) : NULL;
+
+	TRY {
+		for (uint_fast64_t c = 0; c <= stream_count; c++) {
+			if (fread_le(&offsets[c], sizeof(uint64_t), file) == EOF) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			// Offsets must be ascending, start at zero, and end exactly at the offset table
+			if ((c == 0 && offsets[c] != 0) || (c > 0 && offsets[c] < offsets[c - 1])) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+		}
+
+		if (offsets[stream_count] != index->data_size) {
+			THROW(JDXError_CORRUPT_FILE);
+		}
+
+		for (size_t c = 0; c < checksum_count; c++) {
+			if (fread_le(&checksums[c], sizeof(uint32_t), file) == EOF) {
+				THROW(JDXError_READ_FILE);
+			}
+		}
+	} CATCH(error) {
+		deallocate(offsets);
+		return error;
+	}
+
+	index->offsets = offsets;
+	index->checksums = checksums;
+
+	return JDXError_NONE;
+}
+
+void free_chunk_index(ChunkIndex *index) {
+	deallocate(index->offsets);
+
+	index->offsets = NULL;
+	index->checksums = NULL;
+}
+
+bool is_stream_intact(const ChunkIndex *index, uint64_t stream, const uint8_t *stream_data, size_t stream_size) {
+	return index->checksums == NULL || libdeflate_crc32(0, stream_data, stream_size) == index->checksums[stream];
+}
+
+JDXError read_references(uint64_t *dest, const ChunkIndex *index, FILE *file, int64_t data_start, uint64_t chunk_count) {
+	if (chunk_count == 0) {
+		return JDXError_NONE;
+	}
+
+	// The reference streams of the chunks are contiguous, so all of them are read with one seek
+	uint64_t first_stream = 2 * index->chunk_count;
+	uint64_t read_start = index->offsets[first_stream];
+	size_t read_size = (size_t) (index->offsets[first_stream + chunk_count] - read_start);
+
+	uint8_t *reference_data = allocate(read_size > 0 ? read_size : 1);
+	struct libdeflate_decompressor *decompressor = libdeflate_alloc_decompressor();
+
+	TRY {
+		if (reference_data == NULL || decompressor == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		} else if (
+			fseek_64(file, data_start + (int64_t) read_start, SEEK_SET) != 0 ||
+			fread(reference_data, 1, read_size, file) != read_size
+		) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		for (uint64_t c = 0; c < chunk_count; c++) {
+			const uint8_t *stream_data = reference_data + (index->offsets[first_stream + c] - read_start);
+			size_t stream_size = (size_t) (index->offsets[first_stream + c + 1] - index->offsets[first_stream + c]);
+
+			if (!is_stream_intact(index, first_stream + c, stream_data, stream_size)) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+
+			JDXError decode_error = decode_chunk(
+				decompressor,
+				index->codec,
+				stream_data,
+				stream_size,
+				(uint8_t *) (dest + c * index->chunk_image_count),
+				sizeof(uint64_t) * (size_t) index->chunk_image_count
+			);
+
+			if (decode_error) {
+				THROW(decode_error);
+			}
+		}
+	} CATCH(error) {
+		libdeflate_free_decompressor(decompressor);
+		deallocate(reference_data);
+
+		return error;
+	}
+
+	libdeflate_free_decompressor(decompressor);
+	deallocate(reference_data);
+
+	return JDXError_NONE;
+}
+
+uint64_t count_stored_images(const uint64_t *references, uint64_t image_count) {
+	uint64_t stored_images = 0;
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		stored_images += references[i] == 0;
+	}
+
+	return stored_images;
+}
+
+void place_stored_images(uint8_t *image_data, const uint64_t *references, size_t image_size, uint64_t image_count) {
+	// Stored images only ever move back, so moving the last one first never overwrites one that has yet to move
+	uint64_t stored = count_stored_images(references, image_count);
+
+	for (uint64_t i = image_count; i-- > 0 && stored > 0;) {
+		if (references[i] == 0 && --stored != i) {
+			memcpy(image_data + image_size * (size_t) i, image_data + image_size * (size_t) stored, image_size);
+		}
+	}
+}
+
+void deinterleave_chunk(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const uint8_t *src,
+	size_t image_size,
+	uint64_t image_count
+) {
+	for (uint_fast64_t i = 0; i < image_count; i++) {
+		// Images are skipped when only the labels are wanted
+		if (image_data) {
+			memcpy(image_data, src, image_size);
+			image_data += image_size;
+		}
+
+		src += image_size;
+
+		memcpy(&labels[i], src, sizeof(JDXLabel));
+		src += sizeof(JDXLabel);
+	}
+}
+
+static size_t get_compress_bound(struct libdeflate_compressor *compressor, JDXCodec codec, size_t size) {
+	switch (codec) {
+		case JDXCodec_ZLIB: return libdeflate_zlib_compress_bound(compressor, size);
+		case JDXCodec_GZIP: return libdeflate_gzip_compress_bound(compressor, size);
+		default: return libdeflate_deflate_compress_bound(compressor, size);
+	}
+}
+
+// Grows an array of pointers or sizes, zeroing the new entries so that they read as not yet allocated
+static bool grow_array(void *array_ptr, uint32_t count, uint32_t new_count, size_t item_size) {
+	void **array = array_ptr;
+
+	if (new_count <= count && *array) {
+		return true;
+	}
+
+	uint8_t *grown = reallocate(*array, new_count * item_size);
+
+	if (grown == NULL) {
+		return false;
+	}
+
+	memset(grown + count * item_size, 0, (new_count - count) * item_size);
+	*array = grown;
+
+	return true;
+}
+
+JDXError reserve_chunk_compressor(
+	ChunkCompressor *compressor,
+	JDXCodec codec,
+	uint8_t compression_level,
+	uint32_t slot_count,
+	size_t max_chunk_size
+) {
+	uint32_t capacity = compressor->slot_capacity;
+	uint32_t new_capacity = slot_count > capacity ? slot_count : capacity;
+
+	if (
+		!grow_array(&compressor->compressors, capacity, new_capacity, sizeof(struct libdeflate_compressor *)) ||
+		!grow_array(&compressor->uncompressed_chunks, capacity, new_capacity, sizeof(uint8_t *)) ||
+		!grow_array(&compressor->compressed_chunks, capacity, new_capacity, sizeof(uint8_t *)) ||
+		!grow_array(&compressor->uncompressed_sizes, capacity, new_capacity, sizeof(size_t)) ||
+		!grow_array(&compressor->compressed_sizes, capacity, new_capacity, sizeof(size_t)) ||
+		!grow_array(&compressor->checksums, capacity, new_capacity, sizeof(uint32_t))
+	) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	compressor->slot_capacity = new_capacity;
+
+	// libdeflate compressors are bound to a single level, so those of any other level are replaced
+	if (compression_level != compressor->compression_level) {
+		for (uint32_t s = 0; s < new_capacity; s++) {
+			libdeflate_free_compressor(compressor->compressors[s]);
+			compressor->compressors[s] = NULL;
+		}
+	}
+
+	// Chunks that would not fit are replaced rather than resized, since nothing in them needs to be kept
+	if (max_chunk_size > compressor->uncompressed_capacity || compressor->uncompressed_capacity == 0) {
+		for (uint32_t s = 0; s < new_capacity; s++) {
+			deallocate(compressor->uncompressed_chunks[s]);
+			compressor->uncompressed_chunks[s] = NULL;
+		}
+
+		compressor->uncompressed_capacity = max_chunk_size > 0 ? max_chunk_size : 1;
+	}
+
+	compressor->codec = codec;
+	compressor->compression_level = compression_level;
+
+	for (uint32_t s = 0; s < slot_count; s++) {
+		if (compressor->uncompressed_chunks[s] == NULL) {
+			compressor->uncompressed_chunks[s] = allocate(compressor->uncompressed_capacity);
+
+			if (compressor->uncompressed_chunks[s] == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+		}
+
+		// Stored chunks are written straight from their uncompressed buffers
+		if (codec == JDXCodec_STORED) {
+			continue;
+		}
+
+		if (compressor->compressors[s] == NULL) {
+			compressor->compressors[s] = libdeflate_alloc_compressor(compression_level);
+
+			if (compressor->compressors[s] == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+		}
+
+		// Bound the output by libdeflate's worst case so that incompressible chunks still succeed
+		size_t compressed_capacity = get_compress_bound(compressor->compressors[s], codec, compressor->uncompressed_capacity);
+
+		if (compressed_capacity > compressor->compressed_capacity) {
+			for (uint32_t c = 0; c < new_capacity; c++) {
+				deallocate(compressor->compressed_chunks[c]);
+				compressor->compressed_chunks[c] = NULL;
+			}
+
+			compressor->compressed_capacity = compressed_capacity;
+		}
+
+		if (compressor->compressed_chunks[s] == NULL) {
+			compressor->compressed_chunks[s] = allocate(compressor->compressed_capacity);
+
+			if (compressor->compressed_chunks[s] == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+		}
+	}
+
+	compressor->slot_count = slot_count;
+	return JDXError_NONE;
+}
+
+void free_chunk_compressor(ChunkCompressor *compressor) {
+	for (uint32_t s = 0; s < compressor->slot_capacity; s++) {
+		if (compressor->compressors) {
+			libdeflate_free_compressor(compressor->compressors[s]);
+		}
+
+		if (compressor->uncompressed_chunks) {
+			deallocate(compressor->uncompressed_chunks[s]);
+		}
+
+		if (compressor->compressed_chunks) {
+			deallocate(compressor->compressed_chunks[s]);
+		}
+	}
+
+	deallocate(compressor->compressors);
+	deallocate(compressor->uncompressed_chunks);
+	deallocate(compressor->compressed_chunks);
+	deallocate(compressor->uncompressed_sizes);
+	deallocate(compressor->compressed_sizes);
+	deallocate(compressor->checksums);
+	deallocate(compressor->slot_stats);
+
+	*compressor = (ChunkCompressor) { .slot_count = 0 };
+}
+
+JDXError enable_compressor_stats(ChunkCompressor *compressor, JDXStats *stats) {
+	// Reserved compressors may still hold the stats of their previous write
+	deallocate(compressor->slot_stats);
+
+	compressor->stats = NULL;
+	compressor->slot_stats = NULL;
+
+	if (stats == NULL) {
+		return JDXError_NONE;
+	}
+
+	if ((compressor->slot_stats = allocate_zeroed(compressor->slot_count, sizeof(JDXStats))) == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	compressor->stats = stats;
+	return JDXError_NONE;
+}
+
+static void compress_chunk_task(void *context, uint64_t slot, uint32_t worker) {
+	ChunkCompressor *compressor = context;
+
+	struct libdeflate_compressor *slot_compressor = compressor->compressors[slot];
+	const uint8_t *src = compressor->uncompressed_chunks[slot];
+	size_t src_size = compressor->uncompressed_sizes[slot];
+	uint8_t *dest = compressor->compressed_chunks[slot];
+	size_t dest_capacity = compressor->compressed_capacity;
+
+	JDXStats *stats = compressor->slot_stats ? &compressor->slot_stats[slot] : NULL;
+
+	// Stored chunks are written straight from their uncompressed buffers, so only their checksums are computed
+	if (compressor->codec == JDXCodec_STORED) {
+		compressor->compressed_sizes[slot] = src_size;
+		compressor->checksums[slot] = libdeflate_crc32(0, src, src_size);
+
+		add_codec_bytes(stats, src_size, src_size);
+		return;
+	}
+
+	uint64_t start = get_stats_clock(stats);
+
+	// libdeflate will return 0 if operation failed, which is checked once all slots are done
+	switch (compressor->codec) {
+		case JDXCodec_ZLIB:
+			compressor->compressed_sizes[slot] = libdeflate_zlib_compress(slot_compressor, src, src_size, dest, dest_capacity);
+			break;
+		case JDXCodec_GZIP:
+			compressor->compressed_sizes[slot] = libdeflate_gzip_compress(slot_compressor, src, src_size, dest, dest_capacity);
+			break;
+		default:
+			compressor->compressed_sizes[slot] = libdeflate_deflate_compress(slot_compressor, src, src_size, dest, dest_capacity);
+			break;
+	}
+
+	compressor->checksums[slot] = libdeflate_crc32(0, dest, compressor->compressed_sizes[slot]);
+
+	add_phase_time(stats, JDXPhase_COMPRESS, start);
+	add_codec_bytes(stats, compressor->compressed_sizes[slot], src_size);
+}
+
+JDXError compress_chunks(ChunkCompressor *compressor, uint32_t chunk_count) {
+	parallel_for(chunk_count, compressor->slot_count, compress_chunk_task, compressor);
+
+	for (uint32_t s = 0; s < chunk_count; s++) {
+		if (compressor->compressed_sizes[s] == 0 && compressor->codec != JDXCodec_STORED) {
+			return JDXError_WRITE_FILE;
+		}
+
+		// Each slot was compressed by a single worker, so its stats are only merged once every worker is done
+		if (compressor->stats) {
+			merge_stats(compressor->stats, &compressor->slot_stats[s]);
+			memset(&compressor->slot_stats[s], 0, sizeof(JDXStats));
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+JDXError write_compressed_chunks(
+	ChunkCompressor *compressor,
+	uint32_t chunk_count,
+	uint64_t *offsets,
+	uint32_t *checksums,
+	FILE *file
+) {
+	uint64_t start = get_stats_clock(compressor->stats);
+
+	// Chunks are written in slot order, with offsets[0] being the offset of the first chunk written
+	for (uint32_t s = 0; s < chunk_count; s++) {
+		size_t compressed_size = compressor->compressed_sizes[s];
+		const uint8_t *compressed_chunk = (
+			compressor->codec == JDXCodec_STORED
+				? compressor->uncompressed_chunks[s]
+				: compressor->compressed_chunks[s]
+		);
+
+		if (fwrite(compressed_chunk, 1, compressed_size, file) != compressed_size) {
+			return JDXError_WRITE_FILE;
+		}
+
+		offsets[s + 1] = offsets[s] + compressed_size;
+		checksums[s] = compressor->checksums[s];
+	}
+
+	if (compressor->stats) {
+		compressor->stats->bytes_written += offsets[chunk_count] - offsets[0];
+		add_phase_time(compressor->stats, JDXPhase_WRITE, start);
+	}
+
+	return JDXError_NONE;
+}
+
+JDXError reserve_chunk_decompressor(ChunkDecompressor *decompressor, uint32_t worker_count, size_t max_chunk_size) {
+	uint32_t capacity = decompressor->worker_capacity;
+	uint32_t new_capacity = worker_count > capacity ? worker_count : capacity;
+
+	if (
+		!grow_array(&decompressor->decompressors, capacity, new_capacity, sizeof(struct libdeflate_decompressor *)) ||
+		!grow_array(&decompressor->decompressed_chunks, capacity, new_capacity, sizeof(uint8_t *))
+	) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	decompressor->worker_capacity = new_capacity;
+
+	if (max_chunk_size > decompressor->decompressed_capacity || decompressor->decompressed_capacity == 0) {
+		for (uint32_t w = 0; w < new_capacity; w++) {
+			deallocate(decompressor->decompressed_chunks[w]);
+			decompressor->decompressed_chunks[w] = NULL;
+		}
+
+		decompressor->decompressed_capacity = max_chunk_size > 0 ? max_chunk_size : 1;
+	}
+
+	for (uint32_t w = 0; w < worker_count; w++) {
+		if (decompressor->decompressors[w] == NULL) {
+			decompressor->decompressors[w] = libdeflate_alloc_decompressor();
+		}
+
+		if (decompressor->decompressed_chunks[w] == NULL) {
+			decompressor->decompressed_chunks[w] = allocate(decompressor->decompressed_capacity);
+		}
+
+		if (decompressor->decompressors[w] == NULL || decompressor->decompressed_chunks[w] == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+	}
+
+	decompressor->worker_count = worker_count;
+	return JDXError_NONE;
+}
+
+void free_chunk_decompressor(ChunkDecompressor *decompressor) {
+	for (uint32_t w = 0; w < decompressor->worker_capacity; w++) {
+		if (decompressor->decompressors) {
+			libdeflate_free_decompressor(decompressor->decompressors[w]);
+		}
+
+		if (decompressor->decompressed_chunks) {
+			deallocate(decompressor->decompressed_chunks[w]);
+		}
+	}
+
+	deallocate(decompressor->decompressors);
+	deallocate(decompressor->decompressed_chunks);
+	deallocate(decompressor->worker_stats);
+
+	*decompressor = (ChunkDecompressor) { .worker_count = 0 };
+}
+
+JDXError decode_chunk(
+	struct libdeflate_decompressor *decompressor,
+	JDXCodec codec,
+	const uint8_t *src,
+	size_t src_size,
+	uint8_t *dest,
+	size_t dest_size
+) {
+	if (codec == JDXCodec_STORED) {
+		if (src_size != dest_size) {
+			return JDXError_CORRUPT_FILE;
+		}
+
+		memcpy(dest, src, dest_size);
+		return JDXError_NONE;
+	}
+
+	enum libdeflate_result decompress_result;
+
+	switch (codec) {
+		case JDXCodec_ZLIB:
+			decompress_result = libdeflate_zlib_decompress(decompressor, src, src_size, dest, dest_size, NULL);
+			break;
+		case JDXCodec_GZIP:
+			decompress_result = libdeflate_gzip_decompress(decompressor, src, src_size, dest, dest_size, NULL);
+			break;
+		default:
+			decompress_result = libdeflate_deflate_decompress(decompressor, src, src_size, dest, dest_size, NULL);
+			break;
+	}
+
+	return decompress_result == LIBDEFLATE_SUCCESS ? JDXError_NONE : JDXError_CORRUPT_FILE;
+}
+
+typedef struct {
+	ChunkDecompressor *decompressor;
+	const ChunkIndex *index;
+	const JDXHeader *header;
+	const uint8_t *chunk_data;
+
+	uint8_t *image_data;
+	JDXLabel *labels;
+
+	// Streams still being read into chunk_data, or NULL if the whole body was read beforehand
+	ChunkLoader *loader;
+
+	// Reference of every image, only for deduplicated bodies whose pixels are wanted
+	uint64_t *references;
+
+	atomic_bool corrupt;
+	atomic_bool read_failed;
+} DecompressionJob;
+
+static void decompress_interleaved_chunk(DecompressionJob *job, uint64_t chunk, uint32_t worker) {
+	JDXStats *stats = job->decompressor->worker_stats ? &job->decompressor->worker_stats[worker] : NULL;
+
+	size_t image_size = JDX_GetImageSize(job->header);
+	uint64_t first_image = chunk * job->index->chunk_image_count;
+	uint64_t chunk_images = get_images_in_chunk(job->index, job->header, chunk);
+	size_t compressed_size = job->index->offsets[chunk + 1] - job->index->offsets[chunk];
+	size_t chunk_size = (image_size + sizeof(JDXLabel)) * (size_t) chunk_images;
+
+	uint64_t start = get_stats_clock(stats);
+
+	JDXError decode_error = decode_chunk(
+		job->decompressor->decompressors[worker],
+		job->index->codec,
+		job->chunk_data + job->index->offsets[chunk],
+		compressed_size,
+		job->decompressor->decompressed_chunks[worker],
+		chunk_size
+	);
+
+	if (decode_error) {
+		atomic_store(&job->corrupt, true);
+		return;
+	}
+
+	add_phase_time(stats, JDXPhase_DECOMPRESS, start);
+	add_codec_bytes(stats, compressed_size, chunk_size);
+	start = get_stats_clock(stats);
+
+	deinterleave_chunk(
+		job->image_data ? job->image_data + image_size * (size_t) first_image : NULL,
+		job->labels + first_image,
+		job->decompressor->decompressed_chunks[worker],
+		image_size,
+		chunk_images
+	);
+
+	add_phase_time(stats, JDXPhase_COPY, start);
+}
+
+static void decompress_chunk_task(void *context, uint64_t chunk, uint32_t worker) {
+	DecompressionJob *job = context;
+
+	if (job->index->interleaved) {
+		decompress_interleaved_chunk(job, chunk, worker);
+		return;
+	}
+
+	JDXStats *stats = job->decompressor->worker_stats ? &job->decompressor->worker_stats[worker] : NULL;
+
+	size_t image_size = JDX_GetImageSize(job->header);
+	uint64_t first_image = chunk * job->index->chunk_image_count;
+	uint64_t chunk_images = get_images_in_chunk(job->index, job->header, chunk);
+	uint64_t label_stream = job->index->chunk_count + chunk;
+	size_t label_size = sizeof(JDXLabel) * (size_t) chunk_images;
+	size_t compressed_label_size = job->index->offsets[label_stream + 1] - job->index->offsets[label_stream];
+
+	uint64_t start = get_stats_clock(stats);
+
+	// Chunks are claimed in the order they are read, so this only blocks when decoding has caught up with reading
+	if (job->loader) {
+		if (wait_for_chunk(job->loader, chunk) != JDXError_NONE) {
+			atomic_store(&job->read_failed, true);
+			return;
+		}
+
+		add_phase_time(stats, JDXPhase_READ, start);
+		start = get_stats_clock(stats);
+	}
+
+	if (!is_stream_intact(job->index, label_stream, job->chunk_data + job->index->offsets[label_stream], compressed_label_size)) {
+		atomic_store(&job->corrupt, true);
+		return;
+	}
+
+	// Both streams of a chunk are decoded straight into their place in the arrays, so workers never overlap
+	JDXError label_error = decode_chunk(
+		job->decompressor->decompressors[worker],
+		job->index->codec,
+		job->chunk_data + job->index->offsets[label_stream],
+		compressed_label_size,
+		(uint8_t *) (job->labels + first_image),
+		label_size
+	);
+
+	if (label_error) {
+		atomic_store(&job->corrupt, true);
+		return;
+	}
+
+	add_codec_bytes(stats, compressed_label_size, label_size);
+
+	// Pixels are skipped when only the labels are wanted
+	if (job->image_data == NULL) {
+		add_phase_time(stats, JDXPhase_DECOMPRESS, start);
+		return;
+	}
+
+	// Deduplicated chunks only store the images that do not refer to another, which are spread out once decoded
+	uint64_t stored_images = chunk_images;
+
+	if (job->index->deduplicated) {
+		uint64_t reference_stream = 2 * job->index->chunk_count + chunk;
+		size_t reference_size = sizeof(uint64_t) * (size_t) chunk_images;
+		size_t compressed_reference_size = job->index->offsets[reference_stream + 1] - job->index->offsets[reference_stream];
+		const uint8_t *reference_data = job->chunk_data + job->index->offsets[reference_stream];
+
+		if (
+			!is_stream_intact(job->index, reference_stream, reference_data, compressed_reference_size) ||
+			decode_chunk(
+				job->decompressor->decompressors[worker],
+				job->index->codec,
+				reference_data,
+				compressed_reference_size,
+				(uint8_t *) (job->references + first_image),
+				reference_size
+			) != JDXError_NONE
+		) {
+			atomic_store(&job->corrupt, true);
+			return;
+		}
+
+		add_codec_bytes(stats, compressed_reference_size, reference_size);
+		stored_images = count_stored_images(job->references + first_image, chunk_images);
+	}
+
+	size_t pixel_size = image_size * (size_t) stored_images;
+	size_t compressed_pixel_size = job->index->offsets[chunk + 1] - job->index->offsets[chunk];
+
+	if (!is_stream_intact(job->index, chunk, job->chunk_data + job->index->offsets[chunk], compressed_pixel_size)) {
+		atomic_store(&job->corrupt, true);
+		return;
+	}
+
+	JDXError image_error = decode_chunk(
+		job->decompressor->decompressors[worker],
+		job->index->codec,
+		job->chunk_data + job->index->offsets[chunk],
+		compressed_pixel_size,
+		job->image_data + image_size * (size_t) first_image,
+		pixel_size
+	);
+
+	if (image_error) {
+		atomic_store(&job->corrupt, true);
+		return;
+	}
+
+	add_phase_time(stats, JDXPhase_DECOMPRESS, start);
+	add_codec_bytes(stats, compressed_pixel_size, pixel_size);
+
+	if (job->index->filters) {
+		start = get_stats_clock(stats);
+
+		reverse_filters(
+			job->image_data + image_size * (size_t) first_image,
+			job->decompressor->decompressed_chunks[worker],
+			job->header,
+			job->index->filters,
+			stored_images
+		);
+
+		add_phase_time(stats, JDXPhase_FILTER, start);
+	}
+
+	if (job->index->deduplicated) {
+		start = get_stats_clock(stats);
+		place_stored_images(job->image_data + image_size * (size_t) first_image, job->references + first_image, image_size, chunk_images);
+		add_phase_time(stats, JDXPhase_COPY, start);
+	}
+}
+
+// Fills the images of a chunk that refer to another, once every chunk has placed its stored images
+static void copy_referenced_images_task(void *context, uint64_t chunk, uint32_t worker) {
+	DecompressionJob *job = context;
+	JDXStats *stats = job->decompressor->worker_stats ? &job->decompressor->worker_stats[worker] : NULL;
+
+	size_t image_size = JDX_GetImageSize(job->header);
+	uint64_t first_image = chunk * job->index->chunk_image_count;
+	uint64_t end_image = first_image + get_images_in_chunk(job->index, job->header, chunk);
+	uint64_t start = get_stats_clock(stats);
+
+	for (uint64_t i = first_image; i < end_image; i++) {
+		uint64_t reference = job->references[i];
+
+		if (reference == 0) {
+			continue;
+		}
+
+		// References always lead straight to a stored image, so the order that chunks are copied in never matters
+		if (reference > i || job->references[i - reference] != 0) {
+			atomic_store(&job->corrupt, true);
+			return;
+		}
+
+		memcpy(job->image_data + image_size * (size_t) i, job->image_data + image_size * (size_t) (i - reference), image_size);
+	}
+
+	add_phase_time(stats, JDXPhase_COPY, start);
+}
+
+JDXError decompress_chunks(
+	ChunkDecompressor *decompressor,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint8_t *image_data,
+	JDXLabel *labels,
+	ChunkLoader *loader
+) {
+	DecompressionJob job = {
+		.decompressor = decompressor,
+		.index = index,
+		.header = header,
+		.chunk_data = chunk_data,
+		.image_data = image_data,
+		.labels = labels,
+		.loader = loader
+	};
+
+	bool has_references = index->deduplicated && image_data && header->image_count > 0;
+
+	if (has_references) {
+		if ((job.references = allocate((size_t) header->image_count * sizeof(uint64_t))) == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+
+		add_allocation(decompressor->worker_stats, (size_t) header->image_count * sizeof(uint64_t));
+	}
+
+	atomic_init(&job.corrupt, false);
+	atomic_init(&job.read_failed, false);
+	parallel_for(index->chunk_count, decompressor->worker_count, decompress_chunk_task, &job);
+
+	if (has_references && !atomic_load(&job.read_failed) && !atomic_load(&job.corrupt)) {
+		parallel_for(index->chunk_count, decompressor->worker_count, copy_referenced_images_task, &job);
+	}
+
+	deallocate(job.references);
+
+	if (atomic_load(&job.read_failed)) {
+		return JDXError_READ_FILE;
+	}
+
+	return atomic_load(&job.corrupt) ? JDXError_CORRUPT_FILE : JDXError_NONE;
+}
+
+static JDXError decode_loaded_body_into(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	ChunkLoader *loader,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+) {
+	ChunkDecompressor local_decompressor = { .worker_count = 0 };
+	ChunkDecompressor *decompressor = context ? &context->decompressor : &local_decompressor;
+	size_t image_size = JDX_GetImageSize(header);
+
+	thread_count = resolve_thread_count(thread_count);
+
+	if (thread_count > index->chunk_count) {
+		thread_count = index->chunk_count > 0 ? (uint32_t) index->chunk_count : 1;
+	}
+
+	// Interleaved chunks go through scratch memory one chunk at a time, and split channels one image at a time
+	size_t scratch_size = 0;
+
+	if (index->interleaved) {
+		scratch_size = (image_size + sizeof(JDXLabel)) * (size_t) get_images_in_chunk(index, header, 0);
+	} else if (index->filters & FILTER_SPLIT_CHANNELS) {
+		scratch_size = image_size;
+	}
+
+	uint64_t start = get_stats_clock(stats);
+	size_t allocated_size = decompressor->decompressed_capacity * decompressor->worker_capacity;
+	JDXError decompressor_error = reserve_chunk_decompressor(decompressor, thread_count, scratch_size);
+
+	if (!decompressor_error && stats && (decompressor->worker_stats = allocate_zeroed(thread_count, sizeof(JDXStats))) == NULL) {
+		decompressor_error = JDXError_MEMORY_FAILURE;
+	}
+
+	if (!decompressor_error) {
+		add_phase_time(stats, JDXPhase_ALLOCATE, start);
+		add_allocation(stats, decompressor->decompressed_capacity * decompressor->worker_capacity - allocated_size);
+
+		decompressor_error = decompress_chunks(decompressor, index, header, chunk_data, image_data, labels, loader);
+	}
+
+	for (uint32_t w = 0; decompressor->worker_stats && w < thread_count; w++) {
+		merge_stats(stats, &decompressor->worker_stats[w]);
+	}
+
+	// Decompressors of a context outlive the call, but its stats do not
+	if (context) {
+		deallocate(decompressor->worker_stats);
+		decompressor->worker_stats = NULL;
+	} else {
+		free_chunk_decompressor(decompressor);
+	}
+
+	return decompressor_error;
+}
+
+JDXError decode_body_into(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+) {
+	return decode_loaded_body_into(image_data, labels, index, header, chunk_data, NULL, thread_count, stats, context);
+}
+
+JDXError decode_body(
+	uint8_t **image_dest,
+	JDXLabel **label_dest,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+) {
+	size_t image_size = JDX_GetImageSize(header);
+	uint64_t start = get_stats_clock(stats);
+
+	uint8_t *image_data = image_dest ? allocate(image_size * header->image_count) : NULL;
+	JDXLabel *labels = allocate(header->image_count * sizeof(JDXLabel));
+
+	add_phase_time(stats, JDXPhase_ALLOCATE, start);
+	add_allocation(stats, (image_dest ? image_size : 0) * header->image_count);
+	add_allocation(stats, header->image_count * sizeof(JDXLabel));
+
+	TRY {
+		if (header->image_count > 0 && ((image_dest && image_data == NULL) || labels == NULL)) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		JDXError decode_error = decode_body_into(image_data, labels, index, header, chunk_data, thread_count, stats, context);
+
+		if (decode_error) {
+			THROW(decode_error);
+		}
+	} CATCH(error) {
+		deallocate(image_data);
+		deallocate(labels);
+
+		return error;
+	}
+
+	if (image_dest) {
+		*image_dest = image_data;
+	}
+
+	*label_dest = labels;
+	return JDXError_NONE;
+}
+
+JDXError read_body_into(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const JDXHeader *header,
+	FILE *file,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	ChunkIndex chunk_index = { .offsets = NULL };
+	uint8_t *compressed_body = NULL;
+	ChunkLoader *loader = NULL;
+
+	TRY {
+		int64_t body_start = stats ? ftell_64(file) : -1;
+		JDXError body_error = read_body_descriptor(&chunk_index, header, file);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+
+		uint64_t start = get_stats_clock(stats);
+
+		// Bodies of several chunks in files that can seek have their offsets read first, so that their chunks can be
+		// read in the background while earlier ones are decoded. Anything else is read in one pass as before
+		int64_t data_start = chunk_index.interleaved || chunk_index.chunk_count < 2 ? -1 : ftell_64(file);
+		bool read_ahead = data_start >= 0 && fseek_64(file, data_start + (int64_t) chunk_index.data_size, SEEK_SET) == 0;
+
+		if (read_ahead) {
+			JDXError offsets_error = read_chunk_offsets(&chunk_index, file);
+
+			if (offsets_error) {
+				THROW(offsets_error);
+			}
+
+			add_phase_time(stats, JDXPhase_READ, start);
+		}
+
+		start = get_stats_clock(stats);
+
+		if (context == NULL) {
+			compressed_body = allocate((size_t) chunk_index.data_size);
+			add_allocation(stats, (size_t) chunk_index.data_size);
+		} else {
+			size_t body_capacity = context->body_capacity;
+
+			compressed_body = reserve_context_body(context, (size_t) chunk_index.data_size);
+			add_allocation(stats, context->body_capacity != body_capacity ? context->body_capacity : 0);
+		}
+
+		add_phase_time(stats, JDXPhase_ALLOCATE, start);
+
+		if (compressed_body == NULL && chunk_index.data_size > 0) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		if (read_ahead) {
+			JDXError loader_error = start_chunk_loader(&loader, file, data_start, &chunk_index, compressed_body);
+
+			if (loader_error == JDXError_MEMORY_FAILURE) {
+				THROW(loader_error);
+			}
+
+			// Files that cannot be read by position, such as pipes, are read through the stream and left after the table
+			if (loader_error) {
+				start = get_stats_clock(stats);
+				int64_t table_end = ftell_64(file);
+
+				if (
+					table_end < 0
+					|| fseek_64(file, data_start, SEEK_SET) != 0
+					|| fread(compressed_body, 1, chunk_index.data_size, file) != chunk_index.data_size
+					|| fseek_64(file, table_end, SEEK_SET) != 0
+				) {
+					THROW(JDXError_READ_FILE);
+				}
+
+				add_phase_time(stats, JDXPhase_READ, start);
+			}
+		} else {
+			start = get_stats_clock(stats);
+
+			if (fread(compressed_body, 1, chunk_index.data_size, file) != chunk_index.data_size) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			JDXError offsets_error = read_chunk_offsets(&chunk_index, file);
+
+			if (offsets_error) {
+				THROW(offsets_error);
+			}
+
+			add_phase_time(stats, JDXPhase_READ, start);
+		}
+
+		// Streams that cannot tell their position only count the body itself
+		int64_t body_end = stats ? ftell_64(file) : -1;
+
+		if (stats) {
+			stats->bytes_read += body_start >= 0 && body_end >= body_start ? (uint64_t) (body_end - body_start) : chunk_index.data_size;
+		}
+
+		JDXError decode_error = decode_loaded_body_into(
+			image_data,
+			labels,
+			&chunk_index,
+			header,
+			compressed_body,
+			loader,
+			thread_count,
+			stats,
+			context
+		);
+
+		// Reads still in flight write into the body, so the loader is always finished before the body is released
+		if (loader) {
+			JDXError loader_error = finish_chunk_loader(loader);
+			loader = NULL;
+
+			if (loader_error) {
+				THROW(loader_error);
+			}
+		}
+
+		if (decode_error) {
+			THROW(decode_error);
+		}
+	} CATCH(error) {
+		free_chunk_index(&chunk_index);
+
+		if (context == NULL) {
+			deallocate(compressed_body);
+		}
+
+		return error;
+	}
+
+	free_chunk_index(&chunk_index);
+
+	if (context == NULL) {
+		deallocate(compressed_body);
+	}
+
+	return JDXError_NONE;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Uncompressed size that chunks are sized towards when no image count per chunk is requested
+#define DEFAULT_CHUNK_SIZE (1 << 20)
+
+// Level used when the write options leave it at 0, which favors size since most datasets are written once
+#define DEFAULT_COMPRESSION_LEVEL 12
+#define MAX_COMPRESSION_LEVEL 12
+
+// Flag stored alongside the filters in the body descriptor for bodies whose duplicate images are written as references
+#define BODY_DEDUPLICATED 0x40
+
+typedef struct {
+	JDXCodec codec;
+	uint8_t compression_level;
+
+	// Filters applied to every image before its pixel stream was compressed, as encoded by get_filter_flags
+	uint8_t filters;
+
+	uint64_t chunk_image_count;
+	uint64_t chunk_count;
+
+	// Bodies before 0.5 are a single stream of images that are each followed by their label
+	bool interleaved;
+
+	// Deduplicated bodies follow the label streams with a reference stream for each chunk, holding for every image the
+	// distance back to the identical image whose pixels it shares, or 0 if its pixels are in the pixel stream of its chunk
+	bool deduplicated;
+
+	// Total size of the chunk data, which is immediately followed by the offset table
+	uint64_t data_size;
+
+	// Offset of the pixel stream of each chunk, then the label stream of each chunk, then the reference stream of each
+	// chunk if the body is deduplicated, relative to the start of the chunk data, plus a final entry equal to data_size
+	uint64_t *offsets;
+
+	// Bodies since 0.5.1 follow the offset table with the CRC32 of every compressed stream, in the same order.
+	// The checksums share the allocation of the offsets and are NULL for older bodies
+	bool checksummed;
+	uint32_t *checksums;
+} ChunkIndex;
+
+// Set of chunk buffers that are filled by the caller and then compressed concurrently, one slot per thread
+typedef struct {
+	JDXCodec codec;
+	uint8_t compression_level;
+	uint32_t slot_count;
+
+	// Slots and buffers only ever grow, so a compressor can be reserved again for other writes without reallocating
+	uint32_t slot_capacity;
+	size_t uncompressed_capacity;
+	size_t compressed_capacity;
+
+	struct libdeflate_compressor **compressors;
+	uint8_t **uncompressed_chunks;
+	uint8_t **compressed_chunks;
+	size_t *uncompressed_sizes;
+	size_t *compressed_sizes;
+
+	// CRC32 of each compressed chunk, computed by the same worker that compressed it
+	uint32_t *checksums;
+
+	// Stats are gathered per slot while compressing and then added to stats, if it is not NULL
+	JDXStats *stats;
+	JDXStats *slot_stats;
+} ChunkCompressor;
+
+// Decompressors and scratch chunks for each worker that decompresses chunks concurrently
+typedef struct {
+	uint32_t worker_count;
+
+	// Workers and scratch chunks only ever grow, like those of ChunkCompressor
+	uint32_t worker_capacity;
+	size_t decompressed_capacity;
+
+	struct libdeflate_decompressor **decompressors;
+	uint8_t **decompressed_chunks;
+
+	// Stats of each worker, or NULL if none are gathered
+	JDXStats *worker_stats;
+} ChunkDecompressor;
+
+// Reads the streams of a body in the background and in chunk order, so that chunks are decoded while later ones are
+// still being read. Reads go through io_uring on Linux, or through a small pool of threads calling pread otherwise
+typedef struct ChunkLoader ChunkLoader;
+
+bool has_chunked_body(const JDXHeader *header);
+bool has_checksummed_body(const JDXHeader *header);
+
+// Checks the codec and level of the write options, resolving a level of 0 to the default
+JDXError resolve_compression(uint8_t *level_dest, JDXCodec codec, uint8_t level);
+
+uint32_t default_chunk_image_count(size_t image_size);
+uint64_t get_chunk_count(uint64_t image_count, uint64_t chunk_image_count);
+uint64_t get_images_in_chunk(const ChunkIndex *index, const JDXHeader *header, uint64_t chunk);
+uint64_t get_stream_count(const ChunkIndex *index);
+
+JDXError read_body_descriptor(ChunkIndex *dest, const JDXHeader *header, FILE *file);
+// Reads the offset table, and the checksums that follow it if the body has them
+JDXError read_chunk_offsets(ChunkIndex *index, FILE *file);
+void free_chunk_index(ChunkIndex *index);
+
+// Checks a compressed stream against its checksum, which always succeeds for bodies without checksums
+bool is_stream_intact(const ChunkIndex *index, uint64_t stream, const uint8_t *stream_data, size_t stream_size);
+
+// Reads the reference streams of the first chunk_count chunks of a deduplicated body, which must all be full, into dest
+JDXError read_references(uint64_t *dest, const ChunkIndex *index, FILE *file, int64_t data_start, uint64_t chunk_count);
+
+uint64_t count_stored_images(const uint64_t *references, uint64_t image_count);
+
+// Moves the stored images of a chunk, which are decoded to the front of its images, to where their references place them
+void place_stored_images(uint8_t *image_data, const uint64_t *references, size_t image_size, uint64_t image_count);
+
+void deinterleave_chunk(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const uint8_t *src,
+	size_t image_size,
+	uint64_t image_count
+);
+
+// Readies a zeroed or previously reserved compressor for chunks of up to max_chunk_size, keeping whatever it already holds
+JDXError reserve_chunk_compressor(
+	ChunkCompressor *compressor,
+	JDXCodec codec,
+	uint8_t compression_level,
+	uint32_t slot_count,
+	size_t max_chunk_size
+);
+void free_chunk_compressor(ChunkCompressor *compressor);
+
+// Makes the compressor add its stats to stats from now on, or stop gathering them if stats is NULL
+JDXError enable_compressor_stats(ChunkCompressor *compressor, JDXStats *stats);
+
+JDXError decode_chunk(
+	struct libdeflate_decompressor *decompressor,
+	JDXCodec codec,
+	const uint8_t *src,
+	size_t src_size,
+	uint8_t *dest,
+	size_t dest_size
+);
+
+JDXError compress_chunks(ChunkCompressor *compressor, uint32_t chunk_count);
+JDXError write_compressed_chunks(
+	ChunkCompressor *compressor,
+	uint32_t chunk_count,
+	uint64_t *offsets,
+	uint32_t *checksums,
+	FILE *file
+);
+
+// Readies a zeroed or previously reserved decompressor for scratch chunks of up to max_chunk_size
+JDXError reserve_chunk_decompressor(ChunkDecompressor *decompressor, uint32_t worker_count, size_t max_chunk_size);
+void free_chunk_decompressor(ChunkDecompressor *decompressor);
+
+JDXError decompress_chunks(
+	ChunkDecompressor *decompressor,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint8_t *image_data,
+	JDXLabel *labels,
+	ChunkLoader *loader
+);
+
+// Fills arrays sized for every image of the header from every chunk of the body, skipping images if image_data is NULL.
+// The decompressors and scratch chunks are taken from context if it is not NULL
+JDXError decode_body_into(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+);
+
+// Allocates the image and label arrays and fills them from every chunk of the body, skipping images if image_dest is NULL
+JDXError decode_body(
+	uint8_t **image_dest,
+	JDXLabel **label_dest,
+	const ChunkIndex *index,
+	const JDXHeader *header,
+	const uint8_t *chunk_data,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+);
+
+// Reads the body that follows header in file and decodes it into arrays sized for every image of the header
+JDXError read_body_into(
+	uint8_t *image_data,
+	JDXLabel *labels,
+	const JDXHeader *header,
+	FILE *file,
+	uint32_t thread_count,
+	JDXStats *stats,
+	JDXContext *context
+);
@@ -0,0 +1,35 @@
+#include "libjdx.h"
+#include "context.h"
+#include "allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+JDXContext *JDX_AllocContext(void) {
+	return allocate_zeroed(1, sizeof(JDXContext));
+}
+
+void JDX_FreeContext(JDXContext *context) {
+	if (context == NULL) {
+		return;
+	}
+
+	free_chunk_compressor(&context->compressor);
+	free_chunk_decompressor(&context->decompressor);
+
+	deallocate(context->body);
+	deallocate(context);
+}
+
+uint8_t *reserve_context_body(JDXContext *context, size_t size) {
+	if (size <= context->body_capacity && context->body) {
+		return context->body;
+	}
+
+	// Nothing in the buffer needs to be kept, so it is replaced rather than resized to avoid copying it
+	deallocate(context->body);
+	context->body = allocate(size);
+	context->body_capacity = context->body ? size : 0;
+
+	return context->body;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "libjdx.h"
+#include "chunk.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct JDXContext {
+	ChunkCompressor compressor;
+	ChunkDecompressor decompressor;
+
+	// Compressed bodies are read whole before they are decoded, into a buffer that only ever grows
+	uint8_t *body;
+	size_t body_capacity;
+};
+
+// Returns the body buffer of the context grown to at least size bytes, or NULL if it cannot be grown
+uint8_t *reserve_context_body(JDXContext *context, size_t size);
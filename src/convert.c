@@ -0,0 +1,701 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "libjdx.h"
+#include "convert.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+// Number of pixels converted to planar float at a time, small enough for the planes to stay in cache
+#define FLOAT_BLOCK_SIZE 256
+
+// Luma weights out of 128 (ITU-R BT.601), chosen so that every SIMD kernel rounds exactly like the scalar one
+#define LUMA_R 38
+#define LUMA_G 75
+#define LUMA_B 15
+
+typedef struct {
+	void (*normalize)(float *dest, const uint8_t *src, size_t count);
+
+	// Planes of each channel are written plane_size bytes apart
+	void (*deinterleave_3)(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count);
+	void (*deinterleave_4)(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count);
+	void (*interleave_3)(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count);
+	void (*interleave_4)(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count);
+
+	void (*add_alpha)(uint8_t *dest, const uint8_t *src, size_t pixel_count);
+	void (*drop_alpha)(uint8_t *dest, const uint8_t *src, size_t pixel_count);
+	void (*luma_3)(uint8_t *dest, const uint8_t *src, size_t pixel_count);
+	void (*luma_4)(uint8_t *dest, const uint8_t *src, size_t pixel_count);
+} PixelKernels;
+
+static void normalize_scalar(float *dest, const uint8_t *src, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		dest[i] = (float) src[i] * (1.0f / 255.0f);
+	}
+}
+
+static void deinterleave_3_scalar(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[p] = src[3 * p];
+		dest[plane_size + p] = src[3 * p + 1];
+		dest[2 * plane_size + p] = src[3 * p + 2];
+	}
+}
+
+static void deinterleave_4_scalar(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[p] = src[4 * p];
+		dest[plane_size + p] = src[4 * p + 1];
+		dest[2 * plane_size + p] = src[4 * p + 2];
+		dest[3 * plane_size + p] = src[4 * p + 3];
+	}
+}
+
+static void interleave_3_scalar(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[3 * p] = src[p];
+		dest[3 * p + 1] = src[plane_size + p];
+		dest[3 * p + 2] = src[2 * plane_size + p];
+	}
+}
+
+static void interleave_4_scalar(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[4 * p] = src[p];
+		dest[4 * p + 1] = src[plane_size + p];
+		dest[4 * p + 2] = src[2 * plane_size + p];
+		dest[4 * p + 3] = src[3 * plane_size + p];
+	}
+}
+
+static void add_alpha_scalar(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		memcpy(dest + 4 * p, src + 3 * p, 3);
+		dest[4 * p + 3] = 0xFF;
+	}
+}
+
+static void drop_alpha_scalar(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		memcpy(dest + 3 * p, src + 4 * p, 3);
+	}
+}
+
+static inline uint8_t get_luma(const uint8_t *pixel) {
+	return (uint8_t) ((LUMA_R * pixel[0] + LUMA_G * pixel[1] + LUMA_B * pixel[2] + 64) >> 7);
+}
+
+static void luma_3_scalar(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[p] = get_luma(src + 3 * p);
+	}
+}
+
+static void luma_4_scalar(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	for (size_t p = 0; p < pixel_count; p++) {
+		dest[p] = get_luma(src + 4 * p);
+	}
+}
+
+static const PixelKernels SCALAR_KERNELS = {
+	.normalize = normalize_scalar,
+	.deinterleave_3 = deinterleave_3_scalar,
+	.deinterleave_4 = deinterleave_4_scalar,
+	.interleave_3 = interleave_3_scalar,
+	.interleave_4 = interleave_4_scalar,
+	.add_alpha = add_alpha_scalar,
+	.drop_alpha = drop_alpha_scalar,
+	.luma_3 = luma_3_scalar,
+	.luma_4 = luma_4_scalar
+};
+
+#ifdef HAVE_X86_KERNELS
+
+// SSE2 is part of x86-64 itself, so these kernels need no runtime check
+
+static void normalize_sse2(float *dest, const uint8_t *src, size_t count) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i low = _mm_unpacklo_epi8(bytes, zero);
+		__m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+		_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+		_mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+		_mm_storeu_ps(dest + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+		_mm_storeu_ps(dest + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+	}
+
+	normalize_scalar(dest + i, src + i, count - i);
+}
+
+static void deinterleave_4_sse2(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	// Three rounds of byte unpacking transpose 16 interleaved pixels into their four channels
+	for (; p + 16 <= pixel_count; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (src + 4 * p));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 4 * p + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *) (src + 4 * p + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *) (src + 4 * p + 48));
+
+		__m128i t0 = _mm_unpacklo_epi8(a, b), t1 = _mm_unpackhi_epi8(a, b);
+		__m128i t2 = _mm_unpacklo_epi8(c, d), t3 = _mm_unpackhi_epi8(c, d);
+
+		__m128i u0 = _mm_unpacklo_epi8(t0, t1), u1 = _mm_unpackhi_epi8(t0, t1);
+		__m128i u2 = _mm_unpacklo_epi8(t2, t3), u3 = _mm_unpackhi_epi8(t2, t3);
+
+		__m128i v0 = _mm_unpacklo_epi8(u0, u1), v1 = _mm_unpackhi_epi8(u0, u1);
+		__m128i v2 = _mm_unpacklo_epi8(u2, u3), v3 = _mm_unpackhi_epi8(u2, u3);
+
+		_mm_storeu_si128((__m128i *) (dest + p), _mm_unpacklo_epi64(v0, v2));
+		_mm_storeu_si128((__m128i *) (dest + plane_size + p), _mm_unpackhi_epi64(v0, v2));
+		_mm_storeu_si128((__m128i *) (dest + 2 * plane_size + p), _mm_unpacklo_epi64(v1, v3));
+		_mm_storeu_si128((__m128i *) (dest + 3 * plane_size + p), _mm_unpackhi_epi64(v1, v3));
+	}
+
+	deinterleave_4_scalar(dest + p, plane_size, src + 4 * p, pixel_count - p);
+}
+
+static void interleave_4_sse2(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	size_t p = 0;
+
+	// Unpacking bytes and then pairs of bytes is the inverse of the transpose in deinterleave_4_sse2
+	for (; p + 16 <= pixel_count; p += 16) {
+		__m128i r = _mm_loadu_si128((const __m128i *) (src + p));
+		__m128i g = _mm_loadu_si128((const __m128i *) (src + plane_size + p));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 2 * plane_size + p));
+		__m128i a = _mm_loadu_si128((const __m128i *) (src + 3 * plane_size + p));
+
+		__m128i rg_low = _mm_unpacklo_epi8(r, g), rg_high = _mm_unpackhi_epi8(r, g);
+		__m128i ba_low = _mm_unpacklo_epi8(b, a), ba_high = _mm_unpackhi_epi8(b, a);
+
+		_mm_storeu_si128((__m128i *) (dest + 4 * p), _mm_unpacklo_epi16(rg_low, ba_low));
+		_mm_storeu_si128((__m128i *) (dest + 4 * p + 16), _mm_unpackhi_epi16(rg_low, ba_low));
+		_mm_storeu_si128((__m128i *) (dest + 4 * p + 32), _mm_unpacklo_epi16(rg_high, ba_high));
+		_mm_storeu_si128((__m128i *) (dest + 4 * p + 48), _mm_unpackhi_epi16(rg_high, ba_high));
+	}
+
+	interleave_4_scalar(dest + 4 * p, src + p, plane_size, pixel_count - p);
+}
+
+// Only normalizing gains from 256-bit vectors, which widen eight bytes to floats at a time, so it alone needs AVX2
+
+__attribute__((target("avx2")))
+static void normalize_avx2(float *dest, const uint8_t *src, size_t count) {
+	const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i low = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i)));
+		__m256i high = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i + 8)));
+
+		_mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), scale));
+		_mm256_storeu_ps(dest + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), scale));
+	}
+
+	normalize_scalar(dest + i, src + i, count - i);
+}
+
+// The byte shuffles of SSSE3 rearrange the channels in the kernels below, which stay within 128-bit vectors
+
+__attribute__((target("ssse3")))
+static void deinterleave_3_ssse3(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	// Each channel of 16 pixels is gathered from the three source vectors into disjoint lanes
+	const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+	const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+	const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+	const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (src + 3 * p));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 3 * p + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *) (src + 3 * p + 32));
+
+		__m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)), _mm_shuffle_epi8(c, r2));
+		__m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)), _mm_shuffle_epi8(c, g2));
+		__m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)), _mm_shuffle_epi8(c, b2));
+
+		_mm_storeu_si128((__m128i *) (dest + p), red);
+		_mm_storeu_si128((__m128i *) (dest + plane_size + p), green);
+		_mm_storeu_si128((__m128i *) (dest + 2 * plane_size + p), blue);
+	}
+
+	deinterleave_3_scalar(dest + p, plane_size, src + 3 * p, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static void deinterleave_4_ssse3(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	// Groups the channels of four pixels within each vector, after which a 32-bit transpose finishes the job
+	const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 4 * p)), group);
+		__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 4 * p + 16)), group);
+		__m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 4 * p + 32)), group);
+		__m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 4 * p + 48)), group);
+
+		__m128i ab_low = _mm_unpacklo_epi32(a, b), ab_high = _mm_unpackhi_epi32(a, b);
+		__m128i cd_low = _mm_unpacklo_epi32(c, d), cd_high = _mm_unpackhi_epi32(c, d);
+
+		_mm_storeu_si128((__m128i *) (dest + p), _mm_unpacklo_epi64(ab_low, cd_low));
+		_mm_storeu_si128((__m128i *) (dest + plane_size + p), _mm_unpackhi_epi64(ab_low, cd_low));
+		_mm_storeu_si128((__m128i *) (dest + 2 * plane_size + p), _mm_unpacklo_epi64(ab_high, cd_high));
+		_mm_storeu_si128((__m128i *) (dest + 3 * plane_size + p), _mm_unpackhi_epi64(ab_high, cd_high));
+	}
+
+	deinterleave_4_scalar(dest + p, plane_size, src + 4 * p, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static void interleave_3_ssse3(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	// Each output vector takes every third byte from one of the three planes
+	const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		__m128i r = _mm_loadu_si128((const __m128i *) (src + p));
+		__m128i g = _mm_loadu_si128((const __m128i *) (src + plane_size + p));
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 2 * plane_size + p));
+
+		__m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0));
+		__m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1));
+		__m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2));
+
+		_mm_storeu_si128((__m128i *) (dest + 3 * p), out0);
+		_mm_storeu_si128((__m128i *) (dest + 3 * p + 16), out1);
+		_mm_storeu_si128((__m128i *) (dest + 3 * p + 32), out2);
+	}
+
+	interleave_3_scalar(dest + 3 * p, src + p, plane_size, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static void add_alpha_ssse3(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+	size_t p = 0;
+
+	// Each load reads four bytes past the pixels it converts, so the loop stops while those are still in bounds
+	for (; p + 6 <= pixel_count; p += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i *) (src + 3 * p));
+		_mm_storeu_si128((__m128i *) (dest + 4 * p), _mm_or_si128(_mm_shuffle_epi8(pixels, spread), alpha));
+	}
+
+	add_alpha_scalar(dest + 4 * p, src + 3 * p, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static void drop_alpha_ssse3(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t p = 0;
+
+	for (; p + 4 <= pixel_count; p += 4) {
+		__m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 4 * p)), pack);
+		int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(pixels, 8));
+
+		// Only the 12 packed bytes are stored, since the destination may end right after them
+		_mm_storel_epi64((__m128i *) (dest + 3 * p), pixels);
+		memcpy(dest + 3 * p + 8, &last, sizeof(last));
+	}
+
+	drop_alpha_scalar(dest + 3 * p, src + 4 * p, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i luma_of_8_pixels(__m128i low, __m128i high) {
+	const __m128i weights = _mm_setr_epi8(
+		LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0,
+		LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0
+	);
+
+	// Products never exceed 255 * 128, so the signed 16-bit sums cannot saturate
+	__m128i sums = _mm_hadd_epi16(_mm_maddubs_epi16(low, weights), _mm_maddubs_epi16(high, weights));
+	sums = _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(64)), 7);
+
+	return _mm_packus_epi16(sums, sums);
+}
+
+__attribute__((target("ssse3")))
+static void luma_3_ssse3(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	size_t p = 0;
+
+	for (; p + 10 <= pixel_count; p += 8) {
+		__m128i low = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 3 * p)), spread);
+		__m128i high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 3 * p + 12)), spread);
+
+		_mm_storel_epi64((__m128i *) (dest + p), luma_of_8_pixels(low, high));
+	}
+
+	luma_3_scalar(dest + p, src + 3 * p, pixel_count - p);
+}
+
+__attribute__((target("ssse3")))
+static void luma_4_ssse3(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 8 <= pixel_count; p += 8) {
+		__m128i low = _mm_loadu_si128((const __m128i *) (src + 4 * p));
+		__m128i high = _mm_loadu_si128((const __m128i *) (src + 4 * p + 16));
+
+		_mm_storel_epi64((__m128i *) (dest + p), luma_of_8_pixels(low, high));
+	}
+
+	luma_4_scalar(dest + p, src + 4 * p, pixel_count - p);
+}
+
+static const PixelKernels SSSE3_KERNELS = {
+	.normalize = normalize_sse2,
+	.deinterleave_3 = deinterleave_3_ssse3,
+	.deinterleave_4 = deinterleave_4_ssse3,
+	.interleave_3 = interleave_3_ssse3,
+	.interleave_4 = interleave_4_sse2,
+	.add_alpha = add_alpha_ssse3,
+	.drop_alpha = drop_alpha_ssse3,
+	.luma_3 = luma_3_ssse3,
+	.luma_4 = luma_4_ssse3
+};
+
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+
+// NEON is part of AArch64 itself, and its structured loads and stores do most of the shuffling
+
+static void normalize_neon(float *dest, const uint8_t *src, size_t count) {
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t bytes = vld1q_u8(src + i);
+		uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+		uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+
+		vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(low))), 1.0f / 255.0f));
+		vst1q_f32(dest + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(low))), 1.0f / 255.0f));
+		vst1q_f32(dest + i + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(high))), 1.0f / 255.0f));
+		vst1q_f32(dest + i + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(high))), 1.0f / 255.0f));
+	}
+
+	normalize_scalar(dest + i, src + i, count - i);
+}
+
+static void deinterleave_3_neon(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x3_t pixels = vld3q_u8(src + 3 * p);
+
+		vst1q_u8(dest + p, pixels.val[0]);
+		vst1q_u8(dest + plane_size + p, pixels.val[1]);
+		vst1q_u8(dest + 2 * plane_size + p, pixels.val[2]);
+	}
+
+	deinterleave_3_scalar(dest + p, plane_size, src + 3 * p, pixel_count - p);
+}
+
+static void deinterleave_4_neon(uint8_t *dest, size_t plane_size, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x4_t pixels = vld4q_u8(src + 4 * p);
+
+		vst1q_u8(dest + p, pixels.val[0]);
+		vst1q_u8(dest + plane_size + p, pixels.val[1]);
+		vst1q_u8(dest + 2 * plane_size + p, pixels.val[2]);
+		vst1q_u8(dest + 3 * plane_size + p, pixels.val[3]);
+	}
+
+	deinterleave_4_scalar(dest + p, plane_size, src + 4 * p, pixel_count - p);
+}
+
+static void interleave_3_neon(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x3_t pixels;
+		pixels.val[0] = vld1q_u8(src + p);
+		pixels.val[1] = vld1q_u8(src + plane_size + p);
+		pixels.val[2] = vld1q_u8(src + 2 * plane_size + p);
+
+		vst3q_u8(dest + 3 * p, pixels);
+	}
+
+	interleave_3_scalar(dest + 3 * p, src + p, plane_size, pixel_count - p);
+}
+
+static void interleave_4_neon(uint8_t *dest, const uint8_t *src, size_t plane_size, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x4_t pixels;
+		pixels.val[0] = vld1q_u8(src + p);
+		pixels.val[1] = vld1q_u8(src + plane_size + p);
+		pixels.val[2] = vld1q_u8(src + 2 * plane_size + p);
+		pixels.val[3] = vld1q_u8(src + 3 * plane_size + p);
+
+		vst4q_u8(dest + 4 * p, pixels);
+	}
+
+	interleave_4_scalar(dest + 4 * p, src + p, plane_size, pixel_count - p);
+}
+
+static void add_alpha_neon(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x3_t rgb = vld3q_u8(src + 3 * p);
+		uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(0xFF) } };
+
+		vst4q_u8(dest + 4 * p, rgba);
+	}
+
+	add_alpha_scalar(dest + 4 * p, src + 3 * p, pixel_count - p);
+}
+
+static void drop_alpha_neon(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 16 <= pixel_count; p += 16) {
+		uint8x16x4_t rgba = vld4q_u8(src + 4 * p);
+		uint8x16x3_t rgb = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+
+		vst3q_u8(dest + 3 * p, rgb);
+	}
+
+	drop_alpha_scalar(dest + 3 * p, src + 4 * p, pixel_count - p);
+}
+
+static inline uint8x8_t luma_of_8_pixels(uint8x8_t red, uint8x8_t green, uint8x8_t blue) {
+	uint16x8_t sums = vmull_u8(red, vdup_n_u8(LUMA_R));
+	sums = vmlal_u8(sums, green, vdup_n_u8(LUMA_G));
+	sums = vmlal_u8(sums, blue, vdup_n_u8(LUMA_B));
+
+	// Rounding narrow by 7 adds the same 64 as the scalar kernel
+	return vrshrn_n_u16(sums, 7);
+}
+
+static void luma_3_neon(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 8 <= pixel_count; p += 8) {
+		uint8x8x3_t rgb = vld3_u8(src + 3 * p);
+		vst1_u8(dest + p, luma_of_8_pixels(rgb.val[0], rgb.val[1], rgb.val[2]));
+	}
+
+	luma_3_scalar(dest + p, src + 3 * p, pixel_count - p);
+}
+
+static void luma_4_neon(uint8_t *dest, const uint8_t *src, size_t pixel_count) {
+	size_t p = 0;
+
+	for (; p + 8 <= pixel_count; p += 8) {
+		uint8x8x4_t rgba = vld4_u8(src + 4 * p);
+		vst1_u8(dest + p, luma_of_8_pixels(rgba.val[0], rgba.val[1], rgba.val[2]));
+	}
+
+	luma_4_scalar(dest + p, src + 4 * p, pixel_count - p);
+}
+
+static const PixelKernels NEON_KERNELS = {
+	.normalize = normalize_neon,
+	.deinterleave_3 = deinterleave_3_neon,
+	.deinterleave_4 = deinterleave_4_neon,
+	.interleave_3 = interleave_3_neon,
+	.interleave_4 = interleave_4_neon,
+	.add_alpha = add_alpha_neon,
+	.drop_alpha = drop_alpha_neon,
+	.luma_3 = luma_3_neon,
+	.luma_4 = luma_4_neon
+};
+
+#endif
+
+static PixelKernels kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void use_kernel_tier(KernelTier tier) {
+	kernels = SCALAR_KERNELS;
+
+	if (tier == KernelTier_SCALAR) {
+		return;
+	}
+
+#if defined(HAVE_X86_KERNELS)
+	if (tier >= KernelTier_SSSE3 && __builtin_cpu_supports("ssse3")) {
+		kernels = SSSE3_KERNELS;
+	} else {
+		kernels.normalize = normalize_sse2;
+		kernels.deinterleave_4 = deinterleave_4_sse2;
+		kernels.interleave_4 = interleave_4_sse2;
+	}
+
+	if (tier >= KernelTier_AVX2 && __builtin_cpu_supports("avx2")) {
+		kernels.normalize = normalize_avx2;
+	}
+#elif defined(HAVE_NEON_KERNELS)
+	kernels = NEON_KERNELS;
+#endif
+}
+
+static void select_kernels(void) {
+	use_kernel_tier(KernelTier_AVX2);
+}
+
+#ifdef DEBUG
+void force_kernel_tier(KernelTier tier) {
+	// Selection must have run first, or it would later undo the forced tier
+	pthread_once(&kernels_once, select_kernels);
+	use_kernel_tier(tier);
+}
+#endif
+
+static const PixelKernels *get_kernels(void) {
+	pthread_once(&kernels_once, select_kernels);
+	return &kernels;
+}
+
+// Kernels only exist for one, three and four channels of a byte each
+static bool is_supported_bit_depth(uint8_t bit_depth) {
+	return bit_depth == 8 || bit_depth == 24 || bit_depth == 32;
+}
+
+JDXError JDX_ConvertToFloat(float *dest, JDXLayout layout, const uint8_t *src, const JDXHeader *header, uint64_t image_count) {
+	if (!is_supported_bit_depth(header->bit_depth) || (layout != JDXLayout_HWC && layout != JDXLayout_CHW)) {
+		return JDXError_UNSUPPORTED_CONVERSION;
+	}
+
+	const PixelKernels *k = get_kernels();
+
+	size_t channels = header->bit_depth / 8;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height;
+
+	// Interleaved floats are a plain element-wise conversion of the whole batch
+	if (layout == JDXLayout_HWC || channels == 1) {
+		k->normalize(dest, src, pixel_count * channels * (size_t) image_count);
+		return JDXError_NONE;
+	}
+
+	uint8_t planes[4 * FLOAT_BLOCK_SIZE];
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		const uint8_t *image = src + pixel_count * channels * (size_t) i;
+		float *image_dest = dest + pixel_count * channels * (size_t) i;
+
+		for (size_t p = 0; p < pixel_count; p += FLOAT_BLOCK_SIZE) {
+			size_t block_size = pixel_count - p < FLOAT_BLOCK_SIZE ? pixel_count - p : FLOAT_BLOCK_SIZE;
+
+			if (channels == 3) {
+				k->deinterleave_3(planes, FLOAT_BLOCK_SIZE, image + 3 * p, block_size);
+			} else {
+				k->deinterleave_4(planes, FLOAT_BLOCK_SIZE, image + 4 * p, block_size);
+			}
+
+			for (size_t c = 0; c < channels; c++) {
+				k->normalize(image_dest + c * pixel_count + p, planes + c * FLOAT_BLOCK_SIZE, block_size);
+			}
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_ConvertToPlanar(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint64_t image_count) {
+	if (!is_supported_bit_depth(header->bit_depth)) {
+		return JDXError_UNSUPPORTED_CONVERSION;
+	}
+
+	const PixelKernels *k = get_kernels();
+
+	size_t channels = header->bit_depth / 8;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height;
+	size_t image_size = pixel_count * channels;
+
+	if (channels == 1) {
+		memcpy(dest, src, image_size * (size_t) image_count);
+		return JDXError_NONE;
+	}
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		if (channels == 3) {
+			k->deinterleave_3(dest + image_size * (size_t) i, pixel_count, src + image_size * (size_t) i, pixel_count);
+		} else {
+			k->deinterleave_4(dest + image_size * (size_t) i, pixel_count, src + image_size * (size_t) i, pixel_count);
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+void interleave_planes(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint64_t image_count) {
+	const PixelKernels *k = get_kernels();
+
+	size_t channels = header->bit_depth / 8;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height;
+	size_t image_size = pixel_count * channels;
+
+	if (channels == 1) {
+		memcpy(dest, src, image_size * (size_t) image_count);
+		return;
+	}
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		if (channels == 3) {
+			k->interleave_3(dest + image_size * (size_t) i, src + image_size * (size_t) i, pixel_count, pixel_count);
+		} else {
+			k->interleave_4(dest + image_size * (size_t) i, src + image_size * (size_t) i, pixel_count, pixel_count);
+		}
+	}
+}
+
+JDXError JDX_ConvertBitDepth(uint8_t *dest, uint8_t dest_bit_depth, const uint8_t *src, const JDXHeader *header, uint64_t image_count) {
+	const PixelKernels *k = get_kernels();
+
+	// Every conversion works on pixels independently, so a batch is treated as one long run of pixels
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height * (size_t) image_count;
+
+	if (dest_bit_depth == header->bit_depth) {
+		memcpy(dest, src, pixel_count * (header->bit_depth / 8));
+	} else if (header->bit_depth == 24 && dest_bit_depth == 32) {
+		k->add_alpha(dest, src, pixel_count);
+	} else if (header->bit_depth == 32 && dest_bit_depth == 24) {
+		k->drop_alpha(dest, src, pixel_count);
+	} else if (header->bit_depth == 24 && dest_bit_depth == 8) {
+		k->luma_3(dest, src, pixel_count);
+	} else if (header->bit_depth == 32 && dest_bit_depth == 8) {
+		k->luma_4(dest, src, pixel_count);
+	} else {
+		return JDXError_UNSUPPORTED_CONVERSION;
+	}
+
+	return JDXError_NONE;
+}
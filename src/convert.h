@@ -0,0 +1,22 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stdint.h>
+
+// Inverse of JDX_ConvertToPlanar, turning one plane per channel back into interleaved pixels
+void interleave_planes(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint64_t image_count);
+
+// Tiers of pixel kernels in the order they are preferred in, where NEON stands in for every x86 tier on ARM
+typedef enum {
+	KernelTier_SCALAR,
+	KernelTier_SSE2,
+	KernelTier_SSSE3,
+	KernelTier_AVX2
+} KernelTier;
+
+#ifdef DEBUG
+// Limits later conversions to the given tier, so that tests can check every tier against the scalar one. Only debug
+// builds have it, since it replaces the kernels without any synchronization with conversions in flight
+void force_kernel_tier(KernelTier tier);
+#endif
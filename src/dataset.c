@@ -1,17 +1,76 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "trycatch.h"
 #include "libjdx.h"
+#include "parallel.h"
+#include "mapping.h"
+#include "dataset.h"
+#include "labels.h"
+#include "chunk.h"
 #include "leio.h"
+#include "stats.h"
+#include "writer.h"
+#include "allocator.h"
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <libdeflate.h>
 
-// TODO: For creating, copying, and appending JDXDataset consider using block memory allocation instead of many mallocs
+// Number of images gathered by each task of a batch, which keeps small batches on the calling thread
+#define BATCH_BLOCK_SIZE 64
+
+// How many images ahead of the current one a batch gather prefetches
+#define PREFETCH_DISTANCE 4
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address, 0, 0)
+#else
+#define PREFETCH(address) ((void) (address))
+#endif
+
+// Alignment of the pixels within an arena, which suits the widest vector loads that convert them
+#define ARENA_IMAGE_ALIGNMENT 64
+
+const JDXReadOptions JDX_DEFAULT_READ_OPTIONS = {
+	.thread_count = 1,
+	.map_advice = JDXMapAdvice_NORMAL,
+	.arena = false,
+	.context = NULL,
+	.stats = NULL
+};
+
+const JDXWriteOptions JDX_DEFAULT_WRITE_OPTIONS = {
+	.chunk_image_count = 0,
+	.thread_count = 1,
+	.codec = JDXCodec_DEFLATE,
+	.compression_level = 0,
+	.filter = JDXFilter_NONE,
+	.split_channels = false,
+	.deduplicate = false,
+	.context = NULL,
+	.stats = NULL
+};
 
 JDXDataset *JDX_AllocDataset(void) {
-	return calloc(1, sizeof(JDXDataset));
+	return allocate_zeroed(1, sizeof(JDXDataset));
+}
+
+void release_dataset_contents(JDXDataset *dataset) {
+	if (dataset->_arena) {
+		// The label table is allocated on its own, so it is the only part of the header outside of the arena
+		free_label_table(dataset->header);
+		deallocate(dataset->_arena);
+	} else {
+		JDX_FreeHeader(dataset->header);
+		release_image_data(dataset);
+		deallocate(dataset->_raw_labels);
+	}
+
+	dataset->header = NULL;
+	dataset->_raw_image_data = NULL;
+	dataset->_raw_labels = NULL;
+	dataset->_arena = NULL;
 }
 
 void JDX_FreeDataset(JDXDataset *dataset) {
@@ -19,10 +78,28 @@ void JDX_FreeDataset(JDXDataset *dataset) {
 		return;
 	}
 
-	JDX_FreeHeader(dataset->header);
-	free(dataset->_raw_image_data);
-	free(dataset->_raw_labels);
-	free(dataset);
+	release_dataset_contents(dataset);
+	deallocate(dataset);
+}
+
+// Moves a dataset out of its arena into separate allocations, so that its parts can be resized independently
+static JDXError detach_arena(JDXDataset *dataset) {
+	if (dataset->_arena == NULL) {
+		return JDXError_NONE;
+	}
+
+	JDXDataset copy = { .header = NULL };
+	JDX_CopyDataset(&copy, dataset);
+
+	if (copy.header == NULL || copy._raw_image_data == NULL || copy._raw_labels == NULL) {
+		release_dataset_contents(&copy);
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	release_dataset_contents(dataset);
+	*dataset = copy;
+
+	return JDXError_NONE;
 }
 
 void JDX_CopyDataset(JDXDataset *dest, const JDXDataset *src) {
@@ -36,11 +113,13 @@ void JDX_CopyDataset(JDXDataset *dest, const JDXDataset *src) {
 		sizeof(uint16_t)
 	);
 
-	dest->_raw_labels = malloc(label_block_size);
+	dest->_raw_labels = allocate(label_block_size);
 	memcpy(dest->_raw_labels, src->_raw_labels, label_block_size);
 
-	dest->_raw_image_data = malloc(image_block_size);
+	dest->_raw_image_data = allocate(image_block_size);
 	memcpy(dest->_raw_image_data, src->_raw_image_data, image_block_size);
+	dest->_mapping = NULL;
+	dest->_arena = NULL;
 }
 
 JDXError JDX_AppendDataset(JDXDataset *dest, const JDXDataset *src) {
@@ -53,35 +132,89 @@ JDXError JDX_AppendDataset(JDXDataset *dest, const JDXDataset *src) {
 		return JDXError_UNEQUAL_BIT_DEPTHS;
 	}
 
-	uint16_t src_label_map[src->header->label_count];
+	// Mapped images are read-only and arenas cannot be resized, so either is copied first
+	JDXError detach_error = detach_arena(dest);
+
+	if (detach_error == JDXError_NONE) {
+		detach_error = detach_image_data(dest);
+	}
+
+	if (detach_error) {
+		return detach_error;
+	}
 
-	uint_fast16_t max_label_count = dest->header->label_count + src->header->label_count;
-	dest->header->labels = realloc(dest->header->labels, max_label_count * sizeof(char *));
-	uint_fast16_t label_count = dest->header->label_count;
+	JDXLabel *src_label_map = allocate(src->header->label_count * sizeof(JDXLabel));
 
-	for (uint_fast16_t i = 0; i < src->header->label_count; i++) {
-		uint_fast16_t j;
+	// New labels are borrowed from the source while merging and then packed into a new arena for the header
+	uint_fast32_t max_label_count = dest->header->label_count + src->header->label_count;
+	char **merged_labels = allocate(max_label_count * sizeof(char *));
 
-		for (j = 0; j < dest->header->label_count; j++) {
-			if (strcmp(src->header->labels[i], dest->header->labels[j]) == 0) {
-				src_label_map[i] = j;
+	char **dest_labels = dest->header->labels;
+	uint16_t dest_label_count = dest->header->label_count;
+
+	if ((src_label_map == NULL && src->header->label_count > 0) || (merged_labels == NULL && max_label_count > 0)) {
+		deallocate(src_label_map);
+		deallocate(merged_labels);
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	if (dest_label_count > 0) {
+		memcpy(merged_labels, dest_labels, dest_label_count * sizeof(char *));
+	}
+
+	dest->header->labels = merged_labels;
+
+	TRY {
+		// New labels are indexed as they are added, so the table must be current before the first of them
+		JDXError table_error = build_label_table(dest->header);
+
+		if (table_error) {
+			THROW(table_error);
+		}
+
+		// Each source label is looked up by hash, so reconciling labels is linear in their total number
+		for (uint_fast16_t i = 0; i < src->header->label_count; i++) {
+			JDXError find_error = JDX_FindLabel(&src_label_map[i], dest->header, src->header->labels[i]);
+
+			if (find_error == JDXError_UNKNOWN_LABEL) {
+				if (dest->header->label_count == UINT16_MAX) {
+					THROW(JDXError_OUT_OF_BOUNDS);
+				}
+
+				JDXLabel l = dest->header->label_count++;
+
+				merged_labels[l] = src->header->labels[i];
+				src_label_map[i] = l;
+
+				find_error = index_label(dest->header, l);
+			}
+
+			if (find_error) {
+				THROW(find_error);
 			}
 		}
 
-		if (j != dest->header->label_count) {
-			uint_fast16_t l = label_count++;
+		JDXError arena_error = alloc_label_arena(&dest->header->labels, merged_labels, dest->header->label_count);
 
-			dest->header->labels[l] = strdup(src->header->labels[i]);
-			src_label_map[i] = l;
+		if (arena_error) {
+			THROW(arena_error);
 		}
-	}
+	} CATCH(error) {
+		// The table may refer to labels that were never added, so it is rebuilt for the labels that remain
+		dest->header->labels = dest_labels;
+		dest->header->label_count = dest_label_count;
+
+		free_label_table(dest->header);
+		build_label_table(dest->header);
 
-	// Reallocate smaller to prevent wasting space for large sets of labels
-	if (label_count < max_label_count) {
-		dest->header->labels = realloc(dest->header->labels, label_count * sizeof(char *));
+		deallocate(src_label_map);
+		deallocate(merged_labels);
+
+		return error;
 	}
 
-	dest->header->label_count = label_count;
+	deallocate(dest_labels);
+	deallocate(merged_labels);
 
 	// Calculate final item count and realloc destination arrays accordingly
 	uint64_t new_image_count = dest->header->image_count + src->header->image_count;
@@ -91,9 +224,9 @@ JDXError JDX_AppendDataset(JDXDataset *dest, const JDXDataset *src) {
 		(size_t) src->header->bit_depth / 8
 	);
 
-	dest->_raw_labels = realloc(dest->_raw_labels, new_image_count * sizeof(uint16_t));
+	dest->_raw_labels = reallocate(dest->_raw_labels, new_image_count * sizeof(uint16_t));
 
-	dest->_raw_image_data = realloc(dest->_raw_image_data, image_size * (size_t) new_image_count);
+	dest->_raw_image_data = reallocate(dest->_raw_image_data, image_size * (size_t) new_image_count);
 	memcpy(
 		dest->_raw_image_data + image_size * (size_t) dest->header->image_count,
 		src->_raw_image_data,
@@ -105,42 +238,258 @@ JDXError JDX_AppendDataset(JDXDataset *dest, const JDXDataset *src) {
 	}
 
 	dest->header->image_count = new_image_count;
+	deallocate(src_label_map);
 
 	return JDXError_NONE;
 }
 
 JDXImage *JDX_GetImage(const JDXDataset *dataset, uint64_t index) {
-	if (index >= dataset->header->image_count) {
+	JDXImageView view;
+
+	if (JDX_GetImageView(&view, dataset, index)) {
 		return NULL;
 	}
 
-	JDXImage *image = malloc(sizeof(JDXImage));
-	image->width = dataset->header->image_width;
-	image->height = dataset->header->image_height;
-	image->bit_depth = dataset->header->bit_depth;
-
 	size_t image_size = JDX_GetImageSize(dataset->header);
 
-	uint8_t *image_data = malloc(image_size);
-	memcpy(image_data, dataset->_raw_image_data + image_size * index, image_size);
-	image->raw_data = image_data;
+	JDXImage *image = allocate(sizeof(JDXImage));
+	image->width = view.width;
+	image->height = view.height;
+	image->bit_depth = view.bit_depth;
 
-	image->label_num = dataset->_raw_labels[index];
-	image->label_str = strdup(dataset->header->labels[image->label_num]);
+	image->raw_data = allocate(image_size);
+	memcpy(image->raw_data, view.raw_data, image_size);
+
+	image->label_num = view.label_num;
+	image->label_str = duplicate_string(view.label_str);
 
 	return image;
 }
 
+JDXError JDX_GetImageView(JDXImageView *dest, const JDXDataset *dataset, uint64_t index) {
+	if (index >= dataset->header->image_count) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	dest->raw_data = dataset->_raw_image_data + JDX_GetImageSize(dataset->header) * (size_t) index;
+	dest->width = dataset->header->image_width;
+	dest->height = dataset->header->image_height;
+	dest->bit_depth = dataset->header->bit_depth;
+
+	dest->label_num = dataset->_raw_labels[index];
+	dest->label_str = dataset->header->labels[dest->label_num];
+
+	return JDXError_NONE;
+}
+
+typedef struct {
+	uint8_t *pixel_dest;
+	JDXLabel *label_dest;
+	const JDXDataset *dataset;
+	const uint64_t *indices;
+	uint64_t index_count;
+} BatchJob;
+
+static void gather_block_task(void *context, uint64_t block, uint32_t worker) {
+	BatchJob *job = context;
+
+	size_t image_size = JDX_GetImageSize(job->dataset->header);
+	uint64_t start = block * BATCH_BLOCK_SIZE;
+	uint64_t end = start + BATCH_BLOCK_SIZE < job->index_count ? start + BATCH_BLOCK_SIZE : job->index_count;
+
+	for (uint64_t i = start; i < end; i++) {
+		// Indices are arbitrary, so the hardware prefetcher cannot guess which image comes next
+		if (i + PREFETCH_DISTANCE < end) {
+			PREFETCH(job->dataset->_raw_image_data + image_size * (size_t) job->indices[i + PREFETCH_DISTANCE]);
+		}
+
+		uint64_t index = job->indices[i];
+
+		if (job->pixel_dest) {
+			memcpy(job->pixel_dest + image_size * (size_t) i, job->dataset->_raw_image_data + image_size * (size_t) index, image_size);
+		}
+
+		if (job->label_dest) {
+			job->label_dest[i] = job->dataset->_raw_labels[index];
+		}
+	}
+}
+
+JDXError JDX_GetBatch(
+	uint8_t *pixel_dest,
+	JDXLabel *label_dest,
+	const JDXDataset *dataset,
+	const uint64_t *indices,
+	uint64_t index_count
+) {
+	return JDX_GetBatchWithOptions(pixel_dest, label_dest, dataset, indices, index_count, &JDX_DEFAULT_READ_OPTIONS);
+}
+
+JDXError JDX_GetBatchWithOptions(
+	uint8_t *pixel_dest,
+	JDXLabel *label_dest,
+	const JDXDataset *dataset,
+	const uint64_t *indices,
+	uint64_t index_count,
+	const JDXReadOptions *options
+) {
+	if (options == NULL) {
+		options = &JDX_DEFAULT_READ_OPTIONS;
+	}
+
+	// Every index is checked up front so that a failed call never leaves a partially filled batch
+	for (uint64_t i = 0; i < index_count; i++) {
+		if (indices[i] >= dataset->header->image_count) {
+			return JDXError_OUT_OF_BOUNDS;
+		}
+	}
+
+	BatchJob job = {
+		.pixel_dest = pixel_dest,
+		.label_dest = label_dest,
+		.dataset = dataset,
+		.indices = indices,
+		.index_count = index_count
+	};
+
+	parallel_for(
+		(index_count + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE,
+		resolve_thread_count(options->thread_count),
+		gather_block_task,
+		&job
+	);
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_ReadImageFromFile(JDXImage **dest, FILE *file, uint64_t index) {
+	JDXReader *reader = NULL;
+	JDXError open_error = JDX_OpenReaderFromFile(&reader, file);
+
+	if (open_error) {
+		return open_error;
+	}
+
+	// Seeking to the final position is allowed for readers but is out of bounds for a single image
+	JDXImageView view;
+	JDXError read_error = (
+		index >= reader->header->image_count
+			? JDXError_OUT_OF_BOUNDS
+			: JDX_SeekReader(reader, index)
+	);
+
+	if (read_error == JDXError_NONE) {
+		read_error = JDX_ReadNextImage(reader, &view);
+	}
+
+	if (read_error) {
+		JDX_CloseReader(reader);
+		return read_error;
+	}
+
+	size_t image_size = JDX_GetImageSize(reader->header);
+
+	JDXImage *image = allocate(sizeof(JDXImage));
+	image->width = view.width;
+	image->height = view.height;
+	image->bit_depth = view.bit_depth;
+
+	image->raw_data = allocate(image_size);
+	memcpy(image->raw_data, view.raw_data, image_size);
+
+	image->label_num = view.label_num;
+	image->label_str = duplicate_string(view.label_str);
+
+	JDX_CloseReader(reader);
+
+	*dest = image;
+	return JDXError_NONE;
+}
+
+JDXError JDX_ReadImageFromPath(JDXImage **dest, const char *path, uint64_t index) {
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	JDXError error = JDX_ReadImageFromFile(dest, file, index);
+
+	if (fclose(file) == EOF) {
+		return JDXError_CLOSE_FILE;
+	}
+
+	return error;
+}
+
+static size_t align_size(size_t size, size_t alignment) {
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+// Moves a header into a new arena laid out as the header, its labels, the images and then their labels
+static void *alloc_dataset_arena(JDXHeader **header, uint8_t **raw_image_data, JDXLabel **raw_labels, size_t *arena_size) {
+	JDXHeader *source = *header;
+
+	size_t image_block_size = JDX_GetImageSize(source) * source->image_count;
+	size_t label_block_size = source->image_count * sizeof(JDXLabel);
+
+	size_t label_arena_offset = align_size(sizeof(JDXHeader), sizeof(char *));
+	size_t label_arena_size = get_label_arena_size(source->labels, source->label_count);
+
+	// Allocators only promise alignment for standard types, so the images are aligned within the arena itself
+	size_t image_offset = align_size(label_arena_offset + label_arena_size, ARENA_IMAGE_ALIGNMENT);
+	size_t label_offset = align_size(image_offset + image_block_size, sizeof(JDXLabel));
+
+	*arena_size = label_offset + label_block_size + ARENA_IMAGE_ALIGNMENT;
+	uint8_t *arena = allocate(*arena_size);
+
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	uint8_t *images = (uint8_t *) align_size((uintptr_t) (arena + image_offset), ARENA_IMAGE_ALIGNMENT);
+	char **labels = (char **) (arena + label_arena_offset);
+
+	fill_label_arena(labels, source->labels, source->label_count);
+
+	JDXHeader *arena_header = (JDXHeader *) arena;
+	*arena_header = *source;
+
+	// The table refers to labels by number, so it still holds for the copies in the arena
+	arena_header->labels = source->label_count > 0 ? labels : NULL;
+	source->_label_table = NULL;
+
+	*raw_image_data = images;
+	*raw_labels = (JDXLabel *) (images + (label_offset - image_offset));
+	*header = arena_header;
+
+	JDX_FreeHeader(source);
+	return arena;
+}
+
 JDXError JDX_ReadDatasetFromFile(JDXDataset *dest, FILE *file) {
+	return JDX_ReadDatasetFromFileWithOptions(dest, file, &JDX_DEFAULT_READ_OPTIONS);
+}
+
+JDXError JDX_ReadDatasetFromFileWithOptions(JDXDataset *dest, FILE *file, const JDXReadOptions *options) {
 	// Declare all allocated pointers so that they can easily be freed in the event of an error
-	struct libdeflate_decompressor *decompressor = NULL;
-	uint8_t *decompressed_body = NULL;
-	uint8_t *compressed_body = NULL;
 	uint8_t *raw_image_data = NULL;
 	uint16_t *raw_labels = NULL;
 	JDXHeader *header = NULL;
+	void *arena = NULL;
+	size_t arena_size = 0;
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_READ_OPTIONS;
+	}
+
+	JDXStats call_stats;
+	JDXStats *stats = begin_stats(&call_stats, options->stats);
 
 	TRY {
+		int64_t header_start = stats ? ftell_64(file) : -1;
+		uint64_t start = get_stats_clock(stats);
+
 		header = JDX_AllocHeader();
 		JDXError header_error = JDX_ReadHeaderFromFile(header, file);
 
@@ -148,83 +497,78 @@ JDXError JDX_ReadDatasetFromFile(JDXDataset *dest, FILE *file) {
 			THROW(header_error);
 		}
 
-		uint64_t compressed_size;
-		if (fread(&compressed_size, sizeof(compressed_size), 1, file) != 1) {
-			THROW(JDXError_READ_FILE);
-		}
+		add_phase_time(stats, JDXPhase_READ, start);
 
-		compressed_body = malloc((size_t) compressed_size);
+		int64_t header_end = stats ? ftell_64(file) : -1;
 
-		if (fread(compressed_body, 1, compressed_size, file) != compressed_size) {
-			THROW(JDXError_READ_FILE);
+		if (stats && header_start >= 0 && header_end >= header_start) {
+			stats->bytes_read += (uint64_t) (header_end - header_start);
 		}
 
-		size_t image_size = (
-			(size_t) header->image_width *
-			(size_t) header->image_height *
-			(size_t) header->bit_depth / 8
-		);
+		size_t image_block_size = JDX_GetImageSize(header) * header->image_count;
+		size_t label_block_size = header->image_count * sizeof(JDXLabel);
 
-		size_t decompressed_size = (image_size + sizeof(uint16_t)) * (size_t) header->image_count;
-		decompressed_body = malloc(decompressed_size);
+		start = get_stats_clock(stats);
 
-		// Decompress encoded body
-		decompressor = libdeflate_alloc_decompressor();
-		enum libdeflate_result decompress_result = libdeflate_deflate_decompress(
-			decompressor, compressed_body, compressed_size,
-			decompressed_body, decompressed_size, NULL
-		);
+		if (options->arena) {
+			arena = alloc_dataset_arena(&header, &raw_image_data, &raw_labels, &arena_size);
+			add_allocation(stats, arena_size);
+		} else {
+			raw_image_data = allocate(image_block_size);
+			raw_labels = allocate(label_block_size);
 
-		if (decompress_result != LIBDEFLATE_SUCCESS) {
-			THROW(JDXError_CORRUPT_FILE);
+			add_allocation(stats, image_block_size);
+			add_allocation(stats, label_block_size);
 		}
 
-		raw_image_data = malloc(image_size * header->image_count);
-		raw_labels = malloc(header->image_count * sizeof(uint16_t));
+		add_phase_time(stats, JDXPhase_ALLOCATE, start);
 
-		uint8_t *dest_chunk_ptr = raw_image_data;
-		uint8_t *src_chunk_ptr = decompressed_body;
+		if (options->arena ? arena == NULL : header->image_count > 0 && (raw_image_data == NULL || raw_labels == NULL)) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
 
-		for (uint_fast64_t i = 0; i < header->image_count; i++) {
-			memcpy(dest_chunk_ptr, src_chunk_ptr, image_size);
-			dest_chunk_ptr += image_size;
-			src_chunk_ptr += image_size;
+		JDXError body_error = read_body_into(raw_image_data, raw_labels, header, file, options->thread_count, stats, options->context);
 
-			raw_labels[i] = *((uint16_t *) src_chunk_ptr);
-			src_chunk_ptr += sizeof(uint16_t);
+		if (body_error) {
+			THROW(body_error);
 		}
 	} CATCH(error) {
-		libdeflate_free_decompressor(decompressor);
-		free(decompressed_body);
-		free(compressed_body);
+		if (arena) {
+			deallocate(arena);
+		} else {
+			deallocate(raw_image_data);
+			deallocate(raw_labels);
+
+			JDX_FreeHeader(header);
+		}
 
-		JDX_FreeHeader(header);
 		return error;
 	}
 
-	libdeflate_free_decompressor(decompressor);
-	free(decompressed_body);
-	free(compressed_body);
+	end_stats(stats, options->stats, "read");
 
-	JDX_FreeHeader(dest->header);
-	free(dest->_raw_image_data);
-	free(dest->_raw_labels);
+	release_dataset_contents(dest);
 
 	dest->header = header;
 	dest->_raw_image_data = raw_image_data;
 	dest->_raw_labels = raw_labels;
+	dest->_arena = arena;
 
 	return JDXError_NONE;
 }
 
 JDXError JDX_ReadDatasetFromPath(JDXDataset *dest, const char *path) {
+	return JDX_ReadDatasetFromPathWithOptions(dest, path, &JDX_DEFAULT_READ_OPTIONS);
+}
+
+JDXError JDX_ReadDatasetFromPathWithOptions(JDXDataset *dest, const char *path, const JDXReadOptions *options) {
 	FILE *file = fopen(path, "rb");
 
 	if (file == NULL) {
 		return JDXError_OPEN_FILE;
 	}
 
-	JDXError error = JDX_ReadDatasetFromFile(dest, file); // Named 'error' but could (and should) be 'JDXError_NONE'
+	JDXError error = JDX_ReadDatasetFromFileWithOptions(dest, file, options); // Named 'error' but could (and should) be 'JDXError_NONE'
 
 	if (fclose(file) == EOF) {
 		return JDXError_CLOSE_FILE;
@@ -233,91 +577,308 @@ JDXError JDX_ReadDatasetFromPath(JDXDataset *dest, const char *path) {
 	return error;
 }
 
-JDXError JDX_WriteDatasetToFile(JDXDataset *dataset, FILE *file) {
+JDXError JDX_ReadLabelsFromFile(JDXLabel **dest, JDXHeader *header_dest, FILE *file) {
 	// Declare all allocated pointers so that they can easily be freed in the event of an error
-	struct libdeflate_compressor *compressor = NULL;
-	uint8_t *uncompressed_body = NULL;
-	uint8_t *compressed_body = NULL;
+	ChunkIndex chunk_index = { .offsets = NULL };
+	uint8_t *label_data = NULL;
+	JDXLabel *labels = NULL;
+	JDXHeader *header = NULL;
 
 	TRY {
-		size_t image_size = (
-			(size_t) dataset->header->image_width *
-			(size_t) dataset->header->image_height *
-			(size_t) dataset->header->bit_depth / 8
-		);
+		header = JDX_AllocHeader();
+		JDXError header_error = JDX_ReadHeaderFromFile(header, file);
 
-		size_t uncompressed_size = (
-			(size_t) (image_size + sizeof(uint16_t)) *
-			(size_t) dataset->header->image_count
-		);
+		if (header_error) {
+			THROW(header_error);
+		}
 
-		uncompressed_body = malloc(uncompressed_size);
+		JDXError body_error = read_body_descriptor(&chunk_index, header, file);
 
-		uint8_t *body_ptr = uncompressed_body;
-		uint8_t *image_data_ptr = dataset->_raw_image_data;
+		if (body_error) {
+			THROW(body_error);
+		}
 
-		for (uint_fast64_t i = 0; i < dataset->header->image_count; i++) {
-			memcpy(body_ptr, image_data_ptr, image_size);
-			image_data_ptr += image_size;
-			body_ptr += image_size;
+		int64_t data_start = ftell_64(file);
 
-			*((uint16_t *) body_ptr) = dataset->_raw_labels[i];
-			body_ptr += sizeof(uint16_t);
+		if (data_start < 0) {
+			THROW(JDXError_READ_FILE);
 		}
 
-		// Must allocate for entire uncompressed size despite it almost certainly being less
-		compressed_body = malloc(uncompressed_size);
-		
-		compressor = libdeflate_alloc_compressor(12);
-		size_t compressed_size = libdeflate_deflate_compress(
-			compressor,
-			uncompressed_body,
-			uncompressed_size,
-			compressed_body,
-			uncompressed_size
-		);
+		// Legacy bodies interleave labels with pixels, so their only chunk has to be read in full
+		uint64_t read_start = 0;
+		uint64_t read_end = chunk_index.data_size;
 
-		// libdeflate will return 0 if operation failed
-		if (compressed_size == 0) {
-			THROW(JDXError_WRITE_FILE);
-		}
+		if (!chunk_index.interleaved) {
+			if (fseek_64(file, data_start + (int64_t) chunk_index.data_size, SEEK_SET) != 0) {
+				THROW(JDXError_READ_FILE);
+			}
 
-		JDXError header_error = JDX_WriteHeaderToFile(dataset->header, file);
+			JDXError offsets_error = read_chunk_offsets(&chunk_index, file);
 
-		if (header_error) {
-			THROW(header_error);
+			if (offsets_error) {
+				THROW(offsets_error);
+			}
+
+			// Every label stream comes after every pixel stream, so all of them are read with one seek
+			read_start = chunk_index.offsets[chunk_index.chunk_count];
+			read_end = chunk_index.offsets[2 * chunk_index.chunk_count];
+
+			for (uint64_t s = chunk_index.chunk_count; s <= 2 * chunk_index.chunk_count; s++) {
+				chunk_index.offsets[s] -= read_start;
+			}
 		}
 
-		if (
-			fwrite(&compressed_size, sizeof(compressed_size), 1, file) != 1 ||
-			fwrite(compressed_body, 1, compressed_size, file) != compressed_size ||
-			fflush(file) == EOF
+		label_data = allocate(read_end > read_start ? (size_t) (read_end - read_start) : 1);
+
+		if (label_data == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		} else if (
+			fseek_64(file, data_start + (int64_t) read_start, SEEK_SET) != 0 ||
+			fread(label_data, 1, read_end - read_start, file) != read_end - read_start
 		) {
-			THROW(JDXError_WRITE_FILE);
+			THROW(JDXError_READ_FILE);
+		}
+
+		// With the label offsets rebased, decode_body finds the label streams in label_data without touching any pixel stream
+		JDXError decode_error = decode_body(NULL, &labels, &chunk_index, header, label_data, 1, NULL, NULL);
+
+		if (decode_error) {
+			THROW(decode_error);
+		}
+	} CATCH(error) {
+		free_chunk_index(&chunk_index);
+		deallocate(label_data);
+
+		JDX_FreeHeader(header);
+		return error;
+	}
+
+	free_chunk_index(&chunk_index);
+	deallocate(label_data);
+
+	JDX_CopyHeader(header_dest, header);
+	JDX_FreeHeader(header);
+
+	*dest = labels;
+	return JDXError_NONE;
+}
+
+JDXError JDX_ReadLabelsFromPath(JDXLabel **dest, JDXHeader *header_dest, const char *path) {
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	JDXError error = JDX_ReadLabelsFromFile(dest, header_dest, file);
+
+	if (fclose(file) == EOF) {
+		return JDXError_CLOSE_FILE;
+	}
+
+	return error;
+}
+
+JDXError JDX_ReadDatasetWithLabelsFromPath(JDXDataset *dest, const char *path, const JDXLabel *labels, uint16_t label_count) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	JDXLabel *file_labels = NULL;
+	uint8_t *raw_image_data = NULL;
+	JDXLabel *raw_labels = NULL;
+	JDXReader *reader = NULL;
+	bool *wanted = NULL;
+	JDXHeader *header = JDX_AllocHeader();
+
+	uint64_t match_count = 0;
+
+	TRY {
+		JDXError labels_error = JDX_ReadLabelsFromPath(&file_labels, header, path);
+
+		if (labels_error) {
+			THROW(labels_error);
+		}
+
+		if ((wanted = allocate_zeroed(header->label_count > 0 ? header->label_count : 1, sizeof(bool))) == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		for (uint16_t l = 0; l < label_count; l++) {
+			if (labels[l] >= header->label_count) {
+				THROW(JDXError_OUT_OF_BOUNDS);
+			}
+
+			wanted[labels[l]] = true;
+		}
+
+		for (uint64_t i = 0; i < header->image_count; i++) {
+			match_count += wanted[file_labels[i]];
+		}
+
+		size_t image_size = JDX_GetImageSize(header);
+
+		raw_image_data = allocate(match_count > 0 ? image_size * (size_t) match_count : 1);
+		raw_labels = allocate(match_count > 0 ? sizeof(JDXLabel) * (size_t) match_count : 1);
+
+		if (raw_image_data == NULL || raw_labels == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		JDXError open_error = JDX_OpenReaderFromPath(&reader, path);
+
+		if (open_error) {
+			THROW(open_error);
+		}
+
+		// The reader only decompresses the chunks that the matching images fall into, each of them once
+		uint64_t match = 0;
+
+		for (uint64_t i = 0; i < header->image_count; i++) {
+			if (!wanted[file_labels[i]]) {
+				continue;
+			}
+
+			JDXImageView view;
+			JDXError seek_error = JDX_SeekReader(reader, i);
+			JDXError read_error = seek_error ? seek_error : JDX_ReadNextImage(reader, &view);
+
+			if (read_error) {
+				THROW(read_error);
+			}
+
+			memcpy(raw_image_data + image_size * (size_t) match, view.raw_data, image_size);
+			raw_labels[match++] = file_labels[i];
+		}
+
+		JDXError close_error = JDX_CloseReader(reader);
+		reader = NULL;
+
+		if (close_error) {
+			THROW(close_error);
 		}
 	} CATCH(error) {
-		libdeflate_free_compressor(compressor);
-		free(uncompressed_body);
-		free(compressed_body);
+		JDX_CloseReader(reader);
+		JDX_FreeHeader(header);
+		deallocate(file_labels);
+		deallocate(raw_image_data);
+		deallocate(raw_labels);
+		deallocate(wanted);
 
 		return error;
 	}
 
-	libdeflate_free_compressor(compressor);
-	free(uncompressed_body);
-	free(compressed_body);
+	deallocate(file_labels);
+	deallocate(wanted);
+
+	header->image_count = match_count;
+
+	release_dataset_contents(dest);
+
+	dest->header = header;
+	dest->_raw_image_data = raw_image_data;
+	dest->_raw_labels = raw_labels;
 
 	return JDXError_NONE;
 }
 
+JDXError JDX_WriteDatasetToFile(JDXDataset *dataset, FILE *file) {
+	return JDX_WriteDatasetToFileWithOptions(dataset, file, &JDX_DEFAULT_WRITE_OPTIONS);
+}
+
+// Copies the whole of a temporary file to the stream that the dataset was meant for
+static JDXError copy_temporary_file(FILE *dest, FILE *temporary) {
+	uint8_t buffer[1 << 16];
+	size_t read_size;
+
+	if (fseek_64(temporary, 0, SEEK_SET) != 0) {
+		return JDXError_READ_FILE;
+	}
+
+	while ((read_size = fread(buffer, 1, sizeof(buffer), temporary)) > 0) {
+		if (fwrite(buffer, 1, read_size, dest) != read_size) {
+			return JDXError_WRITE_FILE;
+		}
+	}
+
+	return ferror(temporary) ? JDXError_READ_FILE : JDXError_NONE;
+}
+
+JDXError JDX_WriteDatasetToFileWithOptions(JDXDataset *dataset, FILE *file, const JDXWriteOptions *options) {
+	if (options == NULL) {
+		options = &JDX_DEFAULT_WRITE_OPTIONS;
+	}
+
+	// The image count and body size are written into the header last, which streams such as pipes cannot seek back to,
+	// so the dataset is written to a temporary file first and then copied over in order
+	if (ftell_64(file) < 0) {
+		FILE *temporary = tmpfile();
+
+		if (temporary == NULL) {
+			return JDXError_OPEN_FILE;
+		}
+
+		JDXError error = JDX_WriteDatasetToFileWithOptions(dataset, temporary, options);
+
+		if (!error) {
+			error = copy_temporary_file(file, temporary);
+		}
+
+		fclose(temporary);
+		return error;
+	}
+
+	uint64_t image_count = dataset->header->image_count;
+	size_t image_size = JDX_GetImageSize(dataset->header);
+
+	// The number of chunks is known up front, so never start more threads than there are chunks to compress
+	JDXWriteOptions writer_options = *options;
+
+	if (writer_options.chunk_image_count == 0) {
+		writer_options.chunk_image_count = default_chunk_image_count(image_size);
+	}
+
+	uint64_t chunk_count = get_chunk_count(image_count, writer_options.chunk_image_count);
+	writer_options.thread_count = resolve_thread_count(options->thread_count);
+
+	if (writer_options.thread_count > chunk_count) {
+		writer_options.thread_count = chunk_count > 0 ? (uint32_t) chunk_count : 1;
+	}
+
+	JDXWriter *writer = NULL;
+	JDXError open_error = JDX_OpenWriterToFile(&writer, file, dataset->header, &writer_options);
+
+	if (open_error) {
+		return open_error;
+	}
+
+	keep_written_images(writer, dataset->_raw_image_data);
+
+	for (uint_fast64_t i = 0; i < image_count; i++) {
+		JDXError write_error = JDX_WriteNextImage(
+			writer,
+			dataset->_raw_image_data + image_size * (size_t) i,
+			dataset->_raw_labels[i]
+		);
+
+		if (write_error) {
+			JDX_CloseWriter(writer);
+			return write_error;
+		}
+	}
+
+	return JDX_CloseWriter(writer);
+}
+
 JDXError JDX_WriteDatasetToPath(JDXDataset *dataset, const char *path) {
+	return JDX_WriteDatasetToPathWithOptions(dataset, path, &JDX_DEFAULT_WRITE_OPTIONS);
+}
+
+JDXError JDX_WriteDatasetToPathWithOptions(JDXDataset *dataset, const char *path, const JDXWriteOptions *options) {
 	FILE *file = fopen(path, "wb");
 
 	if (file == NULL) {
 		return JDXError_OPEN_FILE;
 	}
 
-	JDXError error = JDX_WriteDatasetToFile(dataset, file);
+	JDXError error = JDX_WriteDatasetToFileWithOptions(dataset, file, options);
 	
 	if (fclose(file) == EOF) {
 		return JDXError_CLOSE_FILE;
@@ -326,8 +887,98 @@ JDXError JDX_WriteDatasetToPath(JDXDataset *dataset, const char *path) {
 	return error;
 }
 
+JDXError JDX_AppendDatasetToPath(JDXDataset *dataset, const char *path) {
+	return JDX_AppendDatasetToPathWithOptions(dataset, path, &JDX_DEFAULT_WRITE_OPTIONS);
+}
+
+JDXError JDX_AppendDatasetToPathWithOptions(JDXDataset *dataset, const char *path, const JDXWriteOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	JDXHeader *file_header = JDX_AllocHeader();
+	JDXLabel *label_map = NULL;
+
+	uint16_t label_count = dataset->header->label_count;
+
+	if (file_header == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	JDXWriter *writer = NULL;
+
+	TRY {
+		// Everything is checked against the header before the file is opened for writing, so mismatches leave it untouched
+		JDXError header_error = JDX_ReadHeaderFromPath(file_header, path);
+
+		if (header_error) {
+			THROW(header_error);
+		} else if (dataset->header->image_width != file_header->image_width) {
+			THROW(JDXError_UNEQUAL_WIDTHS);
+		} else if (dataset->header->image_height != file_header->image_height) {
+			THROW(JDXError_UNEQUAL_HEIGHTS);
+		} else if (dataset->header->bit_depth != file_header->bit_depth) {
+			THROW(JDXError_UNEQUAL_BIT_DEPTHS);
+		}
+
+		if ((label_map = allocate(label_count > 0 ? label_count * sizeof(JDXLabel) : 1)) == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		for (uint16_t l = 0; l < label_count; l++) {
+			JDXError find_error = JDX_FindLabel(&label_map[l], file_header, dataset->header->labels[l]);
+
+			if (find_error) {
+				THROW(find_error);
+			}
+		}
+
+		JDXError open_error = JDX_OpenWriterForAppend(&writer, path, options);
+
+		if (open_error) {
+			THROW(open_error);
+		}
+
+		keep_written_images(writer, dataset->_raw_image_data);
+
+		size_t image_size = JDX_GetImageSize(dataset->header);
+
+		for (uint64_t i = 0; i < dataset->header->image_count; i++) {
+			JDXError write_error = JDX_WriteNextImage(
+				writer,
+				dataset->_raw_image_data + image_size * (size_t) i,
+				label_map[dataset->_raw_labels[i]]
+			);
+
+			if (write_error) {
+				THROW(write_error);
+			}
+		}
+
+		// The writer is freed by closing it even if closing fails
+		JDXError close_error = JDX_CloseWriter(writer);
+		writer = NULL;
+
+		if (close_error) {
+			THROW(close_error);
+		}
+	} CATCH(error) {
+		// The file is put back as it was, rather than finished with the images written so far
+		if (writer) {
+			abort_writer(writer);
+		}
+
+		JDX_FreeHeader(file_header);
+		deallocate(label_map);
+
+		return error;
+	}
+
+	JDX_FreeHeader(file_header);
+	deallocate(label_map);
+
+	return JDXError_NONE;
+}
+
 void JDX_FreeImage(JDXImage *image) {
-	free(image->raw_data);
-	free(image->label_str);
-	free(image);
+	deallocate(image->raw_data);
+	deallocate(image->label_str);
+	deallocate(image);
 }
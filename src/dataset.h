@@ -0,0 +1,6 @@
+#pragma once
+
+#include "libjdx.h"
+
+// Frees everything that a dataset holds except the dataset itself, wherever its memory came from
+void release_dataset_contents(JDXDataset *dataset);
@@ -0,0 +1,223 @@
+#include "libjdx.h"
+#include "dedup.h"
+#include "allocator.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Primes of xxHash64, whose round function the lanes below use
+#define PRIME_1 0x9E3779B185EBCA87
+#define PRIME_2 0xC2B2AE3D27D4EB4F
+#define PRIME_3 0x165667B19E3779F9
+#define PRIME_4 0x85EBCA77C2B2AE63
+#define PRIME_5 0x27D4EB2F165667C5
+
+static inline uint64_t rotate_left(uint64_t value, int count) {
+	return (value << count) | (value >> (64 - count));
+}
+
+// Hashes only need to agree within one write, so words are read in the byte order of the machine
+static inline uint64_t read_word(const uint8_t *data) {
+	uint64_t word;
+	memcpy(&word, data, sizeof(word));
+
+	return word;
+}
+
+static inline uint64_t mix_word(uint64_t lane, uint64_t word) {
+	return rotate_left(lane + word * PRIME_2, 31) * PRIME_1;
+}
+
+static uint64_t avalanche(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= PRIME_2;
+	hash ^= hash >> 29;
+	hash *= PRIME_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+ImageHash hash_image(const uint8_t *image_data, size_t image_size) {
+	// Four independent lanes keep several multiplies in flight at once, so hashing runs at several bytes per cycle
+	uint64_t lanes[4] = { PRIME_1 + PRIME_2, PRIME_2, 0, (uint64_t) 0 - PRIME_1 };
+	size_t offset = 0;
+
+	for (; offset + 4 * sizeof(uint64_t) <= image_size; offset += 4 * sizeof(uint64_t)) {
+		lanes[0] = mix_word(lanes[0], read_word(image_data + offset));
+		lanes[1] = mix_word(lanes[1], read_word(image_data + offset + 8));
+		lanes[2] = mix_word(lanes[2], read_word(image_data + offset + 16));
+		lanes[3] = mix_word(lanes[3], read_word(image_data + offset + 24));
+	}
+
+	// At most three whole words remain, which go to the first lanes, and the last lane takes the zero-padded rest
+	for (int l = 0; offset + sizeof(uint64_t) <= image_size; offset += sizeof(uint64_t), l++) {
+		lanes[l] = mix_word(lanes[l], read_word(image_data + offset));
+	}
+
+	if (offset < image_size) {
+		uint64_t word = 0;
+		memcpy(&word, image_data + offset, image_size - offset);
+
+		lanes[3] = mix_word(lanes[3], word ^ PRIME_5);
+	}
+
+	// The halves combine the lanes differently, so that images colliding in one half are unlikely to collide in both
+	ImageHash hash;
+
+	hash.low = avalanche(
+		rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18) +
+		(uint64_t) image_size
+	);
+
+	hash.high = avalanche(
+		(lanes[0] * PRIME_3) ^ rotate_left(lanes[1] * PRIME_4, 23) ^ rotate_left(lanes[2] * PRIME_5, 41) ^
+		rotate_left(lanes[3], 53) ^ ((uint64_t) image_size * PRIME_1)
+	);
+
+	return hash;
+}
+
+static ImageSlot *find_slot(const ImageTable *table, ImageHash hash) {
+	uint64_t mask = table->capacity - 1;
+	uint64_t s = hash.low & mask;
+
+	while (table->slots[s].image && (table->slots[s].hash.low != hash.low || table->slots[s].hash.high != hash.high)) {
+		s = (s + 1) & mask;
+	}
+
+	return &table->slots[s];
+}
+
+static JDXError grow_image_table(ImageTable *table) {
+	uint64_t capacity = table->capacity ? table->capacity * 2 : 1024;
+	ImageSlot *slots = allocate_zeroed((size_t) capacity, sizeof(ImageSlot));
+
+	if (slots == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	ImageTable grown = { .slots = slots, .capacity = capacity };
+
+	for (uint64_t s = 0; s < table->capacity; s++) {
+		if (table->slots[s].image) {
+			*find_slot(&grown, table->slots[s].hash) = table->slots[s];
+		}
+	}
+
+	deallocate(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+
+	return JDXError_NONE;
+}
+
+// Returns the bytes of the image in the slot, or NULL if they are neither kept by the caller nor still cached
+static const uint8_t *get_stored_image(const ImageTable *table, const ImageSlot *slot) {
+	uint64_t image = slot->image - 1;
+
+	if (table->kept_images && image >= table->first_kept_image) {
+		return table->kept_images + table->image_size * (size_t) (image - table->first_kept_image);
+	} else if (slot->cache_entry && table->cache_images[slot->cache_entry - 1] == image) {
+		return table->cache + table->image_size * (size_t) (slot->cache_entry - 1);
+	}
+
+	return NULL;
+}
+
+static JDXError cache_image(ImageTable *table, ImageSlot *slot, const uint8_t *image_data, uint64_t image) {
+	slot->cache_entry = 0;
+
+	// Images kept by the caller need no copy, and empty images cost nothing to store again
+	if ((table->kept_images && image >= table->first_kept_image) || table->image_size == 0) {
+		return JDXError_NONE;
+	}
+
+	// At least the latest stored image is cached, however large images are
+	uint64_t max_cache_count = IMAGE_CACHE_SIZE / table->image_size > 0 ? IMAGE_CACHE_SIZE / table->image_size : 1;
+	uint64_t entry;
+
+	// The cache grows up to its size as images are stored, and from then on replaces its oldest entry
+	if (table->cache_count < max_cache_count) {
+		if (table->cache_count == table->cache_capacity) {
+			uint64_t cache_capacity = table->cache_capacity ? table->cache_capacity * 2 : 16;
+			cache_capacity = cache_capacity < max_cache_count ? cache_capacity : max_cache_count;
+
+			uint8_t *cache = reallocate(table->cache, table->image_size * (size_t) cache_capacity);
+
+			if (cache == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+
+			table->cache = cache;
+
+			uint64_t *cache_images = reallocate(table->cache_images, (size_t) cache_capacity * sizeof(uint64_t));
+
+			if (cache_images == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+
+			table->cache_images = cache_images;
+			table->cache_capacity = cache_capacity;
+		}
+
+		entry = table->cache_count++;
+	} else {
+		entry = table->cache_next;
+		table->cache_next = (table->cache_next + 1) % table->cache_count;
+	}
+
+	memcpy(table->cache + table->image_size * (size_t) entry, image_data, table->image_size);
+	table->cache_images[entry] = image;
+	slot->cache_entry = entry + 1;
+
+	return JDXError_NONE;
+}
+
+JDXError find_or_add_image(uint64_t *source_dest, ImageTable *table, ImageHash hash, const uint8_t *image_data, uint64_t image) {
+	// Keep the table at most half full so that probes stay short
+	if (2 * (table->image_count + 1) > table->capacity) {
+		JDXError grow_error = grow_image_table(table);
+
+		if (grow_error) {
+			return grow_error;
+		}
+	}
+
+	ImageSlot *slot = find_slot(table, hash);
+
+	if (slot->image) {
+		const uint8_t *stored_image = get_stored_image(table, slot);
+
+		if (stored_image && memcmp(stored_image, image_data, table->image_size) == 0) {
+			*source_dest = slot->image - 1;
+			return JDXError_NONE;
+		}
+
+		// The hash alone is easy to collide on purpose, so this image is stored too and later matches are checked
+		// against it, since its bytes are the ones at hand
+	} else {
+		slot->hash = hash;
+		table->image_count++;
+	}
+
+	slot->image = image + 1;
+	*source_dest = image;
+
+	return cache_image(table, slot, image_data, image);
+}
+
+void free_image_table(ImageTable *table) {
+	deallocate(table->slots);
+	deallocate(table->cache);
+	deallocate(table->cache_images);
+
+	table->slots = NULL;
+	table->capacity = 0;
+	table->image_count = 0;
+	table->cache = NULL;
+	table->cache_images = NULL;
+	table->cache_count = 0;
+	table->cache_capacity = 0;
+	table->cache_next = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes of stored images that are kept for checking hash matches, when the caller does not keep them in memory
+#define IMAGE_CACHE_SIZE (64 * 1024 * 1024)
+
+// 128-bit hash of the bytes of an image, which finds candidates that are then compared byte for byte
+typedef struct {
+	uint64_t low, high;
+} ImageHash;
+
+typedef struct {
+	ImageHash hash;
+
+	// Index of the latest stored image with the hash plus one, so that zero marks an empty slot
+	uint64_t image;
+
+	// Entry of the image cache that held its bytes plus one, or zero if they were never cached
+	uint64_t cache_entry;
+} ImageSlot;
+
+// Open addressing table from the hash of every distinct image written so far to a stored image that had it
+typedef struct {
+	ImageSlot *slots;
+	uint64_t capacity;
+	uint64_t image_count;
+	size_t image_size;
+
+	// Images from first_kept_image on, which the caller keeps in memory until the write ends
+	const uint8_t *kept_images;
+	uint64_t first_kept_image;
+
+	// Ring of the most recently stored images that are not kept by the caller, with the index of each
+	uint8_t *cache;
+	uint64_t *cache_images;
+	uint64_t cache_count;
+	uint64_t cache_capacity;
+	uint64_t cache_next;
+} ImageTable;
+
+ImageHash hash_image(const uint8_t *image_data, size_t image_size);
+
+// Finds a stored image with the same bytes, or adds image as a stored one if there is none, in which case source is
+// image. Matches whose bytes are no longer at hand are stored again rather than trusted to the hash
+JDXError find_or_add_image(uint64_t *source_dest, ImageTable *table, ImageHash hash, const uint8_t *image_data, uint64_t image);
+void free_image_table(ImageTable *table);
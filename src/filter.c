@@ -0,0 +1,321 @@
+#include "libjdx.h"
+#include "filter.h"
+#include "convert.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SSE2 and NEON are part of x86-64 and AArch64 themselves, so the reverse filters need no runtime dispatch
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SSE2_FILTERS
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define HAVE_NEON_FILTERS
+#include <arm_neon.h>
+#endif
+
+uint8_t get_filter_flags(JDXFilter filter, bool split_channels) {
+	return (uint8_t) filter | (split_channels ? FILTER_SPLIT_CHANNELS : 0);
+}
+
+bool are_filter_flags_valid(uint8_t filters) {
+	return (filters & ~(FILTER_PREDICTOR_MASK | FILTER_SPLIT_CHANNELS)) == 0
+		&& (filters & FILTER_PREDICTOR_MASK) <= JDXFilter_PAETH;
+}
+
+// Written as selects rather than branches, since which neighbour is nearest is close to random in noisy images
+static inline uint8_t predict_paeth(uint8_t a, uint8_t b, uint8_t c) {
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2 * c);
+
+	uint8_t nearest_bc = pb <= pc ? b : c;
+	return pa <= pb && pa <= pc ? a : nearest_bc;
+}
+
+// Rows are filtered from the end so that every prediction still sees the original bytes to its left and above
+static void filter_plane(uint8_t *plane, size_t row_size, size_t row_count, size_t stride, JDXFilter filter) {
+	for (size_t y = row_count; y-- > 0;) {
+		uint8_t *row = plane + row_size * y;
+		const uint8_t *prev = y > 0 ? row - row_size : NULL;
+
+		for (size_t x = row_size; x-- > 0;) {
+			uint8_t a = x >= stride ? row[x - stride] : 0;
+			uint8_t b = prev ? prev[x] : 0;
+			uint8_t c = prev && x >= stride ? prev[x - stride] : 0;
+
+			switch (filter) {
+				case JDXFilter_SUB: row[x] -= a; break;
+				case JDXFilter_UP: row[x] -= b; break;
+				case JDXFilter_PAETH: row[x] -= predict_paeth(a, b, c); break;
+				default: break;
+			}
+		}
+	}
+}
+
+static void unfilter_sub(uint8_t *row, size_t row_size, size_t stride) {
+	size_t x = 0;
+
+	// A prefix sum within each vector, plus the last pixel of the previous vector, undoes 16 bytes at once
+#if defined(HAVE_SSE2_FILTERS)
+	if (stride == 1 || stride == 4) {
+		__m128i carry = _mm_setzero_si128();
+
+		for (; x + 16 <= row_size; x += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (row + x));
+
+			if (stride == 1) {
+				v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+				v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+			}
+
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+			v = _mm_add_epi8(v, carry);
+
+			_mm_storeu_si128((__m128i *) (row + x), v);
+			carry = stride == 1 ? _mm_set1_epi8((char) row[x + 15]) : _mm_shuffle_epi32(v, 0xFF);
+		}
+	}
+#elif defined(HAVE_NEON_FILTERS)
+	if (stride == 1 || stride == 4) {
+		const uint8x16_t zero = vdupq_n_u8(0);
+		uint8x16_t carry = zero;
+
+		for (; x + 16 <= row_size; x += 16) {
+			uint8x16_t v = vld1q_u8(row + x);
+
+			if (stride == 1) {
+				v = vaddq_u8(v, vextq_u8(zero, v, 15));
+				v = vaddq_u8(v, vextq_u8(zero, v, 14));
+			}
+
+			v = vaddq_u8(v, vextq_u8(zero, v, 12));
+			v = vaddq_u8(v, vextq_u8(zero, v, 8));
+			v = vaddq_u8(v, carry);
+
+			vst1q_u8(row + x, v);
+			carry = stride == 1 ? vdupq_n_u8(row[x + 15]) : vreinterpretq_u8_u32(vdupq_n_u32(vgetq_lane_u32(vreinterpretq_u32_u8(v), 3)));
+		}
+	}
+#endif
+
+	for (x = x > stride ? x : stride; x < row_size; x++) {
+		row[x] += row[x - stride];
+	}
+}
+
+static void unfilter_up(uint8_t *row, const uint8_t *prev, size_t row_size) {
+	size_t x = 0;
+
+#if defined(HAVE_SSE2_FILTERS)
+	for (; x + 16 <= row_size; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (row + x));
+		__m128i above = _mm_loadu_si128((const __m128i *) (prev + x));
+
+		_mm_storeu_si128((__m128i *) (row + x), _mm_add_epi8(v, above));
+	}
+#elif defined(HAVE_NEON_FILTERS)
+	for (; x + 16 <= row_size; x += 16) {
+		vst1q_u8(row + x, vaddq_u8(vld1q_u8(row + x), vld1q_u8(prev + x)));
+	}
+#endif
+
+	for (; x < row_size; x++) {
+		row[x] += prev[x];
+	}
+}
+
+#if defined(HAVE_SSE2_FILTERS)
+
+// Loads four bytes where the row allows it, since only the low stride bytes of each lane are ever stored
+static inline __m128i load_pixel(const uint8_t *src, size_t remaining, size_t stride) {
+	uint32_t pixel = 0;
+
+	if (remaining >= 4) {
+		memcpy(&pixel, src, 4);
+	} else {
+		memcpy(&pixel, src, stride);
+	}
+
+	return _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) pixel), _mm_setzero_si128());
+}
+
+static inline __m128i abs_epi16(__m128i v) {
+	return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+#endif
+
+#if defined(HAVE_SSE2_FILTERS)
+
+// Inlined with a constant stride, so that loading and storing a pixel compiles to plain moves
+static inline void unfilter_paeth_sse2(uint8_t *row, const uint8_t *prev, size_t row_size, size_t stride) {
+	__m128i a = _mm_setzero_si128();
+	__m128i c = _mm_setzero_si128();
+
+	for (size_t x = 0; x + stride <= row_size; x += stride) {
+		__m128i b = load_pixel(prev + x, row_size - x, stride);
+		__m128i d = load_pixel(row + x, row_size - x, stride);
+
+		__m128i pa = abs_epi16(_mm_sub_epi16(b, c));
+		__m128i pb = abs_epi16(_mm_sub_epi16(a, c));
+		__m128i pc = abs_epi16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+		__m128i smallest = _mm_min_epi16(_mm_min_epi16(pa, pb), pc);
+
+		__m128i use_a = _mm_cmpeq_epi16(smallest, pa);
+		__m128i use_b = _mm_andnot_si128(use_a, _mm_cmpeq_epi16(smallest, pb));
+		__m128i use_c = _mm_andnot_si128(_mm_or_si128(use_a, use_b), _mm_set1_epi16(-1));
+
+		__m128i nearest = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(use_a, a), _mm_and_si128(use_b, b)),
+			_mm_and_si128(use_c, c)
+		);
+
+		d = _mm_and_si128(_mm_add_epi16(d, nearest), _mm_set1_epi16(0xFF));
+
+		uint32_t pixel = (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(d, d));
+		memcpy(row + x, &pixel, stride);
+
+		a = d;
+		c = b;
+	}
+}
+
+#elif defined(HAVE_NEON_FILTERS)
+
+// Inlined with a constant stride, so that loading and storing a pixel compiles to plain moves
+static inline void unfilter_paeth_neon(uint8_t *row, const uint8_t *prev, size_t row_size, size_t stride) {
+	uint8x8_t a = vdup_n_u8(0);
+	uint8x8_t c = vdup_n_u8(0);
+
+	for (size_t x = 0; x + stride <= row_size; x += stride) {
+		uint32_t above = 0, current = 0;
+		memcpy(&above, prev + x, stride);
+		memcpy(&current, row + x, stride);
+
+		uint8x8_t b = vcreate_u8(above);
+		uint8x8_t d = vcreate_u8(current);
+
+		// Distances to c saturate at 255, which never changes which of them is smallest
+		uint8x8_t pa = vabd_u8(b, c);
+		uint8x8_t pb = vabd_u8(a, c);
+		uint8x8_t pc = vqmovn_u16(vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c)));
+
+		uint8x8_t use_a = vand_u8(vcle_u8(pa, pb), vcle_u8(pa, pc));
+		uint8x8_t use_b = vcle_u8(pb, pc);
+
+		d = vadd_u8(d, vbsl_u8(use_a, a, vbsl_u8(use_b, b, c)));
+
+		uint32_t pixel = vget_lane_u32(vreinterpret_u32_u8(d), 0);
+		memcpy(row + x, &pixel, stride);
+
+		a = d;
+		c = b;
+	}
+}
+
+#endif
+
+static void unfilter_paeth(uint8_t *row, const uint8_t *prev, size_t row_size, size_t stride) {
+	// Each pixel depends on the one before it, so the channels of one pixel are predicted together
+#if defined(HAVE_SSE2_FILTERS)
+	if (stride == 3) {
+		unfilter_paeth_sse2(row, prev, row_size, 3);
+		return;
+	} else if (stride == 4) {
+		unfilter_paeth_sse2(row, prev, row_size, 4);
+		return;
+	}
+#elif defined(HAVE_NEON_FILTERS)
+	if (stride == 3) {
+		unfilter_paeth_neon(row, prev, row_size, 3);
+		return;
+	} else if (stride == 4) {
+		unfilter_paeth_neon(row, prev, row_size, 4);
+		return;
+	}
+#endif
+
+	size_t x = 0;
+
+	for (; x < stride && x < row_size; x++) {
+		row[x] += prev[x];
+	}
+
+	for (; x < row_size; x++) {
+		row[x] += predict_paeth(row[x - stride], prev[x], prev[x - stride]);
+	}
+}
+
+static void unfilter_plane(uint8_t *plane, size_t row_size, size_t row_count, size_t stride, JDXFilter filter) {
+	for (size_t y = 0; y < row_count; y++) {
+		uint8_t *row = plane + row_size * y;
+		const uint8_t *prev = y > 0 ? row - row_size : NULL;
+
+		// Rows above the first are taken as zero, which turns Up into nothing and Paeth into Sub
+		if (filter == JDXFilter_SUB || (filter == JDXFilter_PAETH && y == 0)) {
+			unfilter_sub(row, row_size, stride);
+		} else if (filter == JDXFilter_UP && y > 0) {
+			unfilter_up(row, prev, row_size);
+		} else if (filter == JDXFilter_PAETH) {
+			unfilter_paeth(row, prev, row_size, stride);
+		}
+	}
+}
+
+void apply_filters(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint8_t filters) {
+	size_t channels = header->bit_depth / 8;
+	bool split_channels = filters & FILTER_SPLIT_CHANNELS;
+	JDXFilter filter = (JDXFilter) (filters & FILTER_PREDICTOR_MASK);
+
+	if (split_channels) {
+		JDX_ConvertToPlanar(dest, src, header, 1);
+	} else {
+		memcpy(dest, src, JDX_GetImageSize(header));
+	}
+
+	if (filter == JDXFilter_NONE) {
+		return;
+	}
+
+	// Split channels are predicted one plane at a time, from the same channel of neighbouring pixels
+	size_t plane_count = split_channels ? channels : 1;
+	size_t stride = split_channels ? 1 : channels;
+	size_t row_size = (size_t) header->image_width * stride;
+	size_t plane_size = row_size * header->image_height;
+
+	for (size_t p = 0; p < plane_count; p++) {
+		filter_plane(dest + plane_size * p, row_size, header->image_height, stride, filter);
+	}
+}
+
+void reverse_filters(uint8_t *image_data, uint8_t *scratch, const JDXHeader *header, uint8_t filters, uint64_t image_count) {
+	size_t channels = header->bit_depth / 8;
+	size_t image_size = JDX_GetImageSize(header);
+	bool split_channels = filters & FILTER_SPLIT_CHANNELS;
+	JDXFilter filter = (JDXFilter) (filters & FILTER_PREDICTOR_MASK);
+
+	size_t plane_count = split_channels ? channels : 1;
+	size_t stride = split_channels ? 1 : channels;
+	size_t row_size = (size_t) header->image_width * stride;
+	size_t plane_size = row_size * header->image_height;
+
+	for (uint64_t i = 0; i < image_count; i++) {
+		uint8_t *image = image_data + image_size * (size_t) i;
+
+		if (filter != JDXFilter_NONE) {
+			for (size_t p = 0; p < plane_count; p++) {
+				unfilter_plane(image + plane_size * p, row_size, header->image_height, stride, filter);
+			}
+		}
+
+		if (split_channels) {
+			memcpy(scratch, image, image_size);
+			interleave_planes(image, scratch, header, 1);
+		}
+	}
+}
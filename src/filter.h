@@ -0,0 +1,19 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Filters of a body are recorded in one byte, holding the JDXFilter in its low bits and a flag for split channels
+#define FILTER_PREDICTOR_MASK 0x0F
+#define FILTER_SPLIT_CHANNELS 0x80
+
+uint8_t get_filter_flags(JDXFilter filter, bool split_channels);
+bool are_filter_flags_valid(uint8_t filters);
+
+// Filters one image from src into dest, which must not overlap
+void apply_filters(uint8_t *dest, const uint8_t *src, const JDXHeader *header, uint8_t filters);
+
+// Reverses the filters of consecutive images in place, with scratch holding one image if channels are split
+void reverse_filters(uint8_t *image_data, uint8_t *scratch, const JDXHeader *header, uint8_t filters, uint64_t image_count);
@@ -1,28 +1,33 @@
 #include "trycatch.h"
 #include "libjdx.h"
+#include "labels.h"
 #include "leio.h"
+#include "allocator.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
 
-const JDXVersion JDX_VERSION = { JDX_BUILD_ALPHA, 0, 4, 0 };
+const JDXVersion JDX_VERSION = { JDX_BUILD_ALPHA, 1, 5, 0 };
+
+// Size of the magic bytes, version, width, height, bit depth, and label count that precede the labels
+#define FIXED_HEADER_SIZE 14
+
+// Size of the first read of a header, which covers the whole header of most files
+#define HEADER_READ_SIZE 4096
 
 JDXHeader *JDX_AllocHeader(void) {
-	return calloc(1, sizeof(JDXHeader));
+	return allocate_zeroed(1, sizeof(JDXHeader));
 }
 
+// Labels share a single allocation with their pointer array, so freeing the array frees every label
 static inline void free_header_labels(JDXHeader *header) {
-	if (header->labels) {
-		if (header->label_count > 0) {
-			for (uint_fast16_t l = 0; l < header->label_count; l++) {
-				free((char *) header->labels[l]);
-			}
-		}
+	free_label_table(header);
+	deallocate(header->labels);
 
-		free(header->labels);
-	}
+	header->labels = NULL;
 }
 
 void JDX_FreeHeader(JDXHeader *header) {
@@ -31,7 +36,7 @@ void JDX_FreeHeader(JDXHeader *header) {
 	}
 
 	free_header_labels(header);
-	free(header);
+	deallocate(header);
 }
 
 void JDX_CopyHeader(JDXHeader *dest, const JDXHeader *src) {
@@ -40,18 +45,16 @@ void JDX_CopyHeader(JDXHeader *dest, const JDXHeader *src) {
 	dest->image_height = src->image_height;
 	dest->bit_depth = src->bit_depth;
 
-	free_header_labels(dest);
-	dest->labels = malloc(src->label_count * sizeof(char **));
-
-	for (uint_fast16_t l = 0; l < src->label_count; l++) {
-		size_t label_size = strlen(src->labels[l]) + 1;
+	char **labels;
+	JDXError arena_error = alloc_label_arena(&labels, src->labels, src->label_count);
 
-		dest->labels[l] = malloc(label_size);
-		memcpy((char *) dest->labels[l], src->labels[l], label_size);
-	}
-
-	dest->label_count = src->label_count;
+	free_header_labels(dest);
+	dest->labels = arena_error ? NULL : labels;
+	dest->label_count = arena_error ? 0 : src->label_count;
 	dest->image_count = src->image_count;
+
+	// Without a table, lookups fall back to searching the labels, so running out of memory here is not an error
+	build_label_table(dest);
 }
 
 size_t JDX_GetImageSize(const JDXHeader *header) {
@@ -62,64 +65,148 @@ size_t JDX_GetImageSize(const JDXHeader *header) {
 	);
 }
 
+// Parses as much of a header as the buffer holds, setting needed to a lower bound on the number of bytes
+// still missing, or to zero once the header is complete and has been stored in dest
+static JDXError parse_header(JDXHeader *dest, size_t *consumed, size_t *needed, const uint8_t *buffer, size_t size) {
+	JDXHeader header = { .labels = NULL };
+
+	if (size < FIXED_HEADER_SIZE) {
+		*needed = FIXED_HEADER_SIZE - size;
+		return JDXError_NONE;
+	} else if (memcmp(buffer, "JDX", 3) != 0) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	header.version.major = buffer[3];
+	header.version.minor = buffer[4];
+	header.version.patch = buffer[5];
+	header.version.build_type = buffer[6];
+	memcpy_le(&header.image_width, buffer + 7, sizeof(header.image_width));
+	memcpy_le(&header.image_height, buffer + 9, sizeof(header.image_height));
+	header.bit_depth = buffer[11];
+	memcpy_le(&header.label_count, buffer + 12, sizeof(header.label_count));
+
+	size_t position = FIXED_HEADER_SIZE;
+	uint_fast16_t l;
+
+	for (l = 0; l < header.label_count; l++) {
+		size_t available = size - position;
+		const uint8_t *label_end = memchr(buffer + position, '\0', available < JDX_MAX_LABEL_LEN ? available : JDX_MAX_LABEL_LEN);
+
+		if (label_end == NULL) {
+			if (available >= JDX_MAX_LABEL_LEN) {
+				return JDXError_CORRUPT_FILE;
+			}
+
+			break;
+		}
+
+		position = (size_t) (label_end - buffer) + 1;
+	}
+
+	// Every remaining label takes at least its terminator, followed by the image count
+	if (l < header.label_count) {
+		*needed = (header.label_count - l) + sizeof(header.image_count);
+		return JDXError_NONE;
+	} else if (size - position < sizeof(header.image_count)) {
+		*needed = sizeof(header.image_count) - (size - position);
+		return JDXError_NONE;
+	}
+
+	memcpy_le(&header.image_count, buffer + position, sizeof(header.image_count));
+
+	if ((header.bit_depth != 8 && header.bit_depth != 24 && header.bit_depth != 32) || (header.version.build_type > JDX_BUILD_RELEASE)) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	// The labels are already stored back to back in the buffer, so they are copied into their arena at once
+	if (header.label_count > 0) {
+		size_t strings_size = position - FIXED_HEADER_SIZE;
+		header.labels = allocate(header.label_count * sizeof(char *) + strings_size);
+
+		if (header.labels == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+
+		char *string = (char *) (header.labels + header.label_count);
+		memcpy(string, buffer + FIXED_HEADER_SIZE, strings_size);
+
+		for (l = 0; l < header.label_count; l++) {
+			header.labels[l] = string;
+			string += strlen(string) + 1;
+		}
+	}
+
+	*consumed = position + sizeof(header.image_count);
+	*needed = 0;
+	*dest = header;
+
+	return JDXError_NONE;
+}
+
 JDXError JDX_ReadHeaderFromFile(JDXHeader *dest, FILE *file) {
-	char corruption_check[3];
-	char label_buffer[JDX_MAX_LABEL_LEN];
 	JDXHeader header = { .labels = NULL };
+	uint8_t *buffer = NULL;
+	size_t size = 0, consumed = 0, needed = 0;
+
+	// Seekable files are read ahead and rewound to the end of the header afterwards, while other
+	// streams are only ever read up to the lower bound of what the header still needs
+	int64_t start = ftell_64(file);
+	bool seekable = start >= 0;
 
 	TRY {
-		if (fread_le(corruption_check, sizeof(corruption_check), file) == EOF) {
-			THROW(JDXError_READ_FILE);
-		} else if (memcmp(corruption_check, "JDX", 3) != 0) {
-			THROW(JDXError_CORRUPT_FILE);
-		}
+		for (;;) {
+			JDXError parse_error = parse_header(&header, &consumed, &needed, buffer, size);
+
+			if (parse_error) {
+				THROW(parse_error);
+			} else if (needed == 0) {
+				break;
+			}
+
+			size_t read_size = needed;
 
-		if (
-			fread_le(&header.version.major, sizeof(header.version.major), file) == EOF ||
-			fread_le(&header.version.minor, sizeof(header.version.minor), file) == EOF ||
-			fread_le(&header.version.patch, sizeof(header.version.patch), file) == EOF ||
-			fread_le(&header.version.build_type, sizeof(header.version.build_type), file) == EOF ||
-			fread_le(&header.image_width, sizeof(header.image_width), file) == EOF ||
-			fread_le(&header.image_height, sizeof(header.image_height), file) == EOF ||
-			fread_le(&header.bit_depth, sizeof(header.bit_depth), file) == EOF ||
-			fread_le(&header.label_count, sizeof(header.label_count), file) == EOF
-		) { THROW(JDXError_READ_FILE); }
-
-		// TODO: Consider doing this with only 2 mallocs; it may speed it up
-		header.labels = calloc(header.label_count, sizeof(char *));
-
-		for (int_fast16_t l = 0; l < header.label_count; l++) {
-			int i = 0;
-			while (i < JDX_MAX_LABEL_LEN && (label_buffer[i++] = getc(file)));
-
-			if (label_buffer[i - 1]) {
-				THROW(JDXError_CORRUPT_FILE);
+			if (seekable) {
+				size_t read_ahead = size > 0 ? size : HEADER_READ_SIZE;
+				read_size = read_ahead > needed ? read_ahead : needed;
 			}
 
-			header.labels[l] = malloc(i);
-			memcpy((char *) header.labels[l], label_buffer, i);
+			uint8_t *new_buffer = reallocate(buffer, size + read_size);
+
+			if (new_buffer == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+
+			buffer = new_buffer;
+
+			size_t read_count = fread(buffer + size, 1, read_size, file);
+			size += read_count;
+
+			if (read_count < needed) {
+				THROW(JDXError_READ_FILE);
+			}
 		}
 
-		if (fread_le(&header.image_count, sizeof(header.image_count), file) == EOF) {
+		if (seekable && size > consumed && fseek_64(file, start + (int64_t) consumed, SEEK_SET) != 0) {
 			THROW(JDXError_READ_FILE);
 		}
 
-		if ((header.bit_depth != 8 && header.bit_depth != 24 && header.bit_depth != 32) || (header.version.build_type > JDX_BUILD_RELEASE)) {
-			THROW(JDXError_CORRUPT_FILE);
-		}
-	} CATCH(error) {
-		if (header.labels) {
-			for (int_fast16_t l = 0; l < header.label_count; l++) {
-				free((char *) header.labels[l]);
-			}
+		JDXError table_error = build_label_table(&header);
 
-			free(header.labels);
+		if (table_error) {
+			THROW(table_error);
 		}
+	} CATCH(error) {
+		free_label_table(&header);
+		deallocate(header.labels);
+		deallocate(buffer);
 
 		return error;
 	}
 
-	if (dest && dest->labels) {
+	deallocate(buffer);
+
+	if (dest) {
 		free_header_labels(dest);
 	}
 
@@ -150,12 +237,15 @@ JDXError JDX_WriteHeaderToFile(JDXHeader *header, FILE *file) {
 		return JDXError_WRITE_FILE;
 	}
 
+	// Files are always written in the current format, regardless of the version they were read from
+	JDXVersion version = JDX_VERSION;
+
 	// Must write this way to account for alignment of JDXHeader
 	if (
-		fwrite_le(&header->version.major, sizeof(header->version.major), file) == EOF ||
-		fwrite_le(&header->version.minor, sizeof(header->version.minor), file) == EOF ||
-		fwrite_le(&header->version.patch, sizeof(header->version.patch), file) == EOF ||
-		fwrite_le(&header->version.build_type, sizeof(header->version.build_type), file) == EOF ||
+		fwrite_le(&version.major, sizeof(version.major), file) == EOF ||
+		fwrite_le(&version.minor, sizeof(version.minor), file) == EOF ||
+		fwrite_le(&version.patch, sizeof(version.patch), file) == EOF ||
+		fwrite_le(&version.build_type, sizeof(version.build_type), file) == EOF ||
 		fwrite_le(&header->image_width, sizeof(header->image_width), file) == EOF ||
 		fwrite_le(&header->image_height, sizeof(header->image_height), file) == EOF ||
 		fwrite_le(&header->bit_depth, sizeof(header->bit_depth), file) == EOF ||
@@ -0,0 +1,330 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trycatch.h"
+#include "libjdx.h"
+#include "parallel.h"
+#include "allocator.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+const JDXIteratorOptions JDX_DEFAULT_ITERATOR_OPTIONS = {
+	.batch_size = 32,
+	.shuffle = true,
+	.seed = 0,
+	.thread_count = 1,
+	.ring_size = 4
+};
+
+typedef enum {
+	SLOT_FREE,
+	SLOT_FILLING,
+	SLOT_READY
+} SlotState;
+
+typedef struct {
+	SlotState state;
+	uint64_t sequence;
+
+	uint8_t *pixels;
+	JDXLabel *labels;
+	uint64_t image_count;
+} BatchSlot;
+
+struct JDXIteratorState {
+	uint32_t batch_size;
+	bool shuffle;
+	uint64_t seed;
+	uint64_t batches_per_epoch;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t slot_ready;
+	pthread_cond_t slot_free;
+	bool closing;
+
+	// Batches are numbered across epochs, and producers never run more than the ring ahead of the consumer
+	BatchSlot *slots;
+	uint32_t ring_size;
+	uint64_t next_sequence;
+	uint64_t consumed_sequence;
+	bool holding_batch;
+
+	// Permutations of the epochs that batches in flight can belong to, indexed by epoch modulo their count
+	uint64_t **permutations;
+	uint32_t permutation_count;
+
+	pthread_t *producers;
+	uint32_t producer_count;
+};
+
+static uint64_t next_random(uint64_t *state) {
+	// SplitMix64, which is enough to shuffle with and needs no more than one word of state
+	uint64_t z = (*state += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+	return z ^ (z >> 31);
+}
+
+static void build_permutation(uint64_t *dest, uint64_t image_count, bool shuffle, uint64_t seed, uint64_t epoch) {
+	for (uint64_t i = 0; i < image_count; i++) {
+		dest[i] = i;
+	}
+
+	if (!shuffle) {
+		return;
+	}
+
+	// Each epoch has its own stream of random numbers, so a seed always produces the same sequence of epochs
+	uint64_t random_state = seed ^ (epoch * 0xD1B54A32D192ED03);
+
+	for (uint64_t i = image_count - 1; i > 0; i--) {
+		uint64_t bound = i + 1;
+		uint64_t threshold = (0 - bound) % bound;
+		uint64_t random;
+
+		// Rejecting the lowest values removes the bias that a plain modulo would have
+		while ((random = next_random(&random_state)) < threshold);
+
+		uint64_t j = random % bound;
+		uint64_t temp = dest[i];
+		dest[i] = dest[j];
+		dest[j] = temp;
+	}
+}
+
+static void *run_producer(void *arg) {
+	JDXIterator *iterator = arg;
+	struct JDXIteratorState *state = iterator->_state;
+
+	uint64_t image_count = iterator->dataset->header->image_count;
+
+	pthread_mutex_lock(&state->mutex);
+
+	for (;;) {
+		while (!state->closing && state->next_sequence >= state->consumed_sequence + state->ring_size) {
+			pthread_cond_wait(&state->slot_free, &state->mutex);
+		}
+
+		if (state->closing) {
+			break;
+		}
+
+		uint64_t sequence = state->next_sequence++;
+		uint64_t epoch = sequence / state->batches_per_epoch;
+		uint64_t batch = sequence % state->batches_per_epoch;
+		uint64_t *permutation = state->permutations[epoch % state->permutation_count];
+
+		// Whichever producer claims the first batch of an epoch shuffles it before any other batch of it can be claimed
+		if (batch == 0) {
+			build_permutation(permutation, image_count, state->shuffle, state->seed, epoch);
+		}
+
+		BatchSlot *slot = &state->slots[sequence % state->ring_size];
+		slot->state = SLOT_FILLING;
+		slot->sequence = sequence;
+
+		uint64_t first_index = batch * state->batch_size;
+		uint64_t remaining = image_count - first_index;
+		slot->image_count = remaining < state->batch_size ? remaining : state->batch_size;
+
+		// The gather itself runs unlocked, so several producers fill their slots at the same time
+		pthread_mutex_unlock(&state->mutex);
+		JDX_GetBatch(slot->pixels, slot->labels, iterator->dataset, permutation + first_index, slot->image_count);
+		pthread_mutex_lock(&state->mutex);
+
+		slot->state = SLOT_READY;
+		pthread_cond_broadcast(&state->slot_ready);
+	}
+
+	pthread_mutex_unlock(&state->mutex);
+	return NULL;
+}
+
+static void free_iterator_state(struct JDXIteratorState *state) {
+	if (state == NULL) {
+		return;
+	}
+
+	if (state->slots) {
+		for (uint32_t s = 0; s < state->ring_size; s++) {
+			deallocate(state->slots[s].pixels);
+			deallocate(state->slots[s].labels);
+		}
+	}
+
+	if (state->permutations) {
+		for (uint32_t p = 0; p < state->permutation_count; p++) {
+			deallocate(state->permutations[p]);
+		}
+	}
+
+	deallocate(state->slots);
+	deallocate(state->permutations);
+	deallocate(state->producers);
+	deallocate(state);
+}
+
+JDXError JDX_OpenIterator(JDXIterator **dest, const JDXDataset *dataset, const JDXIteratorOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	struct JDXIteratorState *state = NULL;
+	JDXIterator *iterator = NULL;
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_ITERATOR_OPTIONS;
+	}
+
+	uint64_t image_count = dataset->header->image_count;
+
+	if (options->batch_size == 0 || options->ring_size == 0 || image_count == 0) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	TRY {
+		state = allocate_zeroed(1, sizeof(struct JDXIteratorState));
+		iterator = allocate_zeroed(1, sizeof(JDXIterator));
+
+		if (state == NULL || iterator == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		state->batch_size = options->batch_size;
+		state->shuffle = options->shuffle;
+		state->seed = options->seed;
+		state->batches_per_epoch = (image_count + options->batch_size - 1) / options->batch_size;
+		state->ring_size = options->ring_size;
+
+		// A full ring plus the batch being claimed can span this many epochs, plus one more to start shuffling into
+		state->permutation_count = (uint32_t) ((state->ring_size + state->batches_per_epoch - 1) / state->batches_per_epoch) + 2;
+
+		state->slots = allocate_zeroed(state->ring_size, sizeof(BatchSlot));
+		state->permutations = allocate_zeroed(state->permutation_count, sizeof(uint64_t *));
+
+		if (state->slots == NULL || state->permutations == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		size_t image_size = JDX_GetImageSize(dataset->header);
+
+		for (uint32_t s = 0; s < state->ring_size; s++) {
+			state->slots[s].pixels = allocate(image_size * options->batch_size);
+			state->slots[s].labels = allocate(sizeof(JDXLabel) * options->batch_size);
+
+			if (state->slots[s].pixels == NULL || state->slots[s].labels == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+		}
+
+		for (uint32_t p = 0; p < state->permutation_count; p++) {
+			if ((state->permutations[p] = allocate((size_t) image_count * sizeof(uint64_t))) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+		}
+
+		// More producers than slots would only ever wait on each other
+		uint32_t producer_count = resolve_thread_count(options->thread_count);
+		state->producer_count = producer_count < state->ring_size ? producer_count : state->ring_size;
+		state->producers = allocate_zeroed(state->producer_count, sizeof(pthread_t));
+
+		if (state->producers == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+	} CATCH(error) {
+		free_iterator_state(state);
+		deallocate(iterator);
+
+		return error;
+	}
+
+	pthread_mutex_init(&state->mutex, NULL);
+	pthread_cond_init(&state->slot_ready, NULL);
+	pthread_cond_init(&state->slot_free, NULL);
+
+	iterator->dataset = dataset;
+	iterator->epoch = 0;
+	iterator->_state = state;
+
+	uint32_t started = 0;
+
+	while (started < state->producer_count && pthread_create(&state->producers[started], NULL, run_producer, iterator) == 0) {
+		started++;
+	}
+
+	// Closing joins only the producers that exist, even when none of them started
+	state->producer_count = started;
+
+	// Producers are interchangeable, so the iterator works as long as at least one of them started
+	if (started == 0) {
+		JDX_CloseIterator(iterator);
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	*dest = iterator;
+	return JDXError_NONE;
+}
+
+JDXError JDX_NextBatch(JDXIterator *iterator, JDXBatch *dest) {
+	struct JDXIteratorState *state = iterator->_state;
+
+	pthread_mutex_lock(&state->mutex);
+
+	// The batch returned by the previous call goes back to the producers only now, once the consumer is done with it
+	if (state->holding_batch) {
+		state->slots[state->consumed_sequence % state->ring_size].state = SLOT_FREE;
+		state->consumed_sequence++;
+		state->holding_batch = false;
+
+		pthread_cond_broadcast(&state->slot_free);
+	}
+
+	// Each epoch ends with one call that reports it, after which batches of the next epoch follow
+	if (state->consumed_sequence / state->batches_per_epoch > iterator->epoch) {
+		iterator->epoch++;
+		pthread_mutex_unlock(&state->mutex);
+
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	BatchSlot *slot = &state->slots[state->consumed_sequence % state->ring_size];
+
+	while (slot->state != SLOT_READY || slot->sequence != state->consumed_sequence) {
+		pthread_cond_wait(&state->slot_ready, &state->mutex);
+	}
+
+	state->holding_batch = true;
+	pthread_mutex_unlock(&state->mutex);
+
+	dest->pixels = slot->pixels;
+	dest->labels = slot->labels;
+	dest->image_count = slot->image_count;
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_CloseIterator(JDXIterator *iterator) {
+	if (iterator == NULL) {
+		return JDXError_NONE;
+	}
+
+	struct JDXIteratorState *state = iterator->_state;
+
+	pthread_mutex_lock(&state->mutex);
+	state->closing = true;
+	pthread_cond_broadcast(&state->slot_free);
+	pthread_mutex_unlock(&state->mutex);
+
+	for (uint32_t p = 0; p < state->producer_count; p++) {
+		pthread_join(state->producers[p], NULL);
+	}
+
+	pthread_mutex_destroy(&state->mutex);
+	pthread_cond_destroy(&state->slot_ready);
+	pthread_cond_destroy(&state->slot_free);
+
+	free_iterator_state(state);
+	deallocate(iterator);
+
+	return JDXError_NONE;
+}
@@ -0,0 +1,163 @@
+#include "libjdx.h"
+#include "labels.h"
+#include "allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Open addressing table whose slots hold a label number plus one, so that zero marks an empty slot. The slots follow
+// the table in the same allocation, so that every header holds only one allocation for it
+struct JDXLabelTable {
+	uint32_t capacity;
+	uint32_t label_count;
+	uint32_t slots[];
+};
+
+static uint64_t hash_label(const char *label) {
+	// 64-bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+
+	while (*label) {
+		hash ^= (uint8_t) *label++;
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+static void insert_slot(struct JDXLabelTable *table, const char *label, JDXLabel number) {
+	uint32_t mask = table->capacity - 1;
+	uint32_t s = (uint32_t) hash_label(label) & mask;
+
+	while (table->slots[s]) {
+		s = (s + 1) & mask;
+	}
+
+	table->slots[s] = (uint32_t) number + 1;
+}
+
+static JDXError size_label_table(JDXHeader *header, uint32_t min_label_count) {
+	// Keep the table at most half full so that probes stay short
+	uint32_t capacity = 16;
+
+	while (capacity < 2 * min_label_count) {
+		capacity *= 2;
+	}
+
+	struct JDXLabelTable *table = allocate_zeroed(1, sizeof(struct JDXLabelTable) + capacity * sizeof(uint32_t));
+
+	if (table == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	table->capacity = capacity;
+	table->label_count = header->label_count;
+
+	for (uint_fast16_t l = 0; l < header->label_count; l++) {
+		insert_slot(table, header->labels[l], (JDXLabel) l);
+	}
+
+	deallocate(header->_label_table);
+	header->_label_table = table;
+
+	return JDXError_NONE;
+}
+
+JDXError build_label_table(JDXHeader *header) {
+	return size_label_table(header, header->label_count);
+}
+
+void free_label_table(JDXHeader *header) {
+	deallocate(header->_label_table);
+	header->_label_table = NULL;
+}
+
+JDXError index_label(JDXHeader *header, JDXLabel label) {
+	struct JDXLabelTable *table = header->_label_table;
+
+	// Lookups in headers without a table search the labels themselves, which then include the new one
+	if (table == NULL) {
+		return JDXError_NONE;
+	}
+
+	if (2 * (table->label_count + 1) > table->capacity) {
+		return size_label_table(header, header->label_count);
+	}
+
+	insert_slot(table, header->labels[label], label);
+	table->label_count++;
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_FindLabel(JDXLabel *dest, const JDXHeader *header, const char *label) {
+	const struct JDXLabelTable *table = header->_label_table;
+
+	// Headers put together without the library have no table, or a stale one if their labels were changed by hand, so
+	// their labels are searched one by one rather than building a table here, which would race with other lookups
+	if (table == NULL || table->label_count != header->label_count) {
+		for (uint_fast16_t l = 0; l < header->label_count; l++) {
+			if (strcmp(header->labels[l], label) == 0) {
+				*dest = (JDXLabel) l;
+				return JDXError_NONE;
+			}
+		}
+
+		return JDXError_UNKNOWN_LABEL;
+	}
+
+	uint32_t mask = table->capacity - 1;
+
+	for (uint32_t s = (uint32_t) hash_label(label) & mask; table->slots[s]; s = (s + 1) & mask) {
+		JDXLabel number = (JDXLabel) (table->slots[s] - 1);
+
+		if (strcmp(header->labels[number], label) == 0) {
+			*dest = number;
+			return JDXError_NONE;
+		}
+	}
+
+	return JDXError_UNKNOWN_LABEL;
+}
+
+size_t get_label_arena_size(char *const *labels, uint16_t label_count) {
+	size_t size = label_count * sizeof(char *);
+
+	for (uint_fast16_t l = 0; l < label_count; l++) {
+		size += strlen(labels[l]) + 1;
+	}
+
+	return size;
+}
+
+void fill_label_arena(char **arena, char *const *labels, uint16_t label_count) {
+	// The pointer array comes first so that it stays aligned, followed by every string back to back
+	char *string = (char *) (arena + label_count);
+
+	for (uint_fast16_t l = 0; l < label_count; l++) {
+		size_t label_size = strlen(labels[l]) + 1;
+
+		memcpy(string, labels[l], label_size);
+		arena[l] = string;
+		string += label_size;
+	}
+}
+
+JDXError alloc_label_arena(char ***dest, char *const *labels, uint16_t label_count) {
+	if (label_count == 0) {
+		*dest = NULL;
+		return JDXError_NONE;
+	}
+
+	char **arena = allocate(get_label_arena_size(labels, label_count));
+
+	if (arena == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	fill_label_arena(arena, labels, label_count);
+
+	*dest = arena;
+	return JDXError_NONE;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "libjdx.h"
+
+// Builds the hash index of the labels of a header, which every header whose labels are set by the library gets, so
+// that JDX_FindLabel only ever reads it and lookups on a shared header are safe from any number of threads
+JDXError build_label_table(JDXHeader *header);
+void free_label_table(JDXHeader *header);
+
+// Adds a label that was just appended to the header to its table, if the table has been built
+JDXError index_label(JDXHeader *header, JDXLabel label);
+
+// Copies labels into a single allocation holding both the pointer array and the strings, freed all at once
+JDXError alloc_label_arena(char ***dest, char *const *labels, uint16_t label_count);
+
+// Size of the arena that alloc_label_arena would allocate, for filling arenas that are part of larger allocations
+size_t get_label_arena_size(char *const *labels, uint16_t label_count);
+void fill_label_arena(char **arena, char *const *labels, uint16_t label_count);
@@ -1,7 +1,17 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
 #include "leio.h"
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 static inline bool machine_is_le(void) {
   static int_fast8_t precheck = -1;
@@ -41,3 +51,37 @@ size_t fwrite_le(void *src, size_t size, FILE *file) {
 
   return 0;
 }
+
+void memcpy_le(void *dest, const void *src, size_t size) {
+  if (machine_is_le()) {
+    memcpy(dest, src, size);
+  } else {
+    for (size_t i = 0; i < size; i++) {
+      ((char *) dest)[i] = ((const char *) src)[size - 1 - i];
+    }
+  }
+}
+
+int64_t ftell_64(FILE *file) {
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return (int64_t) ftello(file);
+#endif
+}
+
+int fseek_64(FILE *file, int64_t offset, int origin) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, origin);
+#else
+  return fseeko(file, (off_t) offset, origin);
+#endif
+}
+
+int ftruncate_64(FILE *file, int64_t size) {
+#ifdef _WIN32
+  return _chsize_s(_fileno(file), size);
+#else
+  return ftruncate(fileno(file), (off_t) size);
+#endif
+}
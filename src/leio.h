@@ -1,6 +1,17 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
 
 size_t fread_le(void *dest, size_t size, FILE *file);
 size_t fwrite_le(void *dest, size_t size, FILE *file);
+
+// Copies a little-endian field out of a buffer that has already been read
+void memcpy_le(void *dest, const void *src, size_t size);
+
+// 64-bit file positioning, since bodies of large datasets can exceed the range of long
+int64_t ftell_64(FILE *file);
+int fseek_64(FILE *file, int64_t offset, int origin);
+
+// Cuts the file off at size, which must be flushed beforehand
+int ftruncate_64(FILE *file, int64_t size);
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include "libjdx.h"
+#include "loader.h"
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// io_uring is called through its system calls directly, so it needs nothing but kernel headers that define them
+#if defined(__linux__) && !defined(JDX_NO_IO_URING)
+#include <sys/syscall.h>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+
+#define HAS_IO_URING
+#endif
+#endif
+
+// Streams are read in segments of at most this size, so that large chunks are split across several requests
+#define SEGMENT_SIZE (1 << 20)
+
+// Number of segments that io_uring keeps in flight, and number of threads that read segments without it
+#define QUEUE_DEPTH 32
+#define READ_THREAD_COUNT 4
+
+typedef struct {
+	// Relative to the start of the chunk data, like the offsets of the index
+	uint64_t offset;
+	uint32_t size;
+	uint64_t chunk;
+} Segment;
+
+#ifdef DEBUG
+static bool pread_forced = false;
+static uint32_t read_size_limit = 0;
+static uint64_t failing_offset = UINT64_MAX;
+
+void force_pread_loader(bool force) {
+	pread_forced = force;
+}
+
+void limit_loader_reads(uint32_t max_size) {
+	read_size_limit = max_size;
+}
+
+void fail_loader_reads_from(uint64_t offset) {
+	failing_offset = offset;
+}
+
+// Size of the next read of at most size bytes, cut short by the test hooks
+static uint32_t limit_read_size(uint32_t size) {
+	return read_size_limit > 0 && size > read_size_limit ? read_size_limit : size;
+}
+#else
+#define limit_read_size(size) (size)
+#endif
+
+#ifdef HAS_IO_URING
+
+typedef struct {
+	int fd;
+
+	void *sq_ring;
+	void *cq_ring;
+	struct io_uring_sqe *sqes;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+
+	_Atomic uint32_t *sq_tail;
+	uint32_t *sq_array;
+	uint32_t sq_mask;
+
+	_Atomic uint32_t *cq_head;
+	_Atomic uint32_t *cq_tail;
+	struct io_uring_cqe *cqes;
+	uint32_t cq_mask;
+} Ring;
+
+#endif
+
+struct ChunkLoader {
+	int fd;
+	int64_t data_start;
+	uint8_t *body;
+
+	// Segments in chunk order, which is also the order that they are decoded in
+	Segment *segments;
+	uint64_t segment_count;
+	atomic_uint_fast64_t next_segment;
+
+	// Number of segments of each chunk that are still being read, guarded by the mutex along with failed
+	uint64_t *pending;
+	bool failed;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t segment_read;
+
+	pthread_t *threads;
+	uint32_t thread_count;
+
+#ifdef HAS_IO_URING
+	Ring ring;
+	bool has_ring;
+#endif
+};
+
+// Reads the rest of a segment, starting after the bytes that are already read
+static bool read_segment(ChunkLoader *loader, const Segment *segment, uint32_t done) {
+#ifdef DEBUG
+	// Checked before the loop so that segments that io_uring read in full fail as well
+	if (segment->offset + segment->size > failing_offset) {
+		return false;
+	}
+#endif
+
+	while (done < segment->size) {
+		ssize_t result = pread(
+			loader->fd,
+			loader->body + segment->offset + done,
+			limit_read_size(segment->size - done),
+			(off_t) (loader->data_start + (int64_t) (segment->offset + done))
+		);
+
+		if (result < 0 && errno == EINTR) {
+			continue;
+		} else if (result <= 0) {
+			return false;
+		}
+
+		done += (uint32_t) result;
+	}
+
+	return true;
+}
+
+static void finish_segment(ChunkLoader *loader, const Segment *segment, bool succeeded) {
+	pthread_mutex_lock(&loader->mutex);
+
+	if (succeeded) {
+		loader->pending[segment->chunk]--;
+	} else {
+		loader->failed = true;
+	}
+
+	pthread_cond_broadcast(&loader->segment_read);
+	pthread_mutex_unlock(&loader->mutex);
+}
+
+static void *run_read_thread(void *arg) {
+	ChunkLoader *loader = arg;
+
+	// Segments are claimed in order, so every thread works on the chunks that are decoded soonest
+	uint_fast64_t s;
+	while ((s = atomic_fetch_add(&loader->next_segment, 1)) < loader->segment_count) {
+		finish_segment(loader, &loader->segments[s], read_segment(loader, &loader->segments[s], 0));
+	}
+
+	return NULL;
+}
+
+#ifdef HAS_IO_URING
+
+static void close_ring(Ring *ring) {
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+
+	if (ring->sq_ring) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+
+	close(ring->fd);
+}
+
+static bool setup_ring(Ring *ring, uint32_t entries) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(Ring));
+
+	// Kernels without io_uring, or that forbid it, fail here and the loader uses pread instead
+	ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+
+	if (ring->fd < 0) {
+		return false;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// Newer kernels share one mapping between both rings
+	bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+
+	if (single_mapping) {
+		ring->sq_ring_size = ring->sq_ring_size > ring->cq_ring_size ? ring->sq_ring_size : ring->cq_ring_size;
+	}
+
+	void *sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+	ring->sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring;
+
+	void *cq_ring = single_mapping ? sq_ring : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+	ring->cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring;
+
+	void *sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+	ring->sqes = sqes == MAP_FAILED ? NULL : sqes;
+
+	if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+		close_ring(ring);
+		return false;
+	}
+
+	uint8_t *sq = ring->sq_ring;
+	uint8_t *cq = ring->cq_ring;
+
+	ring->sq_tail = (_Atomic uint32_t *) (sq + params.sq_off.tail);
+	ring->sq_array = (uint32_t *) (sq + params.sq_off.array);
+	ring->sq_mask = *(uint32_t *) (sq + params.sq_off.ring_mask);
+
+	ring->cq_head = (_Atomic uint32_t *) (cq + params.cq_off.head);
+	ring->cq_tail = (_Atomic uint32_t *) (cq + params.cq_off.tail);
+	ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	ring->cq_mask = *(uint32_t *) (cq + params.cq_off.ring_mask);
+
+	return true;
+}
+
+static void queue_segment(ChunkLoader *loader, uint64_t s) {
+	Ring *ring = &loader->ring;
+	const Segment *segment = &loader->segments[s];
+
+	uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+	uint32_t index = tail & ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = loader->fd;
+	sqe->addr = (uint64_t) (uintptr_t) (loader->body + segment->offset);
+	sqe->len = limit_read_size(segment->size);
+	sqe->off = (uint64_t) loader->data_start + segment->offset;
+	sqe->user_data = s;
+
+	ring->sq_array[index] = index;
+
+	// The kernel only reads the entry once it sees the new tail
+	atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+}
+
+// Handles every completed read, returning how many there were
+static uint32_t reap_segments(ChunkLoader *loader) {
+	Ring *ring = &loader->ring;
+
+	uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+	uint32_t reaped = tail - head;
+
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+		const Segment *segment = &loader->segments[cqe->user_data];
+
+		// Short or failed reads, including those of kernels without IORING_OP_READ, are finished with pread
+		uint32_t done = cqe->res > 0 ? (uint32_t) cqe->res : 0;
+		finish_segment(loader, segment, read_segment(loader, segment, done));
+	}
+
+	atomic_store_explicit(ring->cq_head, head, memory_order_release);
+	return reaped;
+}
+
+static void *run_ring_thread(void *arg) {
+	ChunkLoader *loader = arg;
+	Ring *ring = &loader->ring;
+
+	uint64_t next = 0;
+	uint32_t in_flight = 0, unsubmitted = 0;
+	bool submit_failed = false;
+
+	// Up to QUEUE_DEPTH segments are in flight at once, and each completion makes room for the next segment in order
+	while (true) {
+		for (; !submit_failed && next < loader->segment_count && in_flight < QUEUE_DEPTH; next++) {
+			queue_segment(loader, next);
+
+			in_flight++;
+			unsubmitted++;
+		}
+
+		if (in_flight == 0) {
+			break;
+		}
+
+		if (submit_failed) {
+			// Reads that were already submitted still write into the body, so they are waited for before it is released
+			syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		} else {
+			long submitted = syscall(__NR_io_uring_enter, ring->fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+			if (submitted >= 0) {
+				unsubmitted -= (uint32_t) submitted;
+			} else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+				submit_failed = true;
+				in_flight -= unsubmitted;
+				unsubmitted = 0;
+
+				pthread_mutex_lock(&loader->mutex);
+				loader->failed = true;
+				pthread_cond_broadcast(&loader->segment_read);
+				pthread_mutex_unlock(&loader->mutex);
+			}
+		}
+
+		in_flight -= reap_segments(loader);
+	}
+
+	return NULL;
+}
+
+#endif
+
+static void free_chunk_loader(ChunkLoader *loader) {
+#ifdef HAS_IO_URING
+	if (loader->has_ring) {
+		close_ring(&loader->ring);
+	}
+#endif
+
+	deallocate(loader->segments);
+	deallocate(loader->pending);
+	deallocate(loader->threads);
+	deallocate(loader);
+}
+
+JDXError start_chunk_loader(ChunkLoader **dest, FILE *file, int64_t data_start, const ChunkIndex *index, uint8_t *body) {
+	int fd = fileno(file);
+	struct stat file_stat;
+
+	// Only regular files can be read at any position, while pipes and memory streams have to be read in order
+	if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+		return JDXError_READ_FILE;
+	}
+
+	ChunkLoader *loader = allocate_zeroed(1, sizeof(ChunkLoader));
+
+	if (loader == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	loader->fd = fd;
+	loader->data_start = data_start;
+	loader->body = body;
+
+	uint64_t chunk_count = index->chunk_count;
+	uint64_t stream_count = get_stream_count(index);
+
+	for (uint64_t s = 0; s < stream_count; s++) {
+		loader->segment_count += (index->offsets[s + 1] - index->offsets[s] + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	}
+
+	loader->segments = allocate((size_t) loader->segment_count * sizeof(Segment));
+	loader->pending = allocate_zeroed((size_t) chunk_count, sizeof(uint64_t));
+	loader->threads = allocate(READ_THREAD_COUNT * sizeof(pthread_t));
+
+	if (loader->segments == NULL || loader->pending == NULL || loader->threads == NULL) {
+		free_chunk_loader(loader);
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	// Every stream of a chunk is read before the next chunk, since a chunk can only be decoded once all of them are in
+	uint64_t segment = 0;
+
+	for (uint64_t c = 0; c < chunk_count; c++) {
+		for (uint64_t stream = c; stream < stream_count; stream += chunk_count) {
+			for (uint64_t offset = index->offsets[stream]; offset < index->offsets[stream + 1]; offset += SEGMENT_SIZE) {
+				uint64_t remaining = index->offsets[stream + 1] - offset;
+
+				loader->segments[segment++] = (Segment) {
+					.offset = offset,
+					.size = (uint32_t) (remaining < SEGMENT_SIZE ? remaining : SEGMENT_SIZE),
+					.chunk = c
+				};
+
+				loader->pending[c]++;
+			}
+		}
+	}
+
+	atomic_init(&loader->next_segment, 0);
+	pthread_mutex_init(&loader->mutex, NULL);
+	pthread_cond_init(&loader->segment_read, NULL);
+
+#ifdef HAS_IO_URING
+	// A single thread keeps the ring full, and only if the ring or its thread cannot be set up are pread threads started
+	bool use_ring = loader->segment_count > 0;
+
+#ifdef DEBUG
+	use_ring = use_ring && !pread_forced;
+#endif
+
+	if (use_ring && (loader->has_ring = setup_ring(&loader->ring, QUEUE_DEPTH))) {
+		if (pthread_create(&loader->threads[0], NULL, run_ring_thread, loader) == 0) {
+			loader->thread_count = 1;
+		} else {
+			close_ring(&loader->ring);
+			loader->has_ring = false;
+		}
+	}
+
+	if (!loader->has_ring) {
+#endif
+		while (
+			loader->thread_count < READ_THREAD_COUNT &&
+			loader->thread_count < loader->segment_count &&
+			pthread_create(&loader->threads[loader->thread_count], NULL, run_read_thread, loader) == 0
+		) {
+			loader->thread_count++;
+		}
+#ifdef HAS_IO_URING
+	}
+#endif
+
+	if (loader->thread_count == 0 && loader->segment_count > 0) {
+		pthread_mutex_destroy(&loader->mutex);
+		pthread_cond_destroy(&loader->segment_read);
+		free_chunk_loader(loader);
+
+		return JDXError_READ_FILE;
+	}
+
+	*dest = loader;
+	return JDXError_NONE;
+}
+
+JDXError wait_for_chunk(ChunkLoader *loader, uint64_t chunk) {
+	pthread_mutex_lock(&loader->mutex);
+
+	while (loader->pending[chunk] > 0 && !loader->failed) {
+		pthread_cond_wait(&loader->segment_read, &loader->mutex);
+	}
+
+	JDXError error = loader->pending[chunk] > 0 ? JDXError_READ_FILE : JDXError_NONE;
+	pthread_mutex_unlock(&loader->mutex);
+
+	return error;
+}
+
+JDXError finish_chunk_loader(ChunkLoader *loader) {
+	for (uint32_t t = 0; t < loader->thread_count; t++) {
+		pthread_join(loader->threads[t], NULL);
+	}
+
+	JDXError error = loader->failed ? JDXError_READ_FILE : JDXError_NONE;
+
+	pthread_mutex_destroy(&loader->mutex);
+	pthread_cond_destroy(&loader->segment_read);
+	free_chunk_loader(loader);
+
+	return error;
+}
+
+#else
+
+// Without pread the body is read as a stream, which start_chunk_loader signals by failing
+JDXError start_chunk_loader(ChunkLoader **dest, FILE *file, int64_t data_start, const ChunkIndex *index, uint8_t *body) {
+	return JDXError_READ_FILE;
+}
+
+JDXError wait_for_chunk(ChunkLoader *loader, uint64_t chunk) {
+	return JDXError_READ_FILE;
+}
+
+JDXError finish_chunk_loader(ChunkLoader *loader) {
+	return JDXError_READ_FILE;
+}
+
+#ifdef DEBUG
+void force_pread_loader(bool force) {}
+void limit_loader_reads(uint32_t max_size) {}
+void fail_loader_reads_from(uint64_t offset) {}
+#endif
+
+#endif
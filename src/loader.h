@@ -0,0 +1,26 @@
+#pragma once
+
+#include "libjdx.h"
+#include "chunk.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Starts reading every stream of the chunk data at data_start into body, which must hold index->data_size bytes.
+// Fails before reading anything if the file cannot be read by position, in which case it is left to be read as a stream
+JDXError start_chunk_loader(ChunkLoader **dest, FILE *file, int64_t data_start, const ChunkIndex *index, uint8_t *body);
+
+// Blocks until every stream of the chunk is in the body, or until any read has failed
+JDXError wait_for_chunk(ChunkLoader *loader, uint64_t chunk);
+
+// Waits for every read to finish and frees the loader, returning JDXError_READ_FILE if any of them failed
+JDXError finish_chunk_loader(ChunkLoader *loader);
+
+#ifdef DEBUG
+// Test hooks that run the pread threads even where io_uring works, cut every read short at the given size, and fail
+// every read from the given offset of the chunk data on. Zero lifts the limit on reads, and UINT64_MAX the failure
+void force_pread_loader(bool force);
+void limit_loader_reads(uint32_t max_size);
+void fail_loader_reads_from(uint64_t offset);
+#endif
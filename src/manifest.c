@@ -0,0 +1,479 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trycatch.h"
+#include "libjdx.h"
+#include "parallel.h"
+#include "mapping.h"
+#include "dataset.h"
+#include "labels.h"
+#include "chunk.h"
+#include "stats.h"
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// First line of every manifest, followed by the version of the manifest format
+#define MANIFEST_MAGIC "jdx-manifest"
+#define MANIFEST_VERSION 1
+
+// Longest line accepted in a manifest, which bounds the length of shard paths
+#define MANIFEST_LINE_SIZE 4096
+
+typedef struct {
+	char *path;
+	JDXHeader *header;
+
+	// Number in the manifest of each label of the shard
+	JDXLabel *label_map;
+	uint64_t first_image;
+
+	// Stats of reading the shard, which are added to those of the whole manifest once every shard is read
+	JDXStats stats;
+
+	JDXError error;
+} Shard;
+
+typedef struct {
+	JDXHeader *header;
+	Shard *shards;
+	uint32_t shard_count;
+
+	// Threads of the whole read, which are split between shards when there are fewer shards than threads
+	uint32_t thread_count;
+
+	uint8_t *image_data;
+	JDXLabel *labels;
+
+	JDXStats *stats;
+} ManifestJob;
+
+static void free_shards(Shard *shards, uint32_t shard_count) {
+	if (shards == NULL) {
+		return;
+	}
+
+	for (uint32_t s = 0; s < shard_count; s++) {
+		deallocate(shards[s].path);
+		deallocate(shards[s].label_map);
+		JDX_FreeHeader(shards[s].header);
+	}
+
+	deallocate(shards);
+}
+
+// Relative shard paths are relative to the directory of the manifest rather than the working directory
+static char *resolve_shard_path(const char *manifest_path, const char *shard_path) {
+	const char *separator = strrchr(manifest_path, '/');
+	size_t directory_length = shard_path[0] != '/' && separator ? (size_t) (separator - manifest_path) + 1 : 0;
+	size_t shard_length = strlen(shard_path);
+
+	char *path = allocate(directory_length + shard_length + 1);
+
+	if (path) {
+		memcpy(path, manifest_path, directory_length);
+		memcpy(path + directory_length, shard_path, shard_length + 1);
+	}
+
+	return path;
+}
+
+static bool parse_number(uint16_t *dest, const char *value) {
+	char *end;
+	unsigned long number = strtoul(value, &end, 10);
+
+	if (end == value || *end != '\0' || number > UINT16_MAX) {
+		return false;
+	}
+
+	*dest = (uint16_t) number;
+	return true;
+}
+
+static JDXError parse_manifest(JDXHeader *header, Shard **shard_dest, uint32_t *shard_count_dest, const char *path) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	char **labels = NULL;
+	Shard *shards = NULL;
+	FILE *file = NULL;
+
+	uint32_t label_count = 0, label_capacity = 0;
+	uint32_t shard_count = 0, shard_capacity = 0;
+
+	char line[MANIFEST_LINE_SIZE];
+
+	TRY {
+		if ((file = fopen(path, "r")) == NULL) {
+			THROW(JDXError_OPEN_FILE);
+		}
+
+		int version;
+
+		if (
+			fgets(line, sizeof(line), file) == NULL ||
+			sscanf(line, MANIFEST_MAGIC " %d", &version) != 1 ||
+			version != MANIFEST_VERSION
+		) {
+			THROW(JDXError_CORRUPT_FILE);
+		}
+
+		while (fgets(line, sizeof(line), file)) {
+			size_t length = strcspn(line, "\r\n");
+
+			// A line without its newline is either the last line or longer than the buffer
+			if (line[length] == '\0' && !feof(file)) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+
+			line[length] = '\0';
+
+			if (length == 0 || line[0] == '#') {
+				continue;
+			}
+
+			// Each line is a key and a value separated by the first space, so labels and paths may contain spaces
+			char *value = strchr(line, ' ');
+
+			if (value == NULL) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+
+			*value++ = '\0';
+
+			if (strcmp(line, "width") == 0) {
+				if (!parse_number(&header->image_width, value)) {
+					THROW(JDXError_CORRUPT_FILE);
+				}
+			} else if (strcmp(line, "height") == 0) {
+				if (!parse_number(&header->image_height, value)) {
+					THROW(JDXError_CORRUPT_FILE);
+				}
+			} else if (strcmp(line, "bit_depth") == 0) {
+				uint16_t bit_depth;
+
+				if (!parse_number(&bit_depth, value) || (bit_depth != 8 && bit_depth != 24 && bit_depth != 32)) {
+					THROW(JDXError_CORRUPT_FILE);
+				}
+
+				header->bit_depth = (uint8_t) bit_depth;
+			} else if (strcmp(line, "label") == 0) {
+				if (label_count == UINT16_MAX || strlen(value) >= JDX_MAX_LABEL_LEN) {
+					THROW(JDXError_CORRUPT_FILE);
+				}
+
+				if (label_count == label_capacity) {
+					label_capacity = label_capacity ? label_capacity * 2 : 64;
+					char **resized = reallocate(labels, label_capacity * sizeof(char *));
+
+					if (resized == NULL) {
+						THROW(JDXError_MEMORY_FAILURE);
+					}
+
+					labels = resized;
+				}
+
+				if ((labels[label_count] = duplicate_string(value)) == NULL) {
+					THROW(JDXError_MEMORY_FAILURE);
+				}
+
+				label_count++;
+			} else if (strcmp(line, "shard") == 0) {
+				if (shard_count == shard_capacity) {
+					shard_capacity = shard_capacity ? shard_capacity * 2 : 64;
+					Shard *resized = reallocate(shards, shard_capacity * sizeof(Shard));
+
+					if (resized == NULL) {
+						THROW(JDXError_MEMORY_FAILURE);
+					}
+
+					shards = resized;
+				}
+
+				shards[shard_count] = (Shard) { .path = resolve_shard_path(path, value) };
+
+				if (shards[shard_count++].path == NULL) {
+					THROW(JDXError_MEMORY_FAILURE);
+				}
+			} else {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+		}
+
+		if (ferror(file) || header->bit_depth == 0) {
+			THROW(ferror(file) ? JDXError_READ_FILE : JDXError_CORRUPT_FILE);
+		}
+
+		JDXError arena_error = alloc_label_arena(&header->labels, labels, (uint16_t) label_count);
+
+		if (arena_error) {
+			THROW(arena_error);
+		}
+
+		header->label_count = (uint16_t) label_count;
+
+		// Shards look labels up concurrently, which is only safe once the table exists
+		JDXError table_error = build_label_table(header);
+
+		if (table_error) {
+			THROW(table_error);
+		}
+	} CATCH(error) {
+		if (file) {
+			fclose(file);
+		}
+
+		for (uint32_t l = 0; l < label_count; l++) {
+			deallocate(labels[l]);
+		}
+
+		deallocate(labels);
+		free_shards(shards, shard_count);
+
+		return error;
+	}
+
+	fclose(file);
+
+	for (uint32_t l = 0; l < label_count; l++) {
+		deallocate(labels[l]);
+	}
+
+	deallocate(labels);
+
+	*shard_dest = shards;
+	*shard_count_dest = shard_count;
+
+	return JDXError_NONE;
+}
+
+static JDXError check_shard_header(const JDXHeader *manifest_header, Shard *shard) {
+	const JDXHeader *header = shard->header;
+
+	if (header->image_width != manifest_header->image_width) {
+		return JDXError_UNEQUAL_WIDTHS;
+	} else if (header->image_height != manifest_header->image_height) {
+		return JDXError_UNEQUAL_HEIGHTS;
+	} else if (header->bit_depth != manifest_header->bit_depth) {
+		return JDXError_UNEQUAL_BIT_DEPTHS;
+	}
+
+	if ((shard->label_map = allocate((header->label_count > 0 ? header->label_count : 1) * sizeof(JDXLabel))) == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	// Every label of a shard must be in the unified label table of the manifest
+	for (uint16_t l = 0; l < header->label_count; l++) {
+		JDXError find_error = JDX_FindLabel(&shard->label_map[l], manifest_header, header->labels[l]);
+
+		if (find_error) {
+			return find_error;
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+static void read_shard_header_task(void *context, uint64_t s, uint32_t worker) {
+	ManifestJob *job = context;
+	Shard *shard = &job->shards[s];
+
+	if ((shard->header = JDX_AllocHeader()) == NULL) {
+		shard->error = JDXError_MEMORY_FAILURE;
+		return;
+	}
+
+	shard->error = JDX_ReadHeaderFromPath(shard->header, shard->path);
+
+	if (shard->error == JDXError_NONE) {
+		shard->error = check_shard_header(job->header, shard);
+	}
+}
+
+static void read_shard_body_task(void *context, uint64_t s, uint32_t worker) {
+	ManifestJob *job = context;
+	Shard *shard = &job->shards[s];
+
+	size_t image_size = JDX_GetImageSize(job->header);
+	uint8_t *image_data = job->image_data + image_size * (size_t) shard->first_image;
+	JDXLabel *labels = job->labels + shard->first_image;
+
+	FILE *file = fopen(shard->path, "rb");
+
+	if (file == NULL) {
+		shard->error = JDXError_OPEN_FILE;
+		return;
+	}
+
+	// The header is read again to reach the body, and must still describe the images counted before
+	JDXHeader *header = JDX_AllocHeader();
+	JDXError error = header ? JDX_ReadHeaderFromFile(header, file) : JDXError_MEMORY_FAILURE;
+
+	if (error == JDXError_NONE && header->image_count != shard->header->image_count) {
+		error = JDXError_CORRUPT_FILE;
+	}
+
+	// Each shard is decoded straight into its place in the dataset, so shards never need to be merged
+	uint32_t thread_count = (
+		job->shard_count < job->thread_count
+			? job->thread_count / job->shard_count + (s < job->thread_count % job->shard_count ? 1 : 0)
+			: 1
+	);
+
+	if (error == JDXError_NONE) {
+		error = read_body_into(image_data, labels, header, file, thread_count, job->stats ? &shard->stats : NULL, NULL);
+	}
+
+	for (uint64_t i = 0; error == JDXError_NONE && i < header->image_count; i++) {
+		if (labels[i] >= header->label_count) {
+			error = JDXError_CORRUPT_FILE;
+		} else {
+			labels[i] = shard->label_map[labels[i]];
+		}
+	}
+
+	JDX_FreeHeader(header);
+	fclose(file);
+
+	shard->error = error;
+}
+
+static JDXError get_shard_error(const ManifestJob *job) {
+	for (uint32_t s = 0; s < job->shard_count; s++) {
+		if (job->shards[s].error) {
+			return job->shards[s].error;
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_ReadDatasetFromManifest(JDXDataset *dest, const char *path, const JDXReadOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	ManifestJob job = { .header = NULL };
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_READ_OPTIONS;
+	}
+
+	JDXStats call_stats;
+	job.stats = begin_stats(&call_stats, options->stats);
+
+	TRY {
+		if ((job.header = JDX_AllocHeader()) == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		JDXError parse_error = parse_manifest(job.header, &job.shards, &job.shard_count, path);
+
+		if (parse_error) {
+			THROW(parse_error);
+		}
+
+		job.thread_count = resolve_thread_count(options->thread_count);
+		parallel_for(job.shard_count, job.thread_count, read_shard_header_task, &job);
+
+		JDXError header_error = get_shard_error(&job);
+
+		if (header_error) {
+			THROW(header_error);
+		}
+
+		for (uint32_t s = 0; s < job.shard_count; s++) {
+			job.shards[s].first_image = job.header->image_count;
+			job.header->image_count += job.shards[s].header->image_count;
+		}
+
+		size_t image_size = JDX_GetImageSize(job.header);
+		uint64_t start = get_stats_clock(job.stats);
+
+		job.image_data = allocate(job.header->image_count > 0 ? image_size * (size_t) job.header->image_count : 1);
+		job.labels = allocate(job.header->image_count > 0 ? sizeof(JDXLabel) * (size_t) job.header->image_count : 1);
+
+		add_phase_time(job.stats, JDXPhase_ALLOCATE, start);
+		add_allocation(job.stats, image_size * (size_t) job.header->image_count);
+		add_allocation(job.stats, sizeof(JDXLabel) * (size_t) job.header->image_count);
+
+		if (job.image_data == NULL || job.labels == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		parallel_for(job.shard_count, job.thread_count, read_shard_body_task, &job);
+
+		JDXError body_error = get_shard_error(&job);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+	} CATCH(error) {
+		free_shards(job.shards, job.shard_count);
+		deallocate(job.image_data);
+		deallocate(job.labels);
+		JDX_FreeHeader(job.header);
+
+		return error;
+	}
+
+	for (uint32_t s = 0; job.stats && s < job.shard_count; s++) {
+		merge_stats(job.stats, &job.shards[s].stats);
+	}
+
+	end_stats(job.stats, options->stats, "read");
+
+	free_shards(job.shards, job.shard_count);
+	job.header->version = JDX_VERSION;
+
+	release_dataset_contents(dest);
+
+	dest->header = job.header;
+	dest->_raw_image_data = job.image_data;
+	dest->_raw_labels = job.labels;
+
+	return JDXError_NONE;
+}
+
+// Values end at the end of their line and must fit in it, so values that the parser would not read back are rejected
+static bool is_line_value(const char *key, const char *value) {
+	return strpbrk(value, "\r\n") == NULL && strlen(key) + strlen(value) + 2 < MANIFEST_LINE_SIZE;
+}
+
+JDXError JDX_WriteManifestToPath(const JDXHeader *header, const char *const *shard_paths, uint32_t shard_count, const char *path) {
+	// Everything is checked before the file is opened, so that a rejected manifest leaves nothing behind
+	for (uint16_t l = 0; l < header->label_count; l++) {
+		if (!is_line_value("label", header->labels[l])) {
+			return JDXError_OUT_OF_BOUNDS;
+		}
+	}
+
+	for (uint32_t s = 0; s < shard_count; s++) {
+		if (!is_line_value("shard", shard_paths[s])) {
+			return JDXError_OUT_OF_BOUNDS;
+		}
+	}
+
+	FILE *file = fopen(path, "w");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	bool write_failed = (
+		fprintf(file, MANIFEST_MAGIC " %d\n", MANIFEST_VERSION) < 0 ||
+		fprintf(file, "width %u\nheight %u\nbit_depth %u\n", header->image_width, header->image_height, header->bit_depth) < 0
+	);
+
+	for (uint16_t l = 0; l < header->label_count && !write_failed; l++) {
+		write_failed = fprintf(file, "label %s\n", header->labels[l]) < 0;
+	}
+
+	for (uint32_t s = 0; s < shard_count && !write_failed; s++) {
+		write_failed = fprintf(file, "shard %s\n", shard_paths[s]) < 0;
+	}
+
+	if (fclose(file) == EOF) {
+		return JDXError_CLOSE_FILE;
+	}
+
+	return write_failed ? JDXError_WRITE_FILE : JDXError_NONE;
+}
@@ -0,0 +1,250 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#include "trycatch.h"
+#include "libjdx.h"
+#include "mapping.h"
+#include "dataset.h"
+#include "chunk.h"
+#include "leio.h"
+#include "stats.h"
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct JDXMapping {
+	void *address;
+	size_t size;
+};
+
+void release_image_data(JDXDataset *dataset) {
+	if (dataset->_mapping) {
+		munmap(dataset->_mapping->address, dataset->_mapping->size);
+		deallocate(dataset->_mapping);
+	} else {
+		deallocate(dataset->_raw_image_data);
+	}
+
+	dataset->_raw_image_data = NULL;
+	dataset->_mapping = NULL;
+}
+
+JDXError detach_image_data(JDXDataset *dataset) {
+	if (dataset->_mapping == NULL) {
+		return JDXError_NONE;
+	}
+
+	size_t image_block_size = JDX_GetImageSize(dataset->header) * (size_t) dataset->header->image_count;
+	uint8_t *image_data = allocate(image_block_size);
+
+	if (image_data == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	memcpy(image_data, dataset->_raw_image_data, image_block_size);
+	release_image_data(dataset);
+
+	dataset->_raw_image_data = image_data;
+	return JDXError_NONE;
+}
+
+// Stored and unfiltered pixel streams that hold exactly their images are contiguous, so they can be used in place
+static bool can_alias_images(const ChunkIndex *index, const JDXHeader *header) {
+	if (index->codec != JDXCodec_STORED || index->filters || index->interleaved || header->image_count == 0) {
+		return false;
+	}
+
+	size_t image_size = JDX_GetImageSize(header);
+
+	for (uint64_t c = 0; c < index->chunk_count; c++) {
+		uint64_t stream_size = index->offsets[c + 1] - index->offsets[c];
+
+		if (stream_size != image_size * get_images_in_chunk(index, header, c)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int get_posix_advice(JDXMapAdvice advice) {
+	switch (advice) {
+		case JDXMapAdvice_SEQUENTIAL: return POSIX_MADV_SEQUENTIAL;
+		case JDXMapAdvice_RANDOM: return POSIX_MADV_RANDOM;
+		case JDXMapAdvice_WILL_NEED: return POSIX_MADV_WILLNEED;
+		default: return POSIX_MADV_NORMAL;
+	}
+}
+
+JDXError JDX_MapDatasetFromPath(JDXDataset *dest, const char *path, const JDXReadOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	ChunkIndex chunk_index = { .offsets = NULL };
+	struct JDXMapping *dataset_mapping = NULL;
+	uint8_t *raw_image_data = NULL;
+	uint16_t *raw_labels = NULL;
+	JDXHeader *header = NULL;
+	FILE *stream = NULL;
+
+	uint8_t *mapping = MAP_FAILED;
+	size_t mapping_size = 0;
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_READ_OPTIONS;
+	}
+
+	// Mapped pages are read by the kernel as they are touched, so no bytes are counted as read
+	JDXStats call_stats;
+	JDXStats *stats = begin_stats(&call_stats, options->stats);
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return JDXError_OPEN_FILE;
+	}
+
+	TRY {
+		struct stat file_stat;
+
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		mapping_size = (size_t) file_stat.st_size;
+		mapping = mmap(NULL, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (mapping == MAP_FAILED) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		// The advice is only a hint, so a kernel that ignores it is not an error
+		posix_madvise(mapping, mapping_size, get_posix_advice(options->map_advice));
+
+		// Only the header and offset table are parsed through a stream, while chunks are decoded straight from the mapping
+		if ((stream = fmemopen(mapping, mapping_size, "rb")) == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		header = JDX_AllocHeader();
+		JDXError header_error = JDX_ReadHeaderFromFile(header, stream);
+
+		if (header_error) {
+			THROW(header_error);
+		}
+
+		JDXError body_error = read_body_descriptor(&chunk_index, header, stream);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+
+		int64_t data_start = ftell_64(stream);
+
+		if (data_start < 0) {
+			THROW(JDXError_READ_FILE);
+		} else if (chunk_index.data_size > mapping_size - (size_t) data_start) {
+			THROW(JDXError_CORRUPT_FILE);
+		}
+
+		if (fseek_64(stream, data_start + (int64_t) chunk_index.data_size, SEEK_SET) != 0) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		JDXError offsets_error = read_chunk_offsets(&chunk_index, stream);
+
+		if (offsets_error) {
+			THROW(offsets_error);
+		}
+
+		// Aliased pixels keep the mapping alive for as long as the dataset, so only the labels are decoded
+		bool alias_images = can_alias_images(&chunk_index, header);
+
+		JDXError decode_error = decode_body(
+			alias_images ? NULL : &raw_image_data,
+			&raw_labels,
+			&chunk_index,
+			header,
+			mapping + data_start,
+			options->thread_count,
+			stats,
+			options->context
+		);
+
+		if (decode_error) {
+			THROW(decode_error);
+		}
+
+		if (alias_images) {
+			if ((dataset_mapping = allocate(sizeof(struct JDXMapping))) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+
+			dataset_mapping->address = mapping;
+			dataset_mapping->size = mapping_size;
+			raw_image_data = mapping + data_start;
+		}
+	} CATCH(error) {
+		if (stream) {
+			fclose(stream);
+		}
+
+		if (mapping != MAP_FAILED) {
+			munmap(mapping, mapping_size);
+		}
+
+		close(fd);
+		free_chunk_index(&chunk_index);
+		deallocate(raw_labels);
+		JDX_FreeHeader(header);
+
+		return error;
+	}
+
+	// The mapping stays valid after its file is closed
+	fclose(stream);
+	close(fd);
+	free_chunk_index(&chunk_index);
+
+	if (dataset_mapping == NULL) {
+		munmap(mapping, mapping_size);
+	}
+
+	end_stats(stats, options->stats, "read");
+
+	release_dataset_contents(dest);
+
+	dest->header = header;
+	dest->_raw_image_data = raw_image_data;
+	dest->_raw_labels = raw_labels;
+	dest->_mapping = dataset_mapping;
+
+	return JDXError_NONE;
+}
+
+#else
+
+void release_image_data(JDXDataset *dataset) {
+	deallocate(dataset->_raw_image_data);
+	dataset->_raw_image_data = NULL;
+}
+
+JDXError detach_image_data(JDXDataset *dataset) {
+	return JDXError_NONE;
+}
+
+// Without mmap the file is read through a stream instead, which loads exactly the same dataset
+JDXError JDX_MapDatasetFromPath(JDXDataset *dest, const char *path, const JDXReadOptions *options) {
+	return JDX_ReadDatasetFromPathWithOptions(dest, path, options);
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "libjdx.h"
+
+// Frees the image data of a dataset, or unmaps the file that it points into
+void release_image_data(JDXDataset *dataset);
+
+// Copies image data that points into a mapped file into owned memory, so that it can be modified
+JDXError detach_image_data(JDXDataset *dataset);
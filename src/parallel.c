@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include "allocator.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+	ParallelTask task;
+	void *context;
+
+	uint64_t count;
+	atomic_uint_fast64_t next_index;
+} ParallelJob;
+
+typedef struct {
+	ParallelJob *job;
+	uint32_t worker;
+} ParallelWorker;
+
+static void *run_worker(void *arg) {
+	ParallelWorker *worker = arg;
+	ParallelJob *job = worker->job;
+
+	// Indices are claimed one at a time so that uneven tasks still balance across workers
+	uint_fast64_t index;
+	while ((index = atomic_fetch_add(&job->next_index, 1)) < job->count) {
+		job->task(job->context, index, worker->worker);
+	}
+
+	return NULL;
+}
+
+uint32_t resolve_thread_count(uint32_t requested) {
+	if (requested > 0) {
+		return requested;
+	}
+
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	return online > 0 ? (uint32_t) online : 1;
+}
+
+void parallel_for(uint64_t count, uint32_t thread_count, ParallelTask task, void *context) {
+	if (thread_count > count) {
+		thread_count = (uint32_t) count;
+	}
+
+	ParallelJob job = { .task = task, .context = context, .count = count };
+	atomic_init(&job.next_index, 0);
+
+	pthread_t *threads = NULL;
+	ParallelWorker *workers = NULL;
+	uint32_t spawned = 0;
+
+	if (thread_count > 1) {
+		threads = allocate((thread_count - 1) * sizeof(pthread_t));
+		workers = allocate(thread_count * sizeof(ParallelWorker));
+	}
+
+	// If threads cannot be allocated or created, the remaining work simply falls to the calling thread
+	if (threads && workers) {
+		for (uint32_t t = 1; t < thread_count; t++) {
+			workers[t] = (ParallelWorker) { .job = &job, .worker = t };
+
+			if (pthread_create(&threads[spawned], NULL, run_worker, &workers[t]) != 0) {
+				break;
+			}
+
+			spawned++;
+		}
+	}
+
+	ParallelWorker caller = { .job = &job, .worker = 0 };
+	run_worker(&caller);
+
+	for (uint32_t t = 0; t < spawned; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	deallocate(threads);
+	deallocate(workers);
+}
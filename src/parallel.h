@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// Work run by parallel_for, called once per index along with the number of the worker running it
+typedef void (*ParallelTask)(void *context, uint64_t index, uint32_t worker);
+
+uint32_t resolve_thread_count(uint32_t requested);
+
+// Runs task for every index in [0, count) on up to thread_count workers, including the calling thread
+void parallel_for(uint64_t count, uint32_t thread_count, ParallelTask task, void *context);
@@ -0,0 +1,447 @@
+#include "trycatch.h"
+#include "libjdx.h"
+#include "chunk.h"
+#include "filter.h"
+#include "leio.h"
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libdeflate.h>
+
+// Sentinel for a reader that has not decompressed any chunk yet
+#define NO_CHUNK UINT64_MAX
+
+struct JDXReaderState {
+	FILE *file;
+	bool owns_file;
+
+	int64_t data_start;
+	ChunkIndex index;
+
+	// Window holding exactly one chunk, which is the only part of the body in memory at a time
+	struct libdeflate_decompressor *decompressor;
+	uint64_t loaded_chunk;
+	uint8_t *compressed_chunk;
+	size_t compressed_capacity;
+	uint8_t *decompressed_chunk;
+	JDXLabel *chunk_labels;
+
+	// Only allocated for bodies before 0.5, whose images and labels share a stream
+	uint8_t *interleaved_chunk;
+
+	// Only allocated for bodies with split channels, which are put back together one image at a time
+	uint8_t *filter_scratch;
+
+	// Only allocated for deduplicated bodies, whose images can refer to images in other chunks. Those are taken from a
+	// second window, which holds the stored images of the chunk that was last referred to
+	uint64_t *chunk_references;
+	uint64_t source_chunk;
+	uint8_t *source_images;
+	uint64_t *source_references;
+};
+
+static void free_reader_state(struct JDXReaderState *state) {
+	if (state == NULL) {
+		return;
+	}
+
+	libdeflate_free_decompressor(state->decompressor);
+	free_chunk_index(&state->index);
+	deallocate(state->compressed_chunk);
+	deallocate(state->filter_scratch);
+	deallocate(state->decompressed_chunk);
+	deallocate(state->chunk_labels);
+	deallocate(state->interleaved_chunk);
+	deallocate(state->chunk_references);
+	deallocate(state->source_images);
+	deallocate(state->source_references);
+	deallocate(state);
+}
+
+static JDXError read_stream(JDXReader *reader, uint64_t stream, uint8_t *dest, size_t dest_size) {
+	struct JDXReaderState *state = reader->_state;
+	uint64_t stream_start, stream_end;
+
+	// Offsets are read two at a time straight from the table rather than kept in memory for the whole body
+	if (state->index.offsets) {
+		stream_start = state->index.offsets[stream];
+		stream_end = state->index.offsets[stream + 1];
+	} else if (
+		fseek_64(state->file, state->data_start + (int64_t) (state->index.data_size + stream * sizeof(uint64_t)), SEEK_SET) != 0 ||
+		fread_le(&stream_start, sizeof(stream_start), state->file) == EOF ||
+		fread_le(&stream_end, sizeof(stream_end), state->file) == EOF
+	) {
+		return JDXError_READ_FILE;
+	}
+
+	if (stream_end < stream_start || stream_end > state->index.data_size) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	// Checksums follow the offset table and are read one at a time in the same way
+	uint32_t checksum = 0;
+	int64_t checksum_position = state->data_start + (int64_t) (
+		state->index.data_size +
+		(get_stream_count(&state->index) + 1) * sizeof(uint64_t) +
+		stream * sizeof(uint32_t)
+	);
+
+	if (
+		state->index.checksummed && (
+			fseek_64(state->file, checksum_position, SEEK_SET) != 0 ||
+			fread_le(&checksum, sizeof(checksum), state->file) == EOF
+		)
+	) {
+		return JDXError_READ_FILE;
+	}
+
+	size_t compressed_size = (size_t) (stream_end - stream_start);
+
+	if (compressed_size > state->compressed_capacity) {
+		uint8_t *compressed_chunk = reallocate(state->compressed_chunk, compressed_size);
+
+		if (compressed_chunk == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+
+		state->compressed_chunk = compressed_chunk;
+		state->compressed_capacity = compressed_size;
+	}
+
+	if (
+		fseek_64(state->file, state->data_start + (int64_t) stream_start, SEEK_SET) != 0 ||
+		fread(state->compressed_chunk, 1, compressed_size, state->file) != compressed_size
+	) {
+		return JDXError_READ_FILE;
+	}
+
+	if (state->index.checksummed && libdeflate_crc32(0, state->compressed_chunk, compressed_size) != checksum) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	return decode_chunk(
+		state->decompressor, state->index.codec,
+		state->compressed_chunk, compressed_size,
+		dest, dest_size
+	);
+}
+
+// Decodes the stored images of a chunk into images, in the places that the references of the chunk give them
+static JDXError load_stored_images(JDXReader *reader, uint64_t chunk, uint8_t *images, uint64_t *references) {
+	struct JDXReaderState *state = reader->_state;
+
+	size_t image_size = JDX_GetImageSize(reader->header);
+	uint64_t chunk_images = get_images_in_chunk(&state->index, reader->header, chunk);
+	uint64_t stored_images = chunk_images;
+
+	if (state->index.deduplicated) {
+		JDXError reference_error = read_stream(
+			reader, 2 * state->index.chunk_count + chunk,
+			(uint8_t *) references,
+			sizeof(uint64_t) * (size_t) chunk_images
+		);
+
+		if (reference_error) {
+			return reference_error;
+		}
+
+		stored_images = count_stored_images(references, chunk_images);
+	}
+
+	JDXError image_error = read_stream(reader, chunk, images, image_size * (size_t) stored_images);
+
+	if (image_error) {
+		return image_error;
+	}
+
+	if (state->index.filters) {
+		reverse_filters(images, state->filter_scratch, reader->header, state->index.filters, stored_images);
+	}
+
+	if (state->index.deduplicated) {
+		place_stored_images(images, references, image_size, chunk_images);
+	}
+
+	return JDXError_NONE;
+}
+
+// Fills the images of the loaded chunk that refer to another image, which may be in an earlier chunk
+static JDXError copy_referenced_images(JDXReader *reader, uint64_t chunk) {
+	struct JDXReaderState *state = reader->_state;
+
+	size_t image_size = JDX_GetImageSize(reader->header);
+	uint64_t chunk_image_count = state->index.chunk_image_count;
+	uint64_t first_image = chunk * chunk_image_count;
+	uint64_t chunk_images = get_images_in_chunk(&state->index, reader->header, chunk);
+
+	for (uint64_t i = 0; i < chunk_images; i++) {
+		uint64_t reference = state->chunk_references[i];
+
+		if (reference == 0) {
+			continue;
+		} else if (reference > first_image + i) {
+			return JDXError_CORRUPT_FILE;
+		}
+
+		uint64_t source = first_image + i - reference;
+		const uint8_t *source_image;
+		uint64_t source_reference;
+
+		if (source >= first_image) {
+			source_image = state->decompressed_chunk + image_size * (size_t) (source - first_image);
+			source_reference = state->chunk_references[source - first_image];
+		} else {
+			uint64_t source_chunk = source / chunk_image_count;
+
+			if (state->source_images == NULL) {
+				state->source_images = allocate(image_size * (size_t) chunk_image_count);
+				state->source_references = allocate(sizeof(uint64_t) * (size_t) chunk_image_count);
+
+				if (state->source_images == NULL || state->source_references == NULL) {
+					return JDXError_MEMORY_FAILURE;
+				}
+			}
+
+			if (source_chunk != state->source_chunk) {
+				state->source_chunk = NO_CHUNK;
+
+				JDXError source_error = load_stored_images(reader, source_chunk, state->source_images, state->source_references);
+
+				if (source_error) {
+					return source_error;
+				}
+
+				state->source_chunk = source_chunk;
+			}
+
+			source_image = state->source_images + image_size * (size_t) (source % chunk_image_count);
+			source_reference = state->source_references[source % chunk_image_count];
+		}
+
+		// References lead straight to a stored image, never to another reference
+		if (source_reference != 0) {
+			return JDXError_CORRUPT_FILE;
+		}
+
+		memcpy(state->decompressed_chunk + image_size * (size_t) i, source_image, image_size);
+	}
+
+	return JDXError_NONE;
+}
+
+static JDXError load_chunk(JDXReader *reader, uint64_t chunk) {
+	struct JDXReaderState *state = reader->_state;
+
+	size_t image_size = JDX_GetImageSize(reader->header);
+	uint64_t chunk_images = get_images_in_chunk(&state->index, reader->header, chunk);
+
+	// Invalidate the window first so that a failed decompression is never mistaken for a loaded chunk
+	state->loaded_chunk = NO_CHUNK;
+
+	if (state->index.interleaved) {
+		JDXError read_error = read_stream(
+			reader, chunk,
+			state->interleaved_chunk,
+			(image_size + sizeof(JDXLabel)) * (size_t) chunk_images
+		);
+
+		if (read_error) {
+			return read_error;
+		}
+
+		deinterleave_chunk(state->decompressed_chunk, state->chunk_labels, state->interleaved_chunk, image_size, chunk_images);
+	} else {
+		JDXError image_error = load_stored_images(reader, chunk, state->decompressed_chunk, state->chunk_references);
+
+		if (image_error) {
+			return image_error;
+		}
+
+		JDXError label_error = read_stream(
+			reader, state->index.chunk_count + chunk,
+			(uint8_t *) state->chunk_labels,
+			sizeof(JDXLabel) * (size_t) chunk_images
+		);
+
+		if (label_error) {
+			return label_error;
+		}
+
+		if (state->index.deduplicated) {
+			JDXError reference_error = copy_referenced_images(reader, chunk);
+
+			if (reference_error) {
+				return reference_error;
+			}
+		}
+	}
+
+	state->loaded_chunk = chunk;
+	return JDXError_NONE;
+}
+
+JDXError JDX_OpenReaderFromFile(JDXReader **dest, FILE *file) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	struct JDXReaderState *state = NULL;
+	JDXHeader *header = NULL;
+	JDXReader *reader = NULL;
+
+	TRY {
+		header = JDX_AllocHeader();
+		JDXError header_error = JDX_ReadHeaderFromFile(header, file);
+
+		if (header_error) {
+			THROW(header_error);
+		}
+
+		state = allocate_zeroed(1, sizeof(struct JDXReaderState));
+		reader = allocate_zeroed(1, sizeof(JDXReader));
+
+		if (state == NULL || reader == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		state->file = file;
+		state->loaded_chunk = NO_CHUNK;
+
+		JDXError body_error = read_body_descriptor(&state->index, header, file);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+
+		if ((state->data_start = ftell_64(file)) < 0) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		size_t image_size = JDX_GetImageSize(header);
+		size_t max_chunk_images = (size_t) get_images_in_chunk(&state->index, header, 0);
+
+		state->decompressor = libdeflate_alloc_decompressor();
+		state->decompressed_chunk = allocate(max_chunk_images > 0 ? image_size * max_chunk_images : 1);
+		state->chunk_labels = allocate(max_chunk_images > 0 ? sizeof(JDXLabel) * max_chunk_images : 1);
+
+		if (state->decompressor == NULL || state->decompressed_chunk == NULL || state->chunk_labels == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		if (state->index.interleaved) {
+			state->interleaved_chunk = allocate(max_chunk_images > 0 ? (image_size + sizeof(JDXLabel)) * max_chunk_images : 1);
+
+			if (state->interleaved_chunk == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+		}
+
+		if (state->index.filters & FILTER_SPLIT_CHANNELS) {
+			if ((state->filter_scratch = allocate(image_size > 0 ? image_size : 1)) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+		}
+
+		if (state->index.deduplicated) {
+			state->source_chunk = NO_CHUNK;
+
+			if ((state->chunk_references = allocate(max_chunk_images > 0 ? sizeof(uint64_t) * max_chunk_images : 1)) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+		}
+	} CATCH(error) {
+		free_reader_state(state);
+		JDX_FreeHeader(header);
+		deallocate(reader);
+
+		return error;
+	}
+
+	reader->header = header;
+	reader->position = 0;
+	reader->_state = state;
+
+	*dest = reader;
+	return JDXError_NONE;
+}
+
+JDXError JDX_OpenReaderFromPath(JDXReader **dest, const char *path) {
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	JDXError error = JDX_OpenReaderFromFile(dest, file);
+
+	if (error) {
+		fclose(file);
+		return error;
+	}
+
+	(*dest)->_state->owns_file = true;
+	return JDXError_NONE;
+}
+
+JDXError JDX_ReadNextImage(JDXReader *reader, JDXImageView *dest) {
+	struct JDXReaderState *state = reader->_state;
+
+	if (reader->position >= reader->header->image_count) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	uint64_t chunk = reader->position / state->index.chunk_image_count;
+
+	if (chunk != state->loaded_chunk) {
+		JDXError load_error = load_chunk(reader, chunk);
+
+		if (load_error) {
+			return load_error;
+		}
+	}
+
+	uint64_t chunk_position = reader->position % state->index.chunk_image_count;
+	JDXLabel label = state->chunk_labels[chunk_position];
+
+	if (label >= reader->header->label_count) {
+		return JDXError_CORRUPT_FILE;
+	}
+
+	dest->raw_data = state->decompressed_chunk + JDX_GetImageSize(reader->header) * (size_t) chunk_position;
+	dest->width = reader->header->image_width;
+	dest->height = reader->header->image_height;
+	dest->bit_depth = reader->header->bit_depth;
+	dest->label_str = reader->header->labels[label];
+	dest->label_num = label;
+
+	reader->position++;
+	return JDXError_NONE;
+}
+
+JDXError JDX_SeekReader(JDXReader *reader, uint64_t index) {
+	// Seeking to image_count is allowed and leaves the reader at the end of the dataset
+	if (index > reader->header->image_count) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	reader->position = index;
+	return JDXError_NONE;
+}
+
+JDXError JDX_CloseReader(JDXReader *reader) {
+	if (reader == NULL) {
+		return JDXError_NONE;
+	}
+
+	JDXError error = JDXError_NONE;
+
+	if (reader->_state->owns_file && fclose(reader->_state->file) == EOF) {
+		error = JDXError_CLOSE_FILE;
+	}
+
+	free_reader_state(reader->_state);
+	JDX_FreeHeader(reader->header);
+	deallocate(reader);
+
+	return error;
+}
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// The callback is read at the start of every instrumented call, so it should be set before any of them run
+static JDXStatsCallback stats_callback = NULL;
+static void *stats_user_data = NULL;
+
+void JDX_SetStatsCallback(JDXStatsCallback callback, void *user_data) {
+	stats_callback = callback;
+	stats_user_data = user_data;
+}
+
+uint64_t get_stats_clock(const JDXStats *stats) {
+	if (stats == NULL) {
+		return 0;
+	}
+
+	struct timespec time;
+
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &time);
+#else
+	timespec_get(&time, TIME_UTC);
+#endif
+
+	return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
+
+void add_phase_time(JDXStats *stats, JDXPhase phase, uint64_t start) {
+	if (stats) {
+		stats->phase_ns[phase] += get_stats_clock(stats) - start;
+	}
+}
+
+void add_allocation(JDXStats *stats, size_t size) {
+	if (stats) {
+		stats->allocated_bytes += size;
+		stats->allocation_count++;
+	}
+}
+
+void add_codec_bytes(JDXStats *stats, uint64_t compressed_size, uint64_t uncompressed_size) {
+	if (stats) {
+		stats->compressed_bytes += compressed_size;
+		stats->uncompressed_bytes += uncompressed_size;
+	}
+}
+
+void merge_stats(JDXStats *dest, const JDXStats *src) {
+	dest->bytes_read += src->bytes_read;
+	dest->bytes_written += src->bytes_written;
+	dest->compressed_bytes += src->compressed_bytes;
+	dest->uncompressed_bytes += src->uncompressed_bytes;
+	dest->allocated_bytes += src->allocated_bytes;
+	dest->allocation_count += src->allocation_count;
+	dest->duplicate_images += src->duplicate_images;
+
+	for (int p = 0; p < JDXPhase_COUNT; p++) {
+		dest->phase_ns[p] += src->phase_ns[p];
+	}
+}
+
+JDXStats *begin_stats(JDXStats *call_stats, const JDXStats *options_stats) {
+	if (options_stats == NULL && stats_callback == NULL) {
+		return NULL;
+	}
+
+	memset(call_stats, 0, sizeof(JDXStats));
+	return call_stats;
+}
+
+void end_stats(JDXStats *call_stats, JDXStats *options_stats, const char *operation) {
+	if (call_stats == NULL) {
+		return;
+	}
+
+	if (options_stats) {
+		merge_stats(options_stats, call_stats);
+	}
+
+	if (stats_callback) {
+		stats_callback(operation, call_stats, stats_user_data);
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Every helper accepts NULL stats and then does nothing, so calls that gather no stats never read the clock
+uint64_t get_stats_clock(const JDXStats *stats);
+void add_phase_time(JDXStats *stats, JDXPhase phase, uint64_t start);
+
+void add_allocation(JDXStats *stats, size_t size);
+void add_codec_bytes(JDXStats *stats, uint64_t compressed_size, uint64_t uncompressed_size);
+void merge_stats(JDXStats *dest, const JDXStats *src);
+
+// Clears and returns the stats of a call if either the options or a callback want them, or returns NULL otherwise
+JDXStats *begin_stats(JDXStats *call_stats, const JDXStats *options_stats);
+
+// Adds the stats of a call to the stats of its options and hands them to the callback
+void end_stats(JDXStats *call_stats, JDXStats *options_stats, const char *operation);
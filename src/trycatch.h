@@ -4,12 +4,12 @@
   int _error = 0; \
   if (1)
 
+// The label must come before the declaration of 'e' so that THROW does not jump past its initialization
 #define CATCH(e) \
+	_catch: ; \
   int e = _error; \
-	_catch: \
     if (_error)
 
 #define THROW(e) \
   _error = e; \
   goto _catch
-
@@ -0,0 +1,182 @@
+#include "trycatch.h"
+#include "libjdx.h"
+#include "parallel.h"
+#include "chunk.h"
+#include "leio.h"
+#include "allocator.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Streams are read in blocks of about this size, and the streams within each block are checked concurrently
+#define VERIFY_BLOCK_SIZE (64 << 20)
+
+typedef struct {
+	const ChunkIndex *index;
+
+	// Block of consecutive streams, starting at block_start within the chunk data
+	const uint8_t *block;
+	uint64_t block_start;
+	uint64_t first_stream;
+
+	atomic_bool corrupt;
+} VerificationJob;
+
+static void verify_stream_task(void *context, uint64_t index, uint32_t worker) {
+	VerificationJob *job = context;
+
+	uint64_t stream = job->first_stream + index;
+	uint64_t stream_start = job->index->offsets[stream];
+	size_t stream_size = (size_t) (job->index->offsets[stream + 1] - stream_start);
+
+	if (!is_stream_intact(job->index, stream, job->block + (stream_start - job->block_start), stream_size)) {
+		atomic_store(&job->corrupt, true);
+	}
+}
+
+// Bodies without checksums can only be checked by decoding them, which needs the whole dataset in memory
+static JDXError verify_by_decoding(FILE *file, const JDXReadOptions *options) {
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	if (dataset == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	JDXError read_error = (
+		fseek_64(file, 0, SEEK_SET) != 0
+			? JDXError_READ_FILE
+			: JDX_ReadDatasetFromFileWithOptions(dataset, file, options)
+	);
+
+	JDX_FreeDataset(dataset);
+	return read_error;
+}
+
+JDXError JDX_VerifyFile(FILE *file) {
+	return JDX_VerifyFileWithOptions(file, &JDX_DEFAULT_READ_OPTIONS);
+}
+
+JDXError JDX_VerifyFileWithOptions(FILE *file, const JDXReadOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	ChunkIndex chunk_index = { .offsets = NULL };
+	uint8_t *block = NULL;
+	JDXHeader *header = NULL;
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_READ_OPTIONS;
+	}
+
+	TRY {
+		header = JDX_AllocHeader();
+		JDXError header_error = header ? JDX_ReadHeaderFromFile(header, file) : JDXError_MEMORY_FAILURE;
+		JDXError body_error = header_error ? header_error : read_body_descriptor(&chunk_index, header, file);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+
+		if (!chunk_index.checksummed) {
+			JDXError decode_error = verify_by_decoding(file, options);
+
+			if (decode_error) {
+				THROW(decode_error);
+			}
+		} else {
+			int64_t data_start = ftell_64(file);
+
+			if (data_start < 0 || fseek_64(file, data_start + (int64_t) chunk_index.data_size, SEEK_SET) != 0) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			JDXError offsets_error = read_chunk_offsets(&chunk_index, file);
+
+			// The checksums end the file, so anything after them means it was not written or copied as a whole
+			if (offsets_error) {
+				THROW(offsets_error == JDXError_READ_FILE ? JDXError_CORRUPT_FILE : offsets_error);
+			} else if (fgetc(file) != EOF) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+
+			uint64_t stream_count = get_stream_count(&chunk_index);
+			uint64_t block_capacity = VERIFY_BLOCK_SIZE;
+
+			for (uint64_t s = 0; s < stream_count; s++) {
+				uint64_t stream_size = chunk_index.offsets[s + 1] - chunk_index.offsets[s];
+				block_capacity = stream_size > block_capacity ? stream_size : block_capacity;
+			}
+
+			block_capacity = block_capacity < chunk_index.data_size ? block_capacity : chunk_index.data_size;
+
+			if ((block = allocate((size_t) block_capacity)) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			} else if (fseek_64(file, data_start, SEEK_SET) != 0) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			uint32_t thread_count = resolve_thread_count(options->thread_count);
+			VerificationJob job = { .index = &chunk_index, .block = block };
+
+			atomic_init(&job.corrupt, false);
+
+			// Streams are contiguous, so each block is read with a single call and checked before the next is read
+			for (uint64_t first = 0; first < stream_count && !atomic_load(&job.corrupt); ) {
+				uint64_t last = first + 1;
+
+				while (last < stream_count && chunk_index.offsets[last + 1] - chunk_index.offsets[first] <= block_capacity) {
+					last++;
+				}
+
+				size_t block_size = (size_t) (chunk_index.offsets[last] - chunk_index.offsets[first]);
+
+				if (fread(block, 1, block_size, file) != block_size) {
+					THROW(JDXError_READ_FILE);
+				}
+
+				job.block_start = chunk_index.offsets[first];
+				job.first_stream = first;
+
+				parallel_for(last - first, thread_count < last - first ? thread_count : (uint32_t) (last - first), verify_stream_task, &job);
+				first = last;
+			}
+
+			if (atomic_load(&job.corrupt)) {
+				THROW(JDXError_CORRUPT_FILE);
+			}
+		}
+	} CATCH(error) {
+		free_chunk_index(&chunk_index);
+		deallocate(block);
+
+		JDX_FreeHeader(header);
+		return error;
+	}
+
+	free_chunk_index(&chunk_index);
+	deallocate(block);
+
+	JDX_FreeHeader(header);
+	return JDXError_NONE;
+}
+
+JDXError JDX_VerifyPath(const char *path) {
+	return JDX_VerifyPathWithOptions(path, &JDX_DEFAULT_READ_OPTIONS);
+}
+
+JDXError JDX_VerifyPathWithOptions(const char *path, const JDXReadOptions *options) {
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	JDXError error = JDX_VerifyFileWithOptions(file, options);
+
+	if (fclose(file) == EOF) {
+		return JDXError_CLOSE_FILE;
+	}
+
+	return error;
+}
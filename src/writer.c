@@ -0,0 +1,985 @@
+#include "trycatch.h"
+#include "libjdx.h"
+#include "parallel.h"
+#include "chunk.h"
+#include "context.h"
+#include "dedup.h"
+#include "filter.h"
+#include "leio.h"
+#include "stats.h"
+#include "writer.h"
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libdeflate.h>
+
+struct JDXWriterState {
+	FILE *file;
+	bool owns_file;
+
+	// Appends can leave the body shorter than before, so the rest of the file is cut off on close
+	bool truncate_on_close;
+
+	// Fields that are only known once every image is written, so they are filled in on close
+	int64_t image_count_position;
+	int64_t data_size_position;
+
+	// Appends keep the header and descriptor of the original file followed by the end of it that they overwrite, from
+	// tail_start on, so that a failed append can put the file back as it was
+	uint8_t *original_data;
+	size_t original_preamble_size;
+	int64_t original_tail_start;
+	int64_t original_size;
+
+	// Error of a flush that left streams partially written, which fails the close as well
+	JDXError write_error;
+
+	uint32_t chunk_image_count;
+	uint8_t filters;
+
+	// Points to owned_compressor, or to the compressor of the context in the write options
+	ChunkCompressor *compressor;
+	ChunkCompressor owned_compressor;
+
+	// Slot currently being filled and how many images it holds so far
+	uint32_t slot;
+	uint64_t slot_images;
+
+	// Labels are small enough to be kept until close, where they are written after every pixel stream
+	JDXLabel *labels;
+	uint64_t labels_capacity;
+
+	// Deduplicated bodies also keep the reference of every image until close, sharing the capacity of the labels,
+	// and find the images that were already written by the hash of their bytes, checked against the bytes themselves
+	bool deduplicated;
+	uint64_t *references;
+	ImageTable images;
+
+	// Offsets have one more entry than checksums, for the end of the last stream, and both share one capacity
+	uint64_t *offsets;
+	uint32_t *checksums;
+	uint64_t stream_count;
+	uint64_t streams_capacity;
+
+	// Stats of the whole write, which points to call_stats if they are gathered and are reported on close
+	JDXStats call_stats;
+	JDXStats *stats;
+	JDXStats *options_stats;
+	const char *operation;
+};
+
+static void free_writer_state(struct JDXWriterState *state) {
+	if (state == NULL) {
+		return;
+	}
+
+	if (state->compressor == &state->owned_compressor) {
+		free_chunk_compressor(state->compressor);
+	} else if (state->compressor) {
+		enable_compressor_stats(state->compressor, NULL);
+	}
+
+	free_image_table(&state->images);
+	deallocate(state->original_data);
+	deallocate(state->labels);
+	deallocate(state->references);
+	deallocate(state->offsets);
+	deallocate(state->checksums);
+	deallocate(state);
+}
+
+#ifdef DEBUG
+static uint64_t failing_stream = UINT64_MAX;
+
+void fail_writes_from_stream(uint64_t stream) {
+	failing_stream = stream;
+}
+#endif
+
+static JDXError reserve_streams(struct JDXWriterState *state, uint64_t stream_count) {
+	if (stream_count <= state->streams_capacity && state->offsets) {
+		return JDXError_NONE;
+	}
+
+	uint64_t streams_capacity = stream_count * 2 > 64 ? stream_count * 2 : 64;
+	uint64_t *offsets = reallocate(state->offsets, (size_t) (streams_capacity + 1) * sizeof(uint64_t));
+
+	if (offsets == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	state->offsets = offsets;
+
+	uint32_t *checksums = reallocate(state->checksums, (size_t) streams_capacity * sizeof(uint32_t));
+
+	if (checksums == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	state->checksums = checksums;
+	state->streams_capacity = streams_capacity;
+
+	return JDXError_NONE;
+}
+
+static JDXError flush_streams(JDXWriter *writer, uint32_t chunk_count) {
+	struct JDXWriterState *state = writer->_state;
+
+	if (chunk_count == 0) {
+		return JDXError_NONE;
+	}
+
+	JDXError reserve_error = reserve_streams(state, state->stream_count + chunk_count);
+
+	if (reserve_error) {
+		return reserve_error;
+	}
+
+	JDXError compress_error = compress_chunks(state->compressor, chunk_count);
+
+	if (compress_error) {
+		return compress_error;
+	}
+
+	JDXError write_error = write_compressed_chunks(
+		state->compressor,
+		chunk_count,
+		state->offsets + state->stream_count,
+		state->checksums + state->stream_count,
+		state->file
+	);
+
+	if (write_error) {
+		return write_error;
+	}
+
+#ifdef DEBUG
+	if (state->stream_count + chunk_count > failing_stream) {
+		return JDXError_WRITE_FILE;
+	}
+#endif
+
+	state->stream_count += chunk_count;
+	state->slot = 0;
+	state->slot_images = 0;
+
+	return JDXError_NONE;
+}
+
+static void free_writer(JDXWriter *writer) {
+	if (writer == NULL) {
+		return;
+	}
+
+	free_writer_state(writer->_state);
+	JDX_FreeHeader(writer->header);
+	deallocate(writer);
+}
+
+// Allocates a writer whose header takes only the shape and labels of the given header, without writing anything yet
+static JDXError alloc_writer(
+	JDXWriter **dest,
+	FILE *file,
+	const JDXHeader *header,
+	JDXCodec codec,
+	uint8_t compression_level,
+	uint8_t filters,
+	bool deduplicated,
+	uint32_t chunk_image_count,
+	uint32_t thread_count,
+	JDXContext *context,
+	JDXStats *options_stats,
+	const char *operation
+) {
+	JDXWriter *writer = allocate_zeroed(1, sizeof(JDXWriter));
+
+	if (writer == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	TRY {
+		writer->header = JDX_AllocHeader();
+		writer->_state = allocate_zeroed(1, sizeof(struct JDXWriterState));
+
+		if (writer->header == NULL || writer->_state == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		// Images are counted as they are written
+		JDX_CopyHeader(writer->header, header);
+		writer->header->version = JDX_VERSION;
+		writer->header->image_count = 0;
+
+		struct JDXWriterState *state = writer->_state;
+		size_t image_size = JDX_GetImageSize(writer->header);
+
+		state->file = file;
+		state->chunk_image_count = chunk_image_count;
+		state->filters = filters;
+		state->deduplicated = deduplicated;
+		state->images.image_size = image_size;
+		state->stats = begin_stats(&state->call_stats, options_stats);
+		state->options_stats = options_stats;
+		state->operation = operation;
+
+		// Slots hold the pixel streams while writing and are reused for the label and reference streams on close
+		size_t max_value_size = deduplicated ? sizeof(uint64_t) : sizeof(JDXLabel);
+		size_t max_chunk_size = (image_size > max_value_size ? image_size : max_value_size) * (size_t) chunk_image_count;
+		uint64_t start = get_stats_clock(state->stats);
+
+		state->compressor = context ? &context->compressor : &state->owned_compressor;
+
+		ChunkCompressor *compressor = state->compressor;
+		size_t allocated_size = (compressor->uncompressed_capacity + compressor->compressed_capacity) * compressor->slot_capacity;
+
+		JDXError compressor_error = reserve_chunk_compressor(
+			compressor,
+			codec,
+			compression_level,
+			resolve_thread_count(thread_count),
+			max_chunk_size
+		);
+
+		if (compressor_error || (compressor_error = enable_compressor_stats(compressor, state->stats))) {
+			THROW(compressor_error);
+		}
+
+		add_phase_time(state->stats, JDXPhase_ALLOCATE, start);
+		add_allocation(
+			state->stats,
+			(compressor->uncompressed_capacity + compressor->compressed_capacity) * compressor->slot_capacity - allocated_size
+		);
+
+		JDXError streams_error = reserve_streams(state, 0);
+
+		if (streams_error) {
+			THROW(streams_error);
+		}
+
+		state->offsets[0] = 0;
+	} CATCH(error) {
+		free_writer(writer);
+		return error;
+	}
+
+	*dest = writer;
+	return JDXError_NONE;
+}
+
+// Writes the header and body descriptor at the current position of the file, leaving it at the start of the chunk data.
+// The image count of the header and the given body size stand in for the real ones until they are filled in on close
+static JDXError write_preamble(JDXWriter *writer, uint64_t data_size) {
+	struct JDXWriterState *state = writer->_state;
+
+	int64_t preamble_start = state->stats ? ftell_64(state->file) : -1;
+	uint64_t start = get_stats_clock(state->stats);
+
+	JDXError header_error = JDX_WriteHeaderToFile(writer->header, state->file);
+
+	if (header_error) {
+		return header_error;
+	}
+
+	// The image count is the last field of the header, followed by the body descriptor
+	uint8_t codec = (uint8_t) state->compressor->codec;
+	uint8_t filters = state->filters | (state->deduplicated ? BODY_DEDUPLICATED : 0);
+
+	if (
+		(state->image_count_position = ftell_64(state->file)) < 0 ||
+		fwrite_le(&codec, sizeof(codec), state->file) == EOF ||
+		fwrite_le(&state->compressor->compression_level, sizeof(state->compressor->compression_level), state->file) == EOF ||
+		fwrite_le(&filters, sizeof(filters), state->file) == EOF ||
+		fwrite_le(&state->chunk_image_count, sizeof(state->chunk_image_count), state->file) == EOF ||
+		(state->data_size_position = ftell_64(state->file)) < 0 ||
+		fwrite_le(&data_size, sizeof(data_size), state->file) == EOF
+	) {
+		return JDXError_WRITE_FILE;
+	}
+
+	state->image_count_position -= sizeof(writer->header->image_count);
+
+	if (state->stats && preamble_start >= 0) {
+		state->stats->bytes_written += (uint64_t) (ftell_64(state->file) - preamble_start);
+	}
+
+	add_phase_time(state->stats, JDXPhase_WRITE, start);
+	return JDXError_NONE;
+}
+
+// Fills in the image count and body size of the header and descriptor, leaving the file after the descriptor
+static bool write_body_size(struct JDXWriterState *state, uint64_t image_count, uint64_t data_size) {
+	return (
+		fseek_64(state->file, state->image_count_position, SEEK_SET) == 0 &&
+		fwrite_le(&image_count, sizeof(image_count), state->file) != EOF &&
+		fseek_64(state->file, state->data_size_position, SEEK_SET) == 0 &&
+		fwrite_le(&data_size, sizeof(data_size), state->file) != EOF
+	);
+}
+
+// Puts back what an append overwrote, the end of the file first and the header last, like a successful close
+static JDXError restore_original_file(struct JDXWriterState *state) {
+	size_t tail_size = (size_t) (state->original_size - state->original_tail_start);
+
+	if (
+		fseek_64(state->file, state->original_tail_start, SEEK_SET) != 0 ||
+		fwrite(state->original_data + state->original_preamble_size, 1, tail_size, state->file) != tail_size ||
+		fflush(state->file) == EOF ||
+		ftruncate_64(state->file, state->original_size) != 0 ||
+		fseek_64(state->file, 0, SEEK_SET) != 0 ||
+		fwrite(state->original_data, 1, state->original_preamble_size, state->file) != state->original_preamble_size ||
+		fflush(state->file) == EOF
+	) {
+		return JDXError_WRITE_FILE;
+	}
+
+	return JDXError_NONE;
+}
+
+// Saves the header and descriptor before data_start and everything from tail_start to the end of the file
+static JDXError keep_original_file(struct JDXWriterState *state, int64_t data_start, int64_t tail_start) {
+	int64_t size;
+
+	if (fseek_64(state->file, 0, SEEK_END) != 0 || (size = ftell_64(state->file)) < tail_start) {
+		return JDXError_READ_FILE;
+	}
+
+	size_t preamble_size = (size_t) data_start;
+	size_t tail_size = (size_t) (size - tail_start);
+	uint8_t *data = allocate(preamble_size + tail_size);
+
+	if (data == NULL) {
+		return JDXError_MEMORY_FAILURE;
+	}
+
+	if (
+		fseek_64(state->file, 0, SEEK_SET) != 0 ||
+		fread(data, 1, preamble_size, state->file) != preamble_size ||
+		fseek_64(state->file, tail_start, SEEK_SET) != 0 ||
+		fread(data + preamble_size, 1, tail_size, state->file) != tail_size
+	) {
+		deallocate(data);
+		return JDXError_READ_FILE;
+	}
+
+	state->original_data = data;
+	state->original_preamble_size = preamble_size;
+	state->original_tail_start = tail_start;
+	state->original_size = size;
+
+	return JDXError_NONE;
+}
+
+void abort_writer(JDXWriter *writer) {
+	struct JDXWriterState *state = writer->_state;
+
+	if (state->original_data) {
+		restore_original_file(state);
+	}
+
+	if (state->owns_file) {
+		fclose(state->file);
+	}
+
+	free_writer(writer);
+}
+
+// Resolves the settings of a new body from the write options
+static JDXError resolve_write_options(
+	uint8_t *compression_level_dest,
+	uint8_t *filters_dest,
+	uint32_t *chunk_image_count_dest,
+	const JDXHeader *header,
+	const JDXWriteOptions *options
+) {
+	JDXError compression_error = resolve_compression(compression_level_dest, options->codec, options->compression_level);
+
+	if (compression_error) {
+		return compression_error;
+	} else if (options->filter > JDXFilter_PAETH) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	*filters_dest = get_filter_flags(options->filter, options->split_channels);
+	*chunk_image_count_dest = (
+		options->chunk_image_count
+			? options->chunk_image_count
+			: default_chunk_image_count(JDX_GetImageSize(header))
+	);
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_OpenWriterToFile(JDXWriter **dest, FILE *file, const JDXHeader *header, const JDXWriteOptions *options) {
+	if (options == NULL) {
+		options = &JDX_DEFAULT_WRITE_OPTIONS;
+	}
+
+	uint8_t compression_level, filters;
+	uint32_t chunk_image_count;
+
+	JDXError options_error = resolve_write_options(&compression_level, &filters, &chunk_image_count, header, options);
+
+	if (options_error) {
+		return options_error;
+	}
+
+	JDXWriter *writer = NULL;
+	JDXError alloc_error = alloc_writer(
+		&writer,
+		file,
+		header,
+		options->codec,
+		compression_level,
+		filters,
+		options->deduplicate,
+		chunk_image_count,
+		options->thread_count,
+		options->context,
+		options->stats,
+		"write"
+	);
+
+	if (alloc_error) {
+		return alloc_error;
+	}
+
+	JDXError preamble_error = write_preamble(writer, 0);
+
+	if (preamble_error) {
+		free_writer(writer);
+		return preamble_error;
+	}
+
+	*dest = writer;
+	return JDXError_NONE;
+}
+
+JDXError JDX_OpenWriterToPath(JDXWriter **dest, const char *path, const JDXHeader *header, const JDXWriteOptions *options) {
+	FILE *file = fopen(path, "wb");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	JDXError error = JDX_OpenWriterToFile(dest, file, header, options);
+
+	if (error) {
+		fclose(file);
+		return error;
+	}
+
+	(*dest)->_state->owns_file = true;
+	return JDXError_NONE;
+}
+
+static JDXError checksum_kept_streams(struct JDXWriterState *state, int64_t data_start, uint64_t kept_stream_count) {
+	uint8_t *stream_data = NULL;
+	size_t stream_capacity = 0;
+
+	TRY {
+		if (kept_stream_count > 0 && fseek_64(state->file, data_start, SEEK_SET) != 0) {
+			THROW(JDXError_READ_FILE);
+		}
+
+		// Kept streams are contiguous from the start of the chunk data, so they are read in order without seeking
+		for (uint64_t s = 0; s < kept_stream_count; s++) {
+			size_t stream_size = (size_t) (state->offsets[s + 1] - state->offsets[s]);
+
+			if (stream_size > stream_capacity) {
+				deallocate(stream_data);
+
+				if ((stream_data = allocate(stream_size)) == NULL) {
+					THROW(JDXError_MEMORY_FAILURE);
+				}
+
+				stream_capacity = stream_size;
+			}
+
+			if (fread(stream_data, 1, stream_size, state->file) != stream_size) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			state->checksums[s] = libdeflate_crc32(0, stream_data, stream_size);
+		}
+	} CATCH(error) {
+		deallocate(stream_data);
+		return error;
+	}
+
+	deallocate(stream_data);
+	return JDXError_NONE;
+}
+
+JDXError JDX_OpenWriterForAppend(JDXWriter **dest, const char *path, const JDXWriteOptions *options) {
+	// Declare all allocated pointers so that they can easily be freed in the event of an error
+	ChunkIndex chunk_index = { .offsets = NULL };
+	JDXLabel *labels = NULL;
+	uint64_t *references = NULL;
+	uint8_t *tail_data = NULL;
+	JDXReader *reader = NULL;
+	JDXWriter *writer = NULL;
+	JDXHeader *header = NULL;
+
+	if (options == NULL) {
+		options = &JDX_DEFAULT_WRITE_OPTIONS;
+	}
+
+	FILE *file = fopen(path, "r+b");
+
+	if (file == NULL) {
+		return JDXError_OPEN_FILE;
+	}
+
+	TRY {
+		header = JDX_AllocHeader();
+
+		if (header == NULL) {
+			THROW(JDXError_MEMORY_FAILURE);
+		}
+
+		JDXError header_error = JDX_ReadHeaderFromFile(header, file);
+		JDXError body_error = header_error ? header_error : read_body_descriptor(&chunk_index, header, file);
+
+		if (body_error) {
+			THROW(body_error);
+		}
+
+		JDXCodec codec = chunk_index.codec;
+		uint8_t compression_level = chunk_index.compression_level;
+		uint8_t filters = chunk_index.filters;
+		bool deduplicated = chunk_index.deduplicated;
+		uint32_t chunk_image_count = (uint32_t) chunk_index.chunk_image_count;
+		int64_t data_start = ftell_64(file);
+
+		// Pixel streams of full chunks stay where they are, while a partial last chunk is decoded and
+		// written again along with the new images, so that every chunk but the last stays full.
+		// Bodies before 0.5 are a single stream, which is converted to chunks on its first append
+		uint64_t kept_chunk_count = 0;
+
+		if (chunk_index.interleaved) {
+			JDXError options_error = resolve_write_options(&compression_level, &filters, &chunk_image_count, header, options);
+
+			if (options_error) {
+				THROW(options_error);
+			}
+
+			codec = options->codec;
+			deduplicated = options->deduplicate;
+		} else if (chunk_image_count == 0) {
+			// Only empty bodies can have no images per chunk, and they have no chunks to keep either
+			chunk_image_count = default_chunk_image_count(JDX_GetImageSize(header));
+		} else {
+			if (data_start < 0 || fseek_64(file, data_start + (int64_t) chunk_index.data_size, SEEK_SET) != 0) {
+				THROW(JDXError_READ_FILE);
+			}
+
+			JDXError offsets_error = read_chunk_offsets(&chunk_index, file);
+
+			if (offsets_error) {
+				THROW(offsets_error);
+			}
+
+			kept_chunk_count = header->image_count / chunk_image_count;
+		}
+
+		// References of the kept images are written again on close along with those of the new images. Only the
+		// rewritten and new images are hashed, so appended images are deduplicated against those alone
+		if (deduplicated) {
+			if ((references = allocate(header->image_count > 0 ? (size_t) header->image_count * sizeof(uint64_t) : 1)) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+
+			JDXError references_error = read_references(references, &chunk_index, file, data_start, kept_chunk_count);
+
+			if (references_error) {
+				THROW(references_error);
+			}
+		}
+
+		// Every label is rewritten after the new pixel streams, so all of them are kept in the writer
+		JDXError labels_error = (
+			fseek_64(file, 0, SEEK_SET) != 0
+				? JDXError_READ_FILE
+				: JDX_ReadLabelsFromFile(&labels, header, file)
+		);
+
+		if (labels_error) {
+			THROW(labels_error);
+		}
+
+		uint64_t kept_image_count = kept_chunk_count * chunk_image_count;
+		uint64_t tail_count = header->image_count - kept_image_count;
+		size_t image_size = JDX_GetImageSize(header);
+
+		// The images to write again are read in full before anything in the file is overwritten
+		if (tail_count > 0) {
+			if ((tail_data = allocate(image_size * (size_t) tail_count)) == NULL) {
+				THROW(JDXError_MEMORY_FAILURE);
+			}
+
+			JDXError reader_error = (
+				fseek_64(file, 0, SEEK_SET) != 0
+					? JDXError_READ_FILE
+					: JDX_OpenReaderFromFile(&reader, file)
+			);
+
+			if (reader_error || (reader_error = JDX_SeekReader(reader, kept_image_count))) {
+				THROW(reader_error);
+			}
+
+			for (uint64_t i = 0; i < tail_count; i++) {
+				JDXImageView view;
+				JDXError read_error = JDX_ReadNextImage(reader, &view);
+
+				if (read_error) {
+					THROW(read_error);
+				}
+
+				memcpy(tail_data + image_size * (size_t) i, view.raw_data, image_size);
+			}
+
+			JDXError close_error = JDX_CloseReader(reader);
+			reader = NULL;
+
+			if (close_error) {
+				THROW(close_error);
+			}
+		}
+
+		JDXError alloc_error = alloc_writer(
+			&writer,
+			file,
+			header,
+			codec,
+			compression_level,
+			filters,
+			deduplicated,
+			chunk_image_count,
+			options->thread_count,
+			options->context,
+			options->stats,
+			"append"
+		);
+
+		if (alloc_error) {
+			THROW(alloc_error);
+		}
+
+		struct JDXWriterState *state = writer->_state;
+		state->owns_file = true;
+
+		JDXError streams_error = reserve_streams(state, kept_chunk_count);
+
+		if (streams_error) {
+			THROW(streams_error);
+		}
+
+		if (kept_chunk_count > 0) {
+			memcpy(state->offsets, chunk_index.offsets, (size_t) (kept_chunk_count + 1) * sizeof(uint64_t));
+		}
+
+		state->stream_count = kept_chunk_count;
+		state->labels = labels;
+		state->references = references;
+		state->labels_capacity = header->image_count;
+		state->truncate_on_close = true;
+		labels = NULL;
+		references = NULL;
+
+		// Everything that is about to be overwritten is kept until close, starting with the streams after the kept
+		// pixel streams. Legacy bodies are rewritten in full, and their new preamble can be longer than the old one
+		int64_t tail_start = data_start + (int64_t) (kept_chunk_count > 0 ? chunk_index.offsets[kept_chunk_count] : 0);
+		JDXError keep_error = data_start < 0 ? JDXError_READ_FILE : keep_original_file(state, data_start, tail_start);
+
+		if (keep_error) {
+			THROW(keep_error);
+		}
+
+		// The header and descriptor keep their size, so the kept pixel streams stay at the same offsets. They keep the
+		// original image count and body size as well, which are only replaced as the very last step of close
+		writer->header->image_count = header->image_count;
+
+		JDXError preamble_error = (
+			fseek_64(file, 0, SEEK_SET) != 0
+				? JDXError_WRITE_FILE
+				: write_preamble(writer, chunk_index.data_size)
+		);
+
+		writer->header->image_count = kept_image_count;
+
+		if (preamble_error) {
+			THROW(preamble_error);
+		} else if ((data_start = ftell_64(file)) < 0) {
+			THROW(JDXError_WRITE_FILE);
+		}
+
+		// Bodies from before checksums were stored get them for their kept streams, which are read back once
+		JDXError checksum_error = JDXError_NONE;
+
+		if (chunk_index.checksums) {
+			memcpy(state->checksums, chunk_index.checksums, (size_t) kept_chunk_count * sizeof(uint32_t));
+		} else {
+			checksum_error = checksum_kept_streams(state, data_start, kept_chunk_count);
+		}
+
+		if (checksum_error) {
+			THROW(checksum_error);
+		} else if (fseek_64(file, data_start + (int64_t) state->offsets[kept_chunk_count], SEEK_SET) != 0) {
+			THROW(JDXError_WRITE_FILE);
+		}
+
+		for (uint64_t i = 0; i < tail_count; i++) {
+			JDXLabel label = state->labels[kept_image_count + i];
+			JDXError write_error = JDX_WriteNextImage(writer, tail_data + image_size * (size_t) i, label);
+
+			if (write_error) {
+				THROW(write_error);
+			}
+		}
+	} CATCH(error) {
+		JDX_CloseReader(reader);
+		free_chunk_index(&chunk_index);
+		JDX_FreeHeader(header);
+		deallocate(labels);
+		deallocate(references);
+		deallocate(tail_data);
+
+		// Writers own the file once they exist, and put back anything that was already overwritten
+		if (writer) {
+			abort_writer(writer);
+		} else {
+			fclose(file);
+		}
+
+		return error;
+	}
+
+	free_chunk_index(&chunk_index);
+	JDX_FreeHeader(header);
+	deallocate(tail_data);
+
+	*dest = writer;
+	return JDXError_NONE;
+}
+
+void keep_written_images(JDXWriter *writer, const uint8_t *images) {
+	struct JDXWriterState *state = writer->_state;
+
+	state->images.kept_images = images;
+	state->images.first_kept_image = writer->header->image_count;
+}
+
+JDXError JDX_WriteNextImage(JDXWriter *writer, const uint8_t *image_data, JDXLabel label) {
+	struct JDXWriterState *state = writer->_state;
+
+	if (label >= writer->header->label_count) {
+		return JDXError_OUT_OF_BOUNDS;
+	}
+
+	if (writer->header->image_count == state->labels_capacity) {
+		uint64_t labels_capacity = state->labels_capacity ? state->labels_capacity * 2 : 1024;
+		uint64_t start = get_stats_clock(state->stats);
+
+		JDXLabel *labels = reallocate(state->labels, (size_t) labels_capacity * sizeof(JDXLabel));
+
+		if (labels == NULL) {
+			return JDXError_MEMORY_FAILURE;
+		}
+
+		state->labels = labels;
+
+		if (state->deduplicated) {
+			uint64_t *references = reallocate(state->references, (size_t) labels_capacity * sizeof(uint64_t));
+
+			if (references == NULL) {
+				return JDXError_MEMORY_FAILURE;
+			}
+
+			state->references = references;
+			add_allocation(state->stats, (size_t) labels_capacity * sizeof(uint64_t));
+		}
+
+		add_phase_time(state->stats, JDXPhase_ALLOCATE, start);
+		add_allocation(state->stats, (size_t) labels_capacity * sizeof(JDXLabel));
+
+		state->labels_capacity = labels_capacity;
+	}
+
+	size_t image_size = JDX_GetImageSize(writer->header);
+	uint64_t image = writer->header->image_count;
+	uint64_t source = image;
+
+	// A matching hash only makes an image a candidate, which becomes a reference once its bytes match too
+	if (state->deduplicated) {
+		uint64_t start = get_stats_clock(state->stats);
+		JDXError hash_error = find_or_add_image(&source, &state->images, hash_image(image_data, image_size), image_data, image);
+
+		if (hash_error) {
+			return hash_error;
+		}
+
+		add_phase_time(state->stats, JDXPhase_HASH, start);
+		state->references[image] = image - source;
+
+		if (state->stats && source != image) {
+			state->stats->duplicate_images++;
+		}
+	}
+
+	// Slots of deduplicated bodies hold only the stored images of their chunk, which can be fewer than its images
+	if (state->slot_images == 0) {
+		state->compressor->uncompressed_sizes[state->slot] = 0;
+	}
+
+	if (source == image) {
+		uint64_t start = get_stats_clock(state->stats);
+
+		apply_filters(
+			state->compressor->uncompressed_chunks[state->slot] + state->compressor->uncompressed_sizes[state->slot],
+			image_data,
+			writer->header,
+			state->filters
+		);
+
+		add_phase_time(state->stats, state->filters ? JDXPhase_FILTER : JDXPhase_COPY, start);
+		state->compressor->uncompressed_sizes[state->slot] += image_size;
+	}
+
+	state->slot_images++;
+	state->labels[writer->header->image_count++] = label;
+
+	// Once every slot holds a full chunk, they are compressed together and written out
+	if (state->slot_images == state->chunk_image_count) {
+		state->slot_images = 0;
+
+		if (++state->slot == state->compressor->slot_count) {
+			JDXError flush_error = flush_streams(writer, state->slot);
+
+			if (flush_error) {
+				state->write_error = flush_error;
+			}
+
+			return flush_error;
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+// Writes a stream for each chunk that holds one value for each of its images, such as their labels
+static JDXError flush_image_values(JDXWriter *writer, const void *values, size_t value_size, uint64_t chunk_count) {
+	struct JDXWriterState *state = writer->_state;
+
+	for (uint64_t c = 0; c < chunk_count; c += state->compressor->slot_count) {
+		uint32_t batch_count = (
+			chunk_count - c < state->compressor->slot_count
+				? (uint32_t) (chunk_count - c)
+				: state->compressor->slot_count
+		);
+
+		for (uint32_t s = 0; s < batch_count; s++) {
+			uint64_t first_image = (c + s) * state->chunk_image_count;
+			uint64_t remaining = writer->header->image_count - first_image;
+			size_t stream_size = value_size * (size_t) (
+				remaining < state->chunk_image_count ? remaining : state->chunk_image_count
+			);
+
+			memcpy(state->compressor->uncompressed_chunks[s], (const uint8_t *) values + value_size * (size_t) first_image, stream_size);
+			state->compressor->uncompressed_sizes[s] = stream_size;
+		}
+
+		JDXError flush_error = flush_streams(writer, batch_count);
+
+		if (flush_error) {
+			return flush_error;
+		}
+	}
+
+	return JDXError_NONE;
+}
+
+JDXError JDX_CloseWriter(JDXWriter *writer) {
+	struct JDXWriterState *state = writer->_state;
+
+	TRY {
+		if (state->write_error) {
+			THROW(state->write_error);
+		}
+
+		// Include the partially filled slot, which holds the last pixel stream of the body
+		JDXError flush_error = flush_streams(writer, state->slot + (state->slot_images > 0 ? 1 : 0));
+
+		if (flush_error) {
+			THROW(flush_error);
+		}
+
+		// Every chunk has exactly one label stream, which follows all of the pixel streams, and then one reference
+		// stream if the body is deduplicated, so that reading only the labels never touches the references
+		uint64_t chunk_count = state->stream_count;
+		JDXError label_error = flush_image_values(writer, state->labels, sizeof(JDXLabel), chunk_count);
+
+		if (label_error) {
+			THROW(label_error);
+		}
+
+		if (state->deduplicated) {
+			JDXError reference_error = flush_image_values(writer, state->references, sizeof(uint64_t), chunk_count);
+
+			if (reference_error) {
+				THROW(reference_error);
+			}
+		}
+
+		uint64_t start = get_stats_clock(state->stats);
+
+		for (uint_fast64_t c = 0; c <= state->stream_count; c++) {
+			if (fwrite_le(&state->offsets[c], sizeof(uint64_t), state->file) == EOF) {
+				THROW(JDXError_WRITE_FILE);
+			}
+		}
+
+		for (uint_fast64_t c = 0; c < state->stream_count; c++) {
+			if (fwrite_le(&state->checksums[c], sizeof(uint32_t), state->file) == EOF) {
+				THROW(JDXError_WRITE_FILE);
+			}
+		}
+
+		uint64_t data_size = state->offsets[state->stream_count];
+		int64_t end_position = ftell_64(state->file);
+
+		// The image count and body size are filled in last, so that the header only describes the new body once
+		// the rest of it is in the file
+		if (
+			end_position < 0 ||
+			fflush(state->file) == EOF ||
+			(state->truncate_on_close && ftruncate_64(state->file, end_position) != 0) ||
+			!write_body_size(state, writer->header->image_count, data_size) ||
+			fseek_64(state->file, end_position, SEEK_SET) != 0 ||
+			fflush(state->file) == EOF
+		) {
+			THROW(JDXError_WRITE_FILE);
+		}
+
+		if (state->stats) {
+			state->stats->bytes_written += (state->stream_count + 1) * sizeof(uint64_t) + state->stream_count * sizeof(uint32_t);
+			add_phase_time(state->stats, JDXPhase_WRITE, start);
+		}
+	} CATCH(error) {
+		abort_writer(writer);
+		return error;
+	}
+
+	JDXError close_error = JDXError_NONE;
+
+	if (state->owns_file && fclose(state->file) == EOF) {
+		close_error = JDXError_CLOSE_FILE;
+	}
+
+	end_stats(state->stats, state->options_stats, state->operation);
+	free_writer(writer);
+
+	return close_error;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "libjdx.h"
+
+#include <stdint.h>
+
+// Lets deduplication compare against the images written from now on in place, which must stay at consecutive
+// addresses from images until the writer is closed, instead of keeping copies of them
+void keep_written_images(JDXWriter *writer, const uint8_t *images);
+
+// Frees a writer without finishing its body, putting back the file of an append as it was before it was opened
+void abort_writer(JDXWriter *writer);
+
+#ifdef DEBUG
+// Test hook that fails every flush that would write the given stream or a later one, after writing it
+void fail_writes_from_stream(uint64_t stream);
+#endif
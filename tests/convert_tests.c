@@ -0,0 +1,150 @@
+#include "tests.h"
+#include "../src/convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Every tier must give exactly the results of the scalar kernels, which the expected values below are written after
+static const KernelTier tested_tiers[] = { KernelTier_SCALAR, KernelTier_SSE2, KernelTier_SSSE3, KernelTier_AVX2 };
+
+// The example pixels with an alpha channel that varies, so that 32-bit kernels cannot pass by ignoring it
+static uint8_t *alloc_alpha_pixels(size_t pixel_count) {
+	uint8_t *pixels = malloc(pixel_count * 4);
+
+	for (size_t p = 0; p < pixel_count; p++) {
+		memcpy(pixels + 4 * p, example_dataset->_raw_image_data + 3 * p, 3);
+		pixels[4 * p + 3] = (uint8_t) (p * 37);
+	}
+
+	return pixels;
+}
+
+static bool check_float_conversion(const uint8_t *src, const JDXHeader *header) {
+	size_t channels = header->bit_depth / 8;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height;
+	size_t image_size = JDX_GetImageSize(header);
+	uint64_t image_count = header->image_count;
+
+	float *interleaved = malloc(image_size * image_count * sizeof(float));
+	float *planar = malloc(image_size * image_count * sizeof(float));
+
+	JDXError interleaved_error = JDX_ConvertToFloat(interleaved, JDXLayout_HWC, src, header, image_count);
+	JDXError planar_error = JDX_ConvertToFloat(planar, JDXLayout_CHW, src, header, image_count);
+	bool floats_match = interleaved_error == JDXError_NONE && planar_error == JDXError_NONE;
+
+	for (uint64_t i = 0; i < image_count && floats_match; i++) {
+		for (size_t p = 0; p < pixel_count && floats_match; p++) {
+			for (size_t c = 0; c < channels && floats_match; c++) {
+				size_t hwc_index = image_size * i + channels * p + c;
+				float expected = (float) src[hwc_index] * (1.0f / 255.0f);
+
+				floats_match = (
+					interleaved[hwc_index] == expected
+					&& planar[image_size * i + pixel_count * c + p] == expected
+				);
+			}
+		}
+	}
+
+	free(interleaved);
+	free(planar);
+
+	return floats_match;
+}
+
+TEST_FUNC(ConvertToFloat) {
+	// The example images are 24-bit, so their planar output has three planes per image and the 32-bit copy has four
+	JDXHeader *header = example_dataset->header;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height * (size_t) header->image_count;
+
+	JDXHeader alpha_header = *header;
+	alpha_header.bit_depth = 32;
+
+	uint8_t *alpha = alloc_alpha_pixels(pixel_count);
+	bool floats_match = true;
+
+	for (size_t t = 0; t < sizeof(tested_tiers) / sizeof(tested_tiers[0]) && floats_match; t++) {
+		force_kernel_tier(tested_tiers[t]);
+
+		floats_match = (
+			check_float_conversion(example_dataset->_raw_image_data, header)
+			&& check_float_conversion(alpha, &alpha_header)
+		);
+	}
+
+	force_kernel_tier(KernelTier_AVX2);
+
+	// Two channels have no kernels, and must be rejected before anything is read from the source
+	JDXHeader unsupported_header = *header;
+	unsupported_header.image_width = 1;
+	unsupported_header.image_height = 1;
+	unsupported_header.bit_depth = 16;
+
+	uint8_t pixel[4] = { 0 };
+	float pixel_floats[4];
+	uint8_t planes[4];
+
+	bool unsupported_rejected = (
+		JDX_ConvertToFloat(pixel_floats, JDXLayout_CHW, pixel, &unsupported_header, 1) == JDXError_UNSUPPORTED_CONVERSION
+		&& JDX_ConvertToFloat(pixel_floats, JDXLayout_HWC, pixel, &unsupported_header, 1) == JDXError_UNSUPPORTED_CONVERSION
+		&& JDX_ConvertToPlanar(planes, pixel, &unsupported_header, 1) == JDXError_UNSUPPORTED_CONVERSION
+		&& JDX_ConvertToFloat(pixel_floats, (JDXLayout) 2, pixel, header, 1) == JDXError_UNSUPPORTED_CONVERSION
+	);
+
+	final_state = floats_match && unsupported_rejected ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(alpha);
+}
+
+TEST_FUNC(ConvertBitDepth) {
+	JDXHeader *header = example_dataset->header;
+	size_t pixel_count = (size_t) header->image_width * (size_t) header->image_height * (size_t) header->image_count;
+
+	JDXHeader alpha_header = *header;
+	alpha_header.bit_depth = 32;
+
+	uint8_t *source_alpha = alloc_alpha_pixels(pixel_count);
+	uint8_t *alpha = malloc(pixel_count * 4);
+	uint8_t *dropped = malloc(pixel_count * 3);
+	uint8_t *luma = malloc(pixel_count);
+	uint8_t *alpha_luma = malloc(pixel_count);
+	bool conversions_match = true;
+
+	for (size_t t = 0; t < sizeof(tested_tiers) / sizeof(tested_tiers[0]) && conversions_match; t++) {
+		force_kernel_tier(tested_tiers[t]);
+
+		// Dropping alpha must give back the original pixels whatever the alpha was, and luma must ignore it
+		conversions_match = (
+			JDX_ConvertBitDepth(alpha, 32, example_dataset->_raw_image_data, header, header->image_count) == JDXError_NONE
+			&& JDX_ConvertBitDepth(dropped, 24, source_alpha, &alpha_header, header->image_count) == JDXError_NONE
+			&& JDX_ConvertBitDepth(luma, 8, example_dataset->_raw_image_data, header, header->image_count) == JDXError_NONE
+			&& JDX_ConvertBitDepth(alpha_luma, 8, source_alpha, &alpha_header, header->image_count) == JDXError_NONE
+			&& memcmp(dropped, example_dataset->_raw_image_data, pixel_count * 3) == 0
+		);
+
+		for (size_t p = 0; p < pixel_count && conversions_match; p++) {
+			const uint8_t *pixel = example_dataset->_raw_image_data + 3 * p;
+			uint8_t expected_luma = (uint8_t) ((38 * pixel[0] + 75 * pixel[1] + 15 * pixel[2] + 64) >> 7);
+
+			conversions_match = (
+				luma[p] == expected_luma
+				&& alpha_luma[p] == expected_luma
+				&& memcmp(alpha + 4 * p, pixel, 3) == 0
+				&& alpha[4 * p + 3] == 0xFF
+			);
+		}
+	}
+
+	force_kernel_tier(KernelTier_AVX2);
+
+	final_state = (
+		conversions_match
+		&& JDX_ConvertBitDepth(luma, 16, example_dataset->_raw_image_data, header, 1) == JDXError_UNSUPPORTED_CONVERSION
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(source_alpha);
+	free(alpha);
+	free(dropped);
+	free(luma);
+	free(alpha_luma);
+}
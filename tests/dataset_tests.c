@@ -1,8 +1,21 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "tests.h"
+#include "../src/dedup.h"
+#include "../src/loader.h"
+#include "../src/writer.h"
 
 #include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 TEST_FUNC(ReadDatasetFromPath) {
 	JDXDataset *dataset = JDX_AllocDataset();
 	JDXError error = JDX_ReadDatasetFromPath(dataset, "./res/example.jdx");
@@ -16,6 +29,812 @@ TEST_FUNC(ReadDatasetFromPath) {
 	JDX_FreeDataset(dataset);
 }
 
+TEST_FUNC(ReadDatasetFromPathThreaded) {
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 4;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options);
+
+	JDXDataset *dataset = JDX_AllocDataset();
+	JDXError read_error = JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options);
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	final_state = (
+		write_error == JDXError_NONE
+		&& read_error == JDXError_NONE
+		&& dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(ReadLargeDatasetFromPath) {
+	// Stored chunks of 3 MiB split every stream into several segments, which the loader reads ahead of decoding
+	JDXHeader large_header = *example_dataset->header;
+	large_header.image_width = 512;
+	large_header.image_height = 512;
+	large_header.bit_depth = 24;
+	large_header.image_count = 16;
+	large_header._label_table = NULL;
+
+	size_t image_block_size = JDX_GetImageSize(&large_header) * large_header.image_count;
+	uint8_t *image_data = malloc(image_block_size);
+	JDXLabel labels[16];
+	uint32_t noise = 1;
+
+	for (size_t b = 0; b < image_block_size; b++) {
+		noise = noise * 1103515245 + 12345;
+		image_data[b] = (uint8_t) (noise >> 24);
+	}
+
+	for (uint64_t i = 0; i < large_header.image_count; i++) {
+		labels[i] = (JDXLabel) (i % large_header.label_count);
+	}
+
+	JDXDataset large_dataset = { .header = &large_header, ._raw_image_data = image_data, ._raw_labels = labels };
+
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 4;
+	write_options.codec = JDXCodec_STORED;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 4;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(&large_dataset, "./res/temp.jdx", &write_options);
+	bool datasets_match = write_error == JDXError_NONE;
+	bool failures_reported = true;
+
+	// Both backends must read everything back whether or not their reads come back short, and report failed reads
+	for (int backend = 0; backend < 2 && datasets_match; backend++) {
+		force_pread_loader(backend == 1);
+
+		for (int short_reads = 0; short_reads <= 1 && datasets_match; short_reads++) {
+			limit_loader_reads(short_reads ? 100000 : 0);
+
+			JDXDataset *dataset = JDX_AllocDataset();
+
+			datasets_match = (
+				JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE
+				&& dataset->header->image_count == large_header.image_count
+				&& memcmp(dataset->_raw_image_data, image_data, image_block_size) == 0
+				&& memcmp(dataset->_raw_labels, labels, sizeof(labels)) == 0
+			);
+
+			JDX_FreeDataset(dataset);
+		}
+
+		limit_loader_reads(0);
+		fail_loader_reads_from(image_block_size / 2);
+
+		JDXDataset *dataset = JDX_AllocDataset();
+		JDXError read_error = JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options);
+		failures_reported = failures_reported && read_error == JDXError_READ_FILE;
+
+		fail_loader_reads_from(UINT64_MAX);
+		JDX_FreeDataset(dataset);
+	}
+
+	force_pread_loader(false);
+
+	final_state = datasets_match && failures_reported ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(image_data);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(ReadLegacyDatasetFromPath) {
+	JDXDataset *dataset = JDX_AllocDataset();
+	JDXError error = JDX_ReadDatasetFromPath(dataset, "./res/example-0.4.jdx");
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	final_state = (
+		error == JDXError_NONE
+		&& dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+}
+
+TEST_FUNC(ReadLabelsFromPath) {
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+	bool labels_match = true;
+
+	// Legacy files interleave labels with pixels, so both layouts are read
+	const char *paths[] = { "./res/example.jdx", "./res/example-0.4.jdx" };
+
+	for (size_t p = 0; p < sizeof(paths) / sizeof(paths[0]) && labels_match; p++) {
+		JDXHeader *header = JDX_AllocHeader();
+		JDXLabel *labels = NULL;
+
+		labels_match = (
+			JDX_ReadLabelsFromPath(&labels, header, paths[p]) == JDXError_NONE
+			&& header->image_count == example_dataset->header->image_count
+			&& header->label_count == example_dataset->header->label_count
+			&& memcmp(labels, example_dataset->_raw_labels, label_block_size) == 0
+		);
+
+		JDX_Free(labels);
+		JDX_FreeHeader(header);
+	}
+
+	final_state = labels_match ? STATE_SUCCESS : STATE_FAILURE;
+}
+
+TEST_FUNC(ReadDatasetWithLabelsFromPath) {
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	JDXLabel wanted_labels[] = { 0, 2 };
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options);
+	JDXError read_error = write_error ? write_error : JDX_ReadDatasetWithLabelsFromPath(dataset, "./res/temp.jdx", wanted_labels, 2);
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	bool images_match = read_error == JDXError_NONE;
+	uint64_t match = 0;
+
+	// The loaded images must be exactly the matching images of the full dataset, in their original order
+	for (uint64_t i = 0; i < example_dataset->header->image_count && images_match; i++) {
+		JDXLabel label = example_dataset->_raw_labels[i];
+
+		if (label != 0 && label != 2) {
+			continue;
+		}
+
+		images_match = (
+			match < dataset->header->image_count
+			&& dataset->_raw_labels[match] == label
+			&& memcmp(dataset->_raw_image_data + image_size * match, example_dataset->_raw_image_data + image_size * i, image_size) == 0
+		);
+
+		match++;
+	}
+
+	JDXLabel invalid_label = example_dataset->header->label_count;
+
+	final_state = (
+		images_match
+		&& match == dataset->header->image_count
+		&& JDX_ReadDatasetWithLabelsFromPath(dataset, "./res/temp.jdx", &invalid_label, 1) == JDXError_OUT_OF_BOUNDS
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+}
+
+static void count_stats_call(const char *operation, const JDXStats *stats, void *user_data) {
+	if (strcmp(operation, "read") == 0) {
+		*(uint64_t *) user_data += stats->bytes_read;
+	}
+}
+
+TEST_FUNC(ReadDatasetWithStats) {
+	JDXStats write_stats = { 0 }, read_stats = { 0 };
+	uint64_t callback_bytes_read = 0;
+
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+	write_options.filter = JDXFilter_SUB;
+	write_options.thread_count = 2;
+	write_options.stats = &write_stats;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 2;
+	read_options.stats = &read_stats;
+
+	JDXDataset *read_dataset = JDX_AllocDataset();
+	JDX_SetStatsCallback(count_stats_call, &callback_bytes_read);
+
+	bool io_succeeded = (
+		JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPathWithOptions(read_dataset, "./res/temp.jdx", &read_options) == JDXError_NONE
+	);
+
+	JDX_SetStatsCallback(NULL, NULL);
+
+	FILE *file = fopen("./res/temp.jdx", "rb");
+	uint64_t file_size = 0;
+
+	if (file) {
+		fseek(file, 0, SEEK_END);
+		file_size = (uint64_t) ftell(file);
+		fclose(file);
+	}
+
+	// Both sides of the codec are counted alike, and every byte of the file is counted once either way
+	uint64_t body_size = (JDX_GetImageSize(example_dataset->header) + sizeof(JDXLabel)) * example_dataset->header->image_count;
+
+	final_state = (
+		io_succeeded
+		&& write_stats.bytes_written == file_size
+		&& read_stats.bytes_read == file_size
+		&& callback_bytes_read == file_size
+		&& write_stats.uncompressed_bytes == body_size
+		&& read_stats.uncompressed_bytes == body_size
+		&& read_stats.compressed_bytes == write_stats.compressed_bytes
+		&& write_stats.phase_ns[JDXPhase_COMPRESS] > 0
+		&& read_stats.phase_ns[JDXPhase_DECOMPRESS] > 0
+		&& read_stats.allocated_bytes >= body_size
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(read_dataset);
+	remove("./res/temp.jdx");
+}
+
+typedef struct {
+	atomic_long live;
+	atomic_long total;
+} AllocationCounts;
+
+static void *counted_alloc(size_t size, void *context) {
+	AllocationCounts *counts = context;
+
+	atomic_fetch_add(&counts->live, 1);
+	atomic_fetch_add(&counts->total, 1);
+
+	return malloc(size);
+}
+
+static void *counted_realloc(void *pointer, size_t size, void *context) {
+	atomic_fetch_add(&((AllocationCounts *) context)->total, 1);
+	return realloc(pointer, size);
+}
+
+static void counted_free(void *pointer, void *context) {
+	atomic_fetch_sub(&((AllocationCounts *) context)->live, 1);
+	free(pointer);
+}
+
+TEST_FUNC(ReadDatasetIntoArena) {
+	AllocationCounts counts = { 0 };
+
+	JDXAllocator allocator = {
+		.alloc = counted_alloc,
+		.realloc = counted_realloc,
+		.free = counted_free,
+		.context = &counts
+	};
+
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+	write_options.thread_count = 2;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 2;
+
+	JDX_SetAllocator(&allocator);
+
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	bool io_succeeded = (
+		JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE
+	);
+
+	// Reading again into an arena releases the separate allocations, leaving only the dataset, its arena and the hash
+	// index of its labels
+	read_options.arena = true;
+
+	io_succeeded = io_succeeded && JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE;
+	long arena_allocations = atomic_load(&counts.live);
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	bool arena_matches = (
+		io_succeeded
+		&& arena_allocations == 3
+		&& (uintptr_t) dataset->_raw_image_data % 64 == 0
+		&& dataset->header->label_count == example_dataset->header->label_count
+		&& strcmp(dataset->header->labels[1], example_dataset->header->labels[1]) == 0
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	);
+
+	// Appending moves the dataset out of its arena before growing it
+	bool append_matches = (
+		JDX_AppendDataset(dataset, example_dataset) == JDXError_NONE
+		&& dataset->header->image_count == example_dataset->header->image_count * 2
+		&& memcmp(dataset->_raw_image_data + image_block_size, example_dataset->_raw_image_data, image_block_size) == 0
+	);
+
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+
+	long remaining_allocations = atomic_load(&counts.live);
+	JDX_SetAllocator(NULL);
+
+	final_state = (arena_matches && append_matches && remaining_allocations == 0) ? STATE_SUCCESS : STATE_FAILURE;
+}
+
+TEST_FUNC(ReadDatasetWithContext) {
+	AllocationCounts counts = { 0 };
+
+	JDXAllocator allocator = {
+		.alloc = counted_alloc,
+		.realloc = counted_realloc,
+		.free = counted_free,
+		.context = &counts
+	};
+
+	JDX_SetAllocator(&allocator);
+
+	JDXContext *context = JDX_AllocContext();
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+	write_options.thread_count = 2;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 2;
+
+	// Calls without a context set the baseline, and the first calls with one fill it
+	long start = atomic_load(&counts.total);
+	bool io_succeeded = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE;
+	long write_allocations = atomic_load(&counts.total) - start;
+
+	start = atomic_load(&counts.total);
+	io_succeeded = io_succeeded && JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE;
+	long read_allocations = atomic_load(&counts.total) - start;
+
+	write_options.context = context;
+	read_options.context = context;
+
+	io_succeeded = (
+		io_succeeded
+		&& JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE
+	);
+
+	start = atomic_load(&counts.total);
+	io_succeeded = io_succeeded && JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE;
+	long context_write_allocations = atomic_load(&counts.total) - start;
+
+	start = atomic_load(&counts.total);
+	io_succeeded = io_succeeded && JDX_ReadDatasetFromPathWithOptions(dataset, "./res/temp.jdx", &read_options) == JDXError_NONE;
+	long context_read_allocations = atomic_load(&counts.total) - start;
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	// Each writer keeps one compressor and two scratch chunks per thread, and each reader one decompressor and the body
+	final_state = (
+		io_succeeded
+		&& context_write_allocations <= write_allocations - 6
+		&& context_read_allocations <= read_allocations - 3
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	JDX_FreeContext(context);
+	remove("./res/temp.jdx");
+
+	if (atomic_load(&counts.live) != 0) {
+		final_state = STATE_FAILURE;
+	}
+
+	JDX_SetAllocator(NULL);
+}
+
+TEST_FUNC(AppendDatasetToPath) {
+	JDXHeader *header = example_dataset->header;
+	size_t image_size = JDX_GetImageSize(header);
+	uint64_t split = header->image_count / 2 + 1;
+
+	// Views of both halves of the example dataset, with the first ending in a partial chunk
+	JDXHeader first_header = *header, second_header = *header;
+	first_header.image_count = split;
+	second_header.image_count = header->image_count - split;
+
+	JDXDataset first_half = { .header = &first_header, ._raw_image_data = example_dataset->_raw_image_data, ._raw_labels = example_dataset->_raw_labels };
+	JDXDataset second_half = {
+		.header = &second_header,
+		._raw_image_data = example_dataset->_raw_image_data + image_size * split,
+		._raw_labels = example_dataset->_raw_labels + split
+	};
+
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+	options.filter = JDXFilter_PAETH;
+	options.thread_count = 2;
+
+	JDXDataset *read_dataset = JDX_AllocDataset();
+
+	bool datasets_match = (
+		JDX_WriteDatasetToPathWithOptions(&first_half, "./res/temp.jdx", &options) == JDXError_NONE
+		&& JDX_AppendDatasetToPathWithOptions(&second_half, "./res/temp.jdx", &options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == header->image_count
+		&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_size * header->image_count) == 0
+		&& memcmp(read_dataset->_raw_labels, example_dataset->_raw_labels, sizeof(JDXLabel) * header->image_count) == 0
+	);
+
+	// Legacy files are converted to chunks on their first append
+	FILE *legacy_file = fopen("./res/example-0.4.jdx", "rb");
+	FILE *temp_file = fopen("./res/temp-0.4.jdx", "wb");
+	uint8_t buffer[4096];
+	size_t read_size;
+
+	while (legacy_file && temp_file && (read_size = fread(buffer, 1, sizeof(buffer), legacy_file)) > 0) {
+		fwrite(buffer, 1, read_size, temp_file);
+	}
+
+	datasets_match = datasets_match && legacy_file && temp_file;
+
+	if (legacy_file) {
+		fclose(legacy_file);
+	}
+
+	if (temp_file) {
+		fclose(temp_file);
+	}
+
+	uint64_t image_count = header->image_count + second_header.image_count;
+
+	datasets_match = (
+		datasets_match
+		&& JDX_AppendDatasetToPath(&second_half, "./res/temp-0.4.jdx") == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp-0.4.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == image_count
+		&& JDX_CompareVersions(read_dataset->header->version, JDX_VERSION) == 0
+		&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_size * header->image_count) == 0
+		&& memcmp(read_dataset->_raw_image_data + image_size * header->image_count, second_half._raw_image_data, image_size * second_header.image_count) == 0
+		&& memcmp(read_dataset->_raw_labels + header->image_count, second_half._raw_labels, sizeof(JDXLabel) * second_header.image_count) == 0
+	);
+
+	// Images of another shape are rejected before the file is touched
+	second_header.image_width++;
+
+	final_state = (
+		datasets_match
+		&& JDX_AppendDatasetToPath(&second_half, "./res/temp.jdx") == JDXError_UNEQUAL_WIDTHS
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == header->image_count
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(read_dataset);
+	remove("./res/temp.jdx");
+	remove("./res/temp-0.4.jdx");
+}
+
+// Reads a whole file into memory, returning NULL if it cannot be read
+static uint8_t *read_file_bytes(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	uint8_t *bytes = NULL;
+
+	if (file && fseek(file, 0, SEEK_END) == 0) {
+		long file_size = ftell(file);
+		bytes = file_size >= 0 ? malloc((size_t) file_size + 1) : NULL;
+
+		if (bytes && (fseek(file, 0, SEEK_SET) != 0 || fread(bytes, 1, (size_t) file_size, file) != (size_t) file_size)) {
+			free(bytes);
+			bytes = NULL;
+		}
+
+		*size = (size_t) file_size;
+	}
+
+	if (file) {
+		fclose(file);
+	}
+
+	return bytes;
+}
+
+// Appends the example dataset to a file while writes fail from the given stream on, which must leave the file as it was
+static bool check_failed_append(const char *path, uint64_t failing_stream) {
+	size_t original_size = 0, size = 0;
+	uint8_t *original = read_file_bytes(path, &original_size);
+
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	fail_writes_from_stream(failing_stream);
+	JDXError append_error = JDX_AppendDatasetToPathWithOptions(example_dataset, path, &options);
+	fail_writes_from_stream(UINT64_MAX);
+
+	uint8_t *restored = read_file_bytes(path, &size);
+
+	bool file_restored = (
+		original
+		&& restored
+		&& append_error == JDXError_WRITE_FILE
+		&& size == original_size
+		&& memcmp(restored, original, size) == 0
+	);
+
+	free(original);
+	free(restored);
+
+	return file_restored;
+}
+
+TEST_FUNC(AppendDatasetToPathFailed) {
+	JDXHeader *header = example_dataset->header;
+	size_t image_size = JDX_GetImageSize(header);
+
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	uint64_t chunk_count = (header->image_count + 2) / 3;
+	uint64_t appended_chunk_count = (2 * header->image_count + 2) / 3;
+
+	// Appends that fail while writing pixel streams, or on close while writing label streams, or while converting a
+	// legacy file, must all put back the file that they started from
+	bool files_restored = (
+		JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options) == JDXError_NONE
+		&& check_failed_append("./res/temp.jdx", chunk_count)
+		&& check_failed_append("./res/temp.jdx", appended_chunk_count)
+	);
+
+	size_t legacy_size = 0;
+	uint8_t *legacy = read_file_bytes("./res/example-0.4.jdx", &legacy_size);
+	FILE *legacy_file = fopen("./res/temp-0.4.jdx", "wb");
+
+	files_restored = files_restored && legacy && legacy_file && fwrite(legacy, 1, legacy_size, legacy_file) == legacy_size;
+
+	if (legacy_file) {
+		fclose(legacy_file);
+	}
+
+	files_restored = files_restored && check_failed_append("./res/temp-0.4.jdx", 1);
+
+	// The header keeps its image count until the writer is closed, even once new streams have been written
+	JDXWriter *writer = NULL;
+	JDXHeader *open_header = JDX_AllocHeader();
+	bool header_kept = JDX_OpenWriterForAppend(&writer, "./res/temp-0.4.jdx", &options) == JDXError_NONE;
+
+	for (uint64_t i = 0; i < header->image_count && header_kept; i++) {
+		const uint8_t *image_data = example_dataset->_raw_image_data + image_size * i;
+		header_kept = JDX_WriteNextImage(writer, image_data, example_dataset->_raw_labels[i]) == JDXError_NONE;
+	}
+
+	header_kept = (
+		header_kept
+		&& JDX_ReadHeaderFromPath(open_header, "./res/temp-0.4.jdx") == JDXError_NONE
+		&& open_header->image_count == header->image_count
+		&& JDX_CloseWriter(writer) == JDXError_NONE
+		&& JDX_ReadHeaderFromPath(open_header, "./res/temp-0.4.jdx") == JDXError_NONE
+		&& open_header->image_count == 2 * header->image_count
+	);
+
+	JDX_FreeHeader(open_header);
+	JDXDataset *read_dataset = JDX_AllocDataset();
+
+	final_state = (
+		files_restored
+		&& header_kept
+		&& JDX_VerifyPath("./res/temp.jdx") == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == header->image_count
+		&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_size * header->image_count) == 0
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp-0.4.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == 2 * header->image_count
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(legacy);
+	JDX_FreeDataset(read_dataset);
+	remove("./res/temp.jdx");
+	remove("./res/temp-0.4.jdx");
+}
+
+TEST_FUNC(ReadDatasetFromManifest) {
+	JDXHeader *header = example_dataset->header;
+	size_t image_size = JDX_GetImageSize(header);
+	uint64_t split = header->image_count / 2;
+
+	// The first shard lists its labels in reverse, so its labels must be renumbered into the manifest's table
+	char **reversed_labels = malloc(header->label_count * sizeof(char *));
+
+	for (uint16_t l = 0; l < header->label_count; l++) {
+		reversed_labels[l] = header->labels[header->label_count - 1 - l];
+	}
+
+	JDXHeader reversed_header = *header;
+	reversed_header.labels = reversed_labels;
+	reversed_header._label_table = NULL;
+
+	JDXWriter *first_writer = NULL, *second_writer = NULL;
+	bool shards_written = (
+		JDX_OpenWriterToPath(&first_writer, "./res/temp-shard-0.jdx", &reversed_header, NULL) == JDXError_NONE
+		&& JDX_OpenWriterToPath(&second_writer, "./res/temp-shard-1.jdx", header, NULL) == JDXError_NONE
+	);
+
+	for (uint64_t i = 0; i < header->image_count && shards_written; i++) {
+		const uint8_t *image = example_dataset->_raw_image_data + image_size * i;
+		JDXLabel label = example_dataset->_raw_labels[i];
+
+		shards_written = i < split
+			? JDX_WriteNextImage(first_writer, image, header->label_count - 1 - label) == JDXError_NONE
+			: JDX_WriteNextImage(second_writer, image, label) == JDXError_NONE;
+	}
+
+	shards_written = JDX_CloseWriter(first_writer) == JDXError_NONE && shards_written;
+	shards_written = JDX_CloseWriter(second_writer) == JDXError_NONE && shards_written;
+
+	// Shard paths are relative to the manifest
+	const char *shard_paths[] = { "temp-shard-0.jdx", "temp-shard-1.jdx" };
+	const char *broken_paths[] = { "temp-shard-0.jdx", "temp-shard\n1.jdx" };
+
+	// More threads than shards, so that each shard is decoded on threads of its own
+	JDXReadOptions options = JDX_DEFAULT_READ_OPTIONS;
+	options.thread_count = 4;
+
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	// Line breaks would end a label or path early, so they cannot be written into a manifest
+	char *broken_label = reversed_labels[0];
+	reversed_labels[0] = "broken\rlabel";
+
+	bool breaks_rejected = (
+		JDX_WriteManifestToPath(&reversed_header, shard_paths, 2, "./res/temp.jdxm") == JDXError_OUT_OF_BOUNDS
+		&& JDX_WriteManifestToPath(header, broken_paths, 2, "./res/temp.jdxm") == JDXError_OUT_OF_BOUNDS
+	);
+
+	reversed_labels[0] = broken_label;
+
+	final_state = (
+		shards_written
+		&& breaks_rejected
+		&& JDX_WriteManifestToPath(header, shard_paths, 2, "./res/temp.jdxm") == JDXError_NONE
+		&& JDX_ReadDatasetFromManifest(dataset, "./res/temp.jdxm", &options) == JDXError_NONE
+		&& dataset->header->image_count == header->image_count
+		&& dataset->header->label_count == header->label_count
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_size * header->image_count) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, sizeof(JDXLabel) * header->image_count) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	free(reversed_labels);
+
+	remove("./res/temp-shard-0.jdx");
+	remove("./res/temp-shard-1.jdx");
+	remove("./res/temp.jdxm");
+}
+
+TEST_FUNC(VerifyPath) {
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+	write_options.codec = JDXCodec_STORED;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 2;
+
+	bool intact_files_pass = (
+		JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE
+		&& JDX_VerifyPathWithOptions("./res/temp.jdx", &read_options) == JDXError_NONE
+		&& JDX_VerifyPath("./res/example-0.4.jdx") == JDXError_NONE
+	);
+
+	// Stored pixels decode no matter what they hold, so only their checksum can tell that a byte was flipped
+	FILE *file = fopen("./res/temp.jdx", "r+b");
+	long file_size = 0;
+
+	if (file) {
+		fseek(file, 0, SEEK_END);
+		file_size = ftell(file);
+
+		fseek(file, file_size / 2, SEEK_SET);
+		int byte = fgetc(file);
+
+		fseek(file, file_size / 2, SEEK_SET);
+		fputc(byte ^ 0x10, file);
+		fclose(file);
+	}
+
+	JDXDataset *dataset = JDX_AllocDataset();
+
+	bool flips_fail = (
+		file_size > 0
+		&& JDX_VerifyPathWithOptions("./res/temp.jdx", &read_options) == JDXError_CORRUPT_FILE
+		&& JDX_ReadDatasetFromPath(dataset, "./res/temp.jdx") == JDXError_CORRUPT_FILE
+	);
+
+	// A file cut short loses the end of its checksums
+	uint8_t *file_data = malloc(file_size > 0 ? (size_t) file_size : 1);
+	bool truncated = false;
+
+	if (JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options) == JDXError_NONE && (file = fopen("./res/temp.jdx", "rb"))) {
+		truncated = fread(file_data, 1, (size_t) file_size, file) == (size_t) file_size;
+		fclose(file);
+	}
+
+	if (truncated && (file = fopen("./res/temp.jdx", "wb"))) {
+		truncated = fwrite(file_data, 1, (size_t) file_size - 1, file) == (size_t) file_size - 1;
+		fclose(file);
+	}
+
+	bool truncations_fail = truncated && JDX_VerifyPath("./res/temp.jdx") == JDXError_CORRUPT_FILE;
+
+	final_state = (intact_files_pass && flips_fail && truncations_fail) ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(file_data);
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(MapDatasetFromPath) {
+	JDXWriteOptions write_options = JDX_DEFAULT_WRITE_OPTIONS;
+	write_options.chunk_image_count = 3;
+	write_options.codec = JDXCodec_STORED;
+
+	JDXReadOptions read_options = JDX_DEFAULT_READ_OPTIONS;
+	read_options.thread_count = 2;
+	read_options.map_advice = JDXMapAdvice_SEQUENTIAL;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &write_options);
+
+	JDXDataset *dataset = JDX_AllocDataset();
+	JDXError map_error = JDX_MapDatasetFromPath(dataset, "./res/temp.jdx", &read_options);
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	// Stored pixels are used in place, so the dataset must keep the file mapped
+	final_state = (
+		write_error == JDXError_NONE
+		&& map_error == JDXError_NONE
+		&& dataset->_mapping != NULL
+		&& dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(ReadImageFromPath) {
+	// Use small chunks so that images are read from chunks other than the first
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options);
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	bool images_match = write_error == JDXError_NONE;
+
+	for (uint64_t i = 0; i < example_dataset->header->image_count && images_match; i++) {
+		JDXImage *image = NULL;
+		JDXError read_error = JDX_ReadImageFromPath(&image, "./res/temp.jdx", i);
+
+		images_match = (
+			read_error == JDXError_NONE
+			&& image->label_num == example_dataset->_raw_labels[i]
+			&& memcmp(image->raw_data, example_dataset->_raw_image_data + image_size * i, image_size) == 0
+		);
+
+		if (image) {
+			JDX_FreeImage(image);
+		}
+	}
+
+	JDXImage *out_of_bounds = NULL;
+	JDXError bounds_error = JDX_ReadImageFromPath(&out_of_bounds, "./res/temp.jdx", example_dataset->header->image_count);
+
+	final_state = (
+		images_match
+		&& bounds_error == JDXError_OUT_OF_BOUNDS
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	remove("./res/temp.jdx");
+}
+
 TEST_FUNC(WriteDatasetToPath) {
 	JDXError write_error = JDX_WriteDatasetToPath(example_dataset, "./res/temp.jdx");
 
@@ -38,6 +857,442 @@ TEST_FUNC(WriteDatasetToPath) {
 	remove("./res/temp.jdx");
 }
 
+#ifndef _WIN32
+// Drains the read end of a pipe into a file until the write end is closed
+static void *drain_pipe(void *arg) {
+	int *fds = arg;
+	FILE *file = fopen("./res/temp.jdx", "wb");
+	uint8_t buffer[4096];
+	ssize_t read_size;
+
+	while ((read_size = read(fds[0], buffer, sizeof(buffer))) > 0) {
+		if (file) {
+			fwrite(buffer, 1, (size_t) read_size, file);
+		}
+	}
+
+	if (file) {
+		fclose(file);
+	}
+
+	return NULL;
+}
+#endif
+
+TEST_FUNC(WriteDatasetToPipe) {
+#ifndef _WIN32
+	// Pipes cannot seek back to the header, so what reaches the other end must still be a whole file
+	int fds[2];
+	pthread_t drainer;
+
+	if (pipe(fds) != 0 || pthread_create(&drainer, NULL, drain_pipe, fds) != 0) {
+		final_state = STATE_FAILURE;
+		return;
+	}
+
+	FILE *pipe_file = fdopen(fds[1], "wb");
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	JDXError write_error = JDXError_OPEN_FILE;
+
+	if (pipe_file) {
+		write_error = JDX_WriteDatasetToFileWithOptions(example_dataset, pipe_file, &options);
+		fclose(pipe_file);
+	} else {
+		close(fds[1]);
+	}
+
+	pthread_join(drainer, NULL);
+	close(fds[0]);
+
+	JDXDataset *dataset = JDX_AllocDataset();
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+
+	final_state = (
+		write_error == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(dataset, "./res/temp.jdx") == JDXError_NONE
+		&& dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& JDX_VerifyPath("./res/temp.jdx") == JDXError_NONE
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(dataset);
+	remove("./res/temp.jdx");
+#else
+	final_state = STATE_SUCCESS;
+#endif
+}
+
+TEST_FUNC(WriteDatasetToPathThreaded) {
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 2;
+	options.thread_count = 3;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options);
+
+	JDXDataset *read_dataset = JDX_AllocDataset();
+	JDXError read_error = JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx");
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	final_state = (
+		write_error == JDXError_NONE
+		&& read_error == JDXError_NONE
+		&& read_dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(read_dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(read_dataset);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(WriteDatasetToPathStored) {
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+	options.codec = JDXCodec_STORED;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options);
+
+	// Stream the stored file back so that the reader's chunk window is exercised too
+	JDXReader *reader = NULL;
+	JDXError open_error = write_error ? write_error : JDX_OpenReaderFromPath(&reader, "./res/temp.jdx");
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	bool images_match = open_error == JDXError_NONE;
+
+	for (uint64_t i = 0; i < example_dataset->header->image_count && images_match; i++) {
+		JDXImageView view;
+
+		images_match = (
+			JDX_ReadNextImage(reader, &view) == JDXError_NONE
+			&& view.label_num == example_dataset->_raw_labels[i]
+			&& memcmp(view.raw_data, example_dataset->_raw_image_data + image_size * i, image_size) == 0
+		);
+	}
+
+	final_state = images_match ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_CloseReader(reader);
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(WriteDatasetToPathCodecs) {
+	JDXCodec codecs[] = { JDXCodec_DEFLATE, JDXCodec_ZLIB, JDXCodec_GZIP };
+	uint8_t levels[] = { 1, 6, 12 };
+
+	size_t image_block_size = JDX_GetImageSize(example_dataset->header) * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+	bool datasets_match = true;
+
+	// Readers find the codec in the file, so every codec and level reads back the same way
+	for (size_t c = 0; c < sizeof(codecs) / sizeof(codecs[0]) && datasets_match; c++) {
+		JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+		options.codec = codecs[c];
+		options.compression_level = levels[c];
+
+		JDXDataset *read_dataset = JDX_AllocDataset();
+
+		datasets_match = (
+			JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options) == JDXError_NONE
+			&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+			&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+			&& memcmp(read_dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+		);
+
+		JDX_FreeDataset(read_dataset);
+	}
+
+	JDXWriteOptions invalid_options = JDX_DEFAULT_WRITE_OPTIONS;
+	invalid_options.compression_level = 13;
+
+	final_state = (
+		datasets_match
+		&& JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &invalid_options) == JDXError_OUT_OF_BOUNDS
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(WriteDatasetToPathFiltered) {
+	// A 32-bit dataset whose rows are not a multiple of 16 pixels covers the stride 4 and tail paths of the filters
+	JDXHeader wide_header = *example_dataset->header;
+	wide_header.image_width = 21;
+	wide_header.image_height = 6;
+	wide_header.bit_depth = 32;
+	wide_header.image_count = 5;
+	wide_header._label_table = NULL;
+
+	size_t wide_image_size = JDX_GetImageSize(&wide_header);
+	uint8_t *wide_image_data = malloc(wide_image_size * wide_header.image_count);
+	JDXLabel wide_labels[5];
+	uint32_t noise = 1;
+
+	// Smooth gradients with some noise give every predictor both small and large residuals
+	for (size_t b = 0; b < wide_image_size * wide_header.image_count; b++) {
+		noise = noise * 1103515245 + 12345;
+		wide_image_data[b] = (uint8_t) (b / 4 * 3 + (noise >> 28));
+	}
+
+	for (uint64_t i = 0; i < wide_header.image_count; i++) {
+		wide_labels[i] = (JDXLabel) (i % wide_header.label_count);
+	}
+
+	JDXDataset wide_dataset = { .header = &wide_header, ._raw_image_data = wide_image_data, ._raw_labels = wide_labels };
+	JDXDataset *datasets[] = { example_dataset, &wide_dataset };
+	bool datasets_match = true;
+
+	// Every filter, with and without split channels, must be undone exactly by both whole reads and the reader
+	for (int d = 0; d < 2 && datasets_match; d++) {
+		JDXDataset *dataset = datasets[d];
+		size_t image_size = JDX_GetImageSize(dataset->header);
+		size_t image_block_size = image_size * dataset->header->image_count;
+
+		for (int f = JDXFilter_NONE; f <= JDXFilter_PAETH && datasets_match; f++) {
+			for (int split = 0; split <= 1 && datasets_match; split++) {
+				JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+				options.chunk_image_count = 3;
+				options.filter = (JDXFilter) f;
+				options.split_channels = split;
+
+				JDXDataset *read_dataset = JDX_AllocDataset();
+				JDXReader *reader = NULL;
+
+				datasets_match = (
+					JDX_WriteDatasetToPathWithOptions(dataset, "./res/temp.jdx", &options) == JDXError_NONE
+					&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+					&& read_dataset->header->bit_depth == dataset->header->bit_depth
+					&& memcmp(read_dataset->_raw_image_data, dataset->_raw_image_data, image_block_size) == 0
+					&& JDX_OpenReaderFromPath(&reader, "./res/temp.jdx") == JDXError_NONE
+				);
+
+				for (uint64_t i = 0; i < dataset->header->image_count && datasets_match; i++) {
+					JDXImageView view;
+
+					datasets_match = (
+						JDX_ReadNextImage(reader, &view) == JDXError_NONE
+						&& memcmp(view.raw_data, dataset->_raw_image_data + image_size * i, image_size) == 0
+					);
+				}
+
+				JDX_CloseReader(reader);
+				JDX_FreeDataset(read_dataset);
+			}
+		}
+	}
+
+	free(wide_image_data);
+
+	final_state = datasets_match ? STATE_SUCCESS : STATE_FAILURE;
+	remove("./res/temp.jdx");
+}
+
+// Changes the first word of an image and solves for the next word that the first lane of its hash reads, so that the
+// lane, and with it the whole hash, ends up as before even though the bytes differ
+static void collide_first_lane(uint8_t *image) {
+	const uint64_t prime_1 = 0x9E3779B185EBCA87, prime_2 = 0xC2B2AE3D27D4EB4F;
+	uint64_t inverse = prime_2;
+
+	// Every step doubles the number of correct low bits of the inverse, which starts with three
+	for (int s = 0; s < 5; s++) {
+		inverse *= 2 - prime_2 * inverse;
+	}
+
+	uint64_t first, second, lane = prime_1 + prime_2;
+	memcpy(&first, image, sizeof(first));
+	memcpy(&second, image + 32, sizeof(second));
+
+	uint64_t mixed = lane + first * prime_2;
+	uint64_t old_lane = ((mixed << 31) | (mixed >> 33)) * prime_1;
+
+	first ^= 0xFF;
+	mixed = lane + first * prime_2;
+
+	uint64_t new_lane = ((mixed << 31) | (mixed >> 33)) * prime_1;
+	second += (old_lane - new_lane) * inverse;
+
+	memcpy(image, &first, sizeof(first));
+	memcpy(image + 32, &second, sizeof(second));
+}
+
+TEST_FUNC(WriteDatasetToPathDeduplicated) {
+	// Every image appears three times, so two of every three are written as references to the first
+	JDXDataset *repeated_dataset = JDX_AllocDataset();
+	JDX_CopyDataset(repeated_dataset, example_dataset);
+	JDX_AppendDataset(repeated_dataset, example_dataset);
+	JDX_AppendDataset(repeated_dataset, example_dataset);
+
+	JDXStats write_stats = { 0 };
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+	options.deduplicate = true;
+	options.stats = &write_stats;
+
+	size_t image_size = JDX_GetImageSize(repeated_dataset->header);
+	uint64_t image_count = repeated_dataset->header->image_count;
+
+	JDXDataset *read_dataset = JDX_AllocDataset();
+	JDXReader *reader = NULL;
+
+	bool datasets_match = (
+		JDX_WriteDatasetToPathWithOptions(repeated_dataset, "./res/temp.jdx", &options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx") == JDXError_NONE
+		&& read_dataset->header->image_count == image_count
+		&& memcmp(read_dataset->_raw_image_data, repeated_dataset->_raw_image_data, image_size * image_count) == 0
+		&& memcmp(read_dataset->_raw_labels, repeated_dataset->_raw_labels, sizeof(JDXLabel) * image_count) == 0
+		&& JDX_VerifyPath("./res/temp.jdx") == JDXError_NONE
+		&& JDX_OpenReaderFromPath(&reader, "./res/temp.jdx") == JDXError_NONE
+	);
+
+	// The reader finds referenced images in other chunks on its own
+	for (uint64_t i = 0; i < image_count && datasets_match; i++) {
+		JDXImageView view;
+
+		datasets_match = (
+			JDX_ReadNextImage(reader, &view) == JDXError_NONE
+			&& memcmp(view.raw_data, repeated_dataset->_raw_image_data + image_size * i, image_size) == 0
+		);
+	}
+
+	final_state = (
+		datasets_match
+		&& write_stats.duplicate_images >= 2 * example_dataset->header->image_count
+		&& write_stats.uncompressed_bytes == (
+			image_size * (image_count - write_stats.duplicate_images) + (sizeof(JDXLabel) + sizeof(uint64_t)) * image_count
+		)
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_CloseReader(reader);
+	JDX_FreeDataset(read_dataset);
+	JDX_FreeDataset(repeated_dataset);
+
+	// Images whose hashes collide must both be stored, whether their bytes are compared in the dataset, in copies
+	// kept by a writer whose caller reuses its buffer, or in the rewritten images of an append
+	JDXHeader pair_header = *example_dataset->header;
+	pair_header.image_width = 32;
+	pair_header.image_height = 32;
+	pair_header.bit_depth = 24;
+	pair_header.image_count = 2;
+	pair_header._label_table = NULL;
+
+	size_t pair_image_size = JDX_GetImageSize(&pair_header);
+	uint8_t *pair_images = malloc(pair_image_size * 2);
+	uint8_t *buffer = malloc(pair_image_size);
+
+	for (size_t b = 0; b < pair_image_size; b++) {
+		pair_images[b] = (uint8_t) (b * 7 + b / 96);
+	}
+
+	memcpy(pair_images + pair_image_size, pair_images, pair_image_size);
+	collide_first_lane(pair_images + pair_image_size);
+
+	ImageHash first_hash = hash_image(pair_images, pair_image_size);
+	ImageHash second_hash = hash_image(pair_images + pair_image_size, pair_image_size);
+
+	JDXLabel pair_labels[2] = { 0, 0 };
+	JDXDataset pair_dataset = { .header = &pair_header, ._raw_image_data = pair_images, ._raw_labels = pair_labels };
+
+	JDXWriteOptions pair_options = JDX_DEFAULT_WRITE_OPTIONS;
+	pair_options.deduplicate = true;
+
+	JDXDataset *written_pair = JDX_AllocDataset();
+	JDXDataset *streamed_pair = JDX_AllocDataset();
+	JDXWriter *writer = NULL;
+
+	bool pair_stored = (
+		first_hash.low == second_hash.low
+		&& first_hash.high == second_hash.high
+		&& memcmp(pair_images, pair_images + pair_image_size, pair_image_size) != 0
+		&& JDX_WriteDatasetToPathWithOptions(&pair_dataset, "./res/temp.jdx", &pair_options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(written_pair, "./res/temp.jdx") == JDXError_NONE
+		&& memcmp(written_pair->_raw_image_data, pair_images, pair_image_size * 2) == 0
+		&& JDX_OpenWriterToPath(&writer, "./res/temp.jdx", &pair_header, &pair_options) == JDXError_NONE
+	);
+
+	for (uint64_t i = 0; i < 2 && writer; i++) {
+		memcpy(buffer, pair_images + pair_image_size * i, pair_image_size);
+		pair_stored = JDX_WriteNextImage(writer, buffer, 0) == JDXError_NONE && pair_stored;
+		memset(buffer, 0, pair_image_size);
+	}
+
+	pair_stored = (
+		(writer == NULL || JDX_CloseWriter(writer) == JDXError_NONE)
+		&& pair_stored
+		&& JDX_AppendDatasetToPathWithOptions(&pair_dataset, "./res/temp.jdx", &pair_options) == JDXError_NONE
+		&& JDX_ReadDatasetFromPath(streamed_pair, "./res/temp.jdx") == JDXError_NONE
+		&& streamed_pair->header->image_count == 4
+		&& memcmp(streamed_pair->_raw_image_data, pair_images, pair_image_size * 2) == 0
+		&& memcmp(streamed_pair->_raw_image_data + pair_image_size * 2, pair_images, pair_image_size * 2) == 0
+	);
+
+	if (!pair_stored) {
+		final_state = STATE_FAILURE;
+	}
+
+	JDX_FreeDataset(written_pair);
+	JDX_FreeDataset(streamed_pair);
+	free(pair_images);
+	free(buffer);
+
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(GetImageView) {
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	uint64_t last_index = example_dataset->header->image_count - 1;
+
+	JDXImageView view;
+	JDXError view_error = JDX_GetImageView(&view, example_dataset, last_index);
+
+	JDXImageView out_of_bounds;
+	JDXError bounds_error = JDX_GetImageView(&out_of_bounds, example_dataset, last_index + 1);
+
+	// Views must point directly into the dataset rather than at a copy
+	final_state = (
+		view_error == JDXError_NONE
+		&& bounds_error == JDXError_OUT_OF_BOUNDS
+		&& view.raw_data == example_dataset->_raw_image_data + image_size * last_index
+		&& view.label_num == example_dataset->_raw_labels[last_index]
+		&& view.label_str == example_dataset->header->labels[view.label_num]
+		&& view.width == example_dataset->header->image_width
+		&& view.height == example_dataset->header->image_height
+		&& view.bit_depth == example_dataset->header->bit_depth
+	) ? STATE_SUCCESS : STATE_FAILURE;
+}
+
+TEST_FUNC(GetBatch) {
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	uint64_t indices[] = { 7, 0, 3, 3, 5 };
+	uint64_t index_count = sizeof(indices) / sizeof(indices[0]);
+
+	JDXReadOptions options = JDX_DEFAULT_READ_OPTIONS;
+	options.thread_count = 2;
+
+	uint8_t *pixels = malloc(image_size * index_count);
+	JDXLabel labels[sizeof(indices) / sizeof(indices[0])];
+
+	JDXError batch_error = JDX_GetBatchWithOptions(pixels, labels, example_dataset, indices, index_count, &options);
+	bool batch_matches = batch_error == JDXError_NONE;
+
+	for (uint64_t i = 0; i < index_count && batch_matches; i++) {
+		batch_matches = (
+			labels[i] == example_dataset->_raw_labels[indices[i]]
+			&& memcmp(pixels + image_size * i, example_dataset->_raw_image_data + image_size * indices[i], image_size) == 0
+		);
+	}
+
+	uint64_t invalid_index = example_dataset->header->image_count;
+
+	final_state = (
+		batch_matches
+		&& JDX_GetBatch(pixels, labels, example_dataset, &invalid_index, 1) == JDXError_OUT_OF_BOUNDS
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(pixels);
+}
+
 TEST_FUNC(CopyDataset) {
 	JDXDataset *copy = JDX_AllocDataset();
 	JDX_CopyDataset(copy, example_dataset);
@@ -66,8 +1321,9 @@ TEST_FUNC(AppendDataset) {
 	final_state = (
 		error == JDXError_NONE
 		&& copy->header->image_count == example_dataset->header->image_count * 2
+		&& copy->header->label_count == example_dataset->header->label_count
 		&& memcmp(example_dataset->_raw_image_data, copy->_raw_image_data + image_block_size, image_block_size) == 0
-		&& memcmp(example_dataset->_raw_labels, copy->_raw_labels + label_block_size, label_block_size) == 0
+		&& memcmp(example_dataset->_raw_labels, copy->_raw_labels + example_dataset->header->image_count, label_block_size) == 0
 	) ? STATE_SUCCESS : STATE_FAILURE;
 
 	JDX_FreeDataset(copy);
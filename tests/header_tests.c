@@ -29,6 +29,32 @@ TEST_FUNC(ReadHeaderFromPath) {
 	JDX_FreeHeader(header);
 }
 
+TEST_FUNC(ReadHeaderFromFile) {
+	FILE *file = fopen("./res/example.jdx", "rb");
+
+	JDXHeader *header = JDX_AllocHeader();
+	JDXError error = file ? JDX_ReadHeaderFromFile(header, file) : JDXError_OPEN_FILE;
+
+	// The header is read ahead in one block, but the file must still be left at the start of the body
+	long header_size = 14 + (long) sizeof(header->image_count);
+
+	for (uint_fast16_t l = 0; error == JDXError_NONE && l < header->label_count; l++) {
+		header_size += (long) strlen(header->labels[l]) + 1;
+	}
+
+	final_state = (
+		error == JDXError_NONE &&
+		header->image_count == 8 &&
+		ftell(file) == header_size
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeHeader(header);
+
+	if (file) {
+		fclose(file);
+	}
+}
+
 TEST_FUNC(CopyHeader) {
 	JDXHeader *copy = JDX_AllocHeader();
 	JDX_CopyHeader(copy, example_dataset->header);
@@ -41,3 +67,38 @@ TEST_FUNC(CopyHeader) {
 
 	JDX_FreeHeader(copy);
 }
+
+TEST_FUNC(FindLabel) {
+	JDXHeader *header = example_dataset->header;
+	bool labels_found = true;
+
+	for (uint_fast16_t l = 0; l < header->label_count && labels_found; l++) {
+		JDXLabel label;
+
+		labels_found = (
+			JDX_FindLabel(&label, header, header->labels[l]) == JDXError_NONE
+			&& label == l
+		);
+	}
+
+	// Headers put together by hand have no table, and headers whose label count was changed by hand have a stale one,
+	// and both must be searched without touching the table
+	JDXHeader untabled = *header;
+	untabled._label_table = NULL;
+
+	JDXHeader stale = *header;
+	stale.label_count = 1;
+
+	JDXLabel unknown, untabled_label, stale_label;
+
+	final_state = (
+		labels_found
+		&& JDX_FindLabel(&unknown, header, "not a label") == JDXError_UNKNOWN_LABEL
+		&& JDX_FindLabel(&untabled_label, &untabled, header->labels[header->label_count - 1]) == JDXError_NONE
+		&& untabled_label == header->label_count - 1
+		&& JDX_FindLabel(&unknown, &untabled, "not a label") == JDXError_UNKNOWN_LABEL
+		&& JDX_FindLabel(&stale_label, &stale, header->labels[0]) == JDXError_NONE
+		&& stale_label == 0
+		&& JDX_FindLabel(&unknown, &stale, header->labels[header->label_count - 1]) == JDXError_UNKNOWN_LABEL
+	) ? STATE_SUCCESS : STATE_FAILURE;
+}
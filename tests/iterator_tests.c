@@ -0,0 +1,112 @@
+#include "tests.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+TEST_FUNC(NextBatch) {
+	JDXIteratorOptions options = JDX_DEFAULT_ITERATOR_OPTIONS;
+	options.batch_size = 3;
+	options.shuffle = false;
+	options.thread_count = 2;
+
+	JDXIterator *iterator = NULL;
+
+	if (JDX_OpenIterator(&iterator, example_dataset, &options)) {
+		return;
+	}
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	uint64_t image_count = example_dataset->header->image_count;
+	bool batches_match = true;
+
+	// Unshuffled epochs visit every image in order, ending with a partial batch if the batch size does not divide them
+	for (uint64_t epoch = 0; epoch < 2 && batches_match; epoch++) {
+		uint64_t position = 0;
+		JDXBatch batch;
+
+		while (batches_match && JDX_NextBatch(iterator, &batch) == JDXError_NONE) {
+			uint64_t expected_count = image_count - position < 3 ? image_count - position : 3;
+
+			batches_match = (
+				batch.image_count == expected_count
+				&& memcmp(batch.labels, example_dataset->_raw_labels + position, sizeof(JDXLabel) * batch.image_count) == 0
+				&& memcmp(batch.pixels, example_dataset->_raw_image_data + image_size * position, image_size * batch.image_count) == 0
+			);
+
+			position += batch.image_count;
+		}
+
+		batches_match = batches_match && position == image_count && iterator->epoch == epoch + 1;
+	}
+
+	final_state = batches_match ? STATE_SUCCESS : STATE_FAILURE;
+	JDX_CloseIterator(iterator);
+}
+
+TEST_FUNC(NextBatchShuffled) {
+	JDXIteratorOptions options = JDX_DEFAULT_ITERATOR_OPTIONS;
+	options.batch_size = 2;
+	options.seed = 42;
+	options.thread_count = 3;
+
+	JDXIterator *first = NULL;
+	JDXIterator *second = NULL;
+
+	JDXError first_error = JDX_OpenIterator(&first, example_dataset, &options);
+	JDXError second_error = JDX_OpenIterator(&second, example_dataset, &options);
+
+	if (first_error || second_error) {
+		JDX_CloseIterator(first);
+		JDX_CloseIterator(second);
+		return;
+	}
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	uint64_t image_count = example_dataset->header->image_count;
+	bool *visited = calloc(image_count, sizeof(bool));
+	bool epochs_match = true;
+
+	// The same seed always produces the same epochs, and each epoch visits every image exactly once
+	for (uint64_t epoch = 0; epoch < 3 && epochs_match; epoch++) {
+		memset(visited, 0, image_count * sizeof(bool));
+
+		JDXBatch first_batch, second_batch;
+
+		while (epochs_match && JDX_NextBatch(first, &first_batch) == JDXError_NONE) {
+			epochs_match = (
+				JDX_NextBatch(second, &second_batch) == JDXError_NONE
+				&& first_batch.image_count == second_batch.image_count
+				&& memcmp(first_batch.pixels, second_batch.pixels, image_size * first_batch.image_count) == 0
+			);
+
+			for (uint64_t i = 0; i < first_batch.image_count && epochs_match; i++) {
+				uint64_t index = 0;
+
+				while (
+					index < image_count
+					&& (visited[index] || memcmp(first_batch.pixels + image_size * i, example_dataset->_raw_image_data + image_size * index, image_size) != 0)
+				) {
+					index++;
+				}
+
+				epochs_match = index < image_count && first_batch.labels[i] == example_dataset->_raw_labels[index];
+
+				if (epochs_match) {
+					visited[index] = true;
+				}
+			}
+		}
+
+		for (uint64_t index = 0; index < image_count && epochs_match; index++) {
+			epochs_match = visited[index];
+		}
+
+		epochs_match = epochs_match && JDX_NextBatch(second, &second_batch) == JDXError_OUT_OF_BOUNDS;
+	}
+
+	final_state = epochs_match ? STATE_SUCCESS : STATE_FAILURE;
+
+	free(visited);
+	JDX_CloseIterator(first);
+	JDX_CloseIterator(second);
+}
@@ -71,11 +71,42 @@ int main(void) {
 	Test tests[] = {
 		TEST(CompareVersions),
 		TEST(ReadHeaderFromPath),
+		TEST(ReadHeaderFromFile),
 		TEST(CopyHeader),
+		TEST(FindLabel),
 		TEST(ReadDatasetFromPath),
+		TEST(ReadDatasetFromPathThreaded),
+		TEST(ReadLargeDatasetFromPath),
+		TEST(ReadLegacyDatasetFromPath),
+		TEST(ReadLabelsFromPath),
+		TEST(ReadDatasetWithLabelsFromPath),
+		TEST(ReadDatasetWithStats),
+		TEST(ReadDatasetIntoArena),
+		TEST(ReadDatasetWithContext),
+		TEST(AppendDatasetToPath),
+		TEST(AppendDatasetToPathFailed),
+		TEST(ReadDatasetFromManifest),
+		TEST(VerifyPath),
+		TEST(MapDatasetFromPath),
+		TEST(ReadImageFromPath),
 		TEST(WriteDatasetToPath),
+		TEST(WriteDatasetToPipe),
+		TEST(WriteDatasetToPathThreaded),
+		TEST(WriteDatasetToPathStored),
+		TEST(WriteDatasetToPathCodecs),
+		TEST(WriteDatasetToPathFiltered),
+		TEST(WriteDatasetToPathDeduplicated),
+		TEST(GetImageView),
+		TEST(GetBatch),
 		TEST(CopyDataset),
-		TEST(AppendDataset)
+		TEST(AppendDataset),
+		TEST(ReadNextImage),
+		TEST(SeekReader),
+		TEST(WriteNextImage),
+		TEST(NextBatch),
+		TEST(NextBatchShuffled),
+		TEST(ConvertToFloat),
+		TEST(ConvertBitDepth)
 	};
 
 	init_testing_env();
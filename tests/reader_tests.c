@@ -0,0 +1,73 @@
+#include "tests.h"
+
+#include <string.h>
+
+TEST_FUNC(ReadNextImage) {
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+
+	JDXError write_error = JDX_WriteDatasetToPathWithOptions(example_dataset, "./res/temp.jdx", &options);
+
+	JDXReader *reader = NULL;
+	JDXError open_error = JDX_OpenReaderFromPath(&reader, "./res/temp.jdx");
+
+	if (write_error || open_error) {
+		remove("./res/temp.jdx");
+		return;
+	}
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	bool images_match = reader->header->image_count == example_dataset->header->image_count;
+
+	while (images_match && reader->position < reader->header->image_count) {
+		uint64_t index = reader->position;
+
+		JDXImageView view;
+		JDXError read_error = JDX_ReadNextImage(reader, &view);
+
+		images_match = (
+			read_error == JDXError_NONE
+			&& view.label_num == example_dataset->_raw_labels[index]
+			&& strcmp(view.label_str, example_dataset->header->labels[view.label_num]) == 0
+			&& memcmp(view.raw_data, example_dataset->_raw_image_data + image_size * index, image_size) == 0
+		);
+	}
+
+	JDXImageView view;
+	JDXError end_error = JDX_ReadNextImage(reader, &view);
+
+	final_state = (
+		images_match
+		&& end_error == JDXError_OUT_OF_BOUNDS
+		&& JDX_CloseReader(reader) == JDXError_NONE
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	remove("./res/temp.jdx");
+}
+
+TEST_FUNC(SeekReader) {
+	JDXReader *reader = NULL;
+	JDXError open_error = JDX_OpenReaderFromPath(&reader, "./res/example.jdx");
+
+	if (open_error) {
+		return;
+	}
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	uint64_t last_index = example_dataset->header->image_count - 1;
+
+	JDXImageView view;
+
+	JDXError seek_error = JDX_SeekReader(reader, last_index);
+	JDXError read_error = JDX_ReadNextImage(reader, &view);
+
+	final_state = (
+		seek_error == JDXError_NONE
+		&& read_error == JDXError_NONE
+		&& view.label_num == example_dataset->_raw_labels[last_index]
+		&& memcmp(view.raw_data, example_dataset->_raw_image_data + image_size * last_index, image_size) == 0
+		&& JDX_SeekReader(reader, last_index + 2) == JDXError_OUT_OF_BOUNDS
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_CloseReader(reader);
+}
@@ -21,8 +21,39 @@ extern TestState final_state;
 // Test definitions
 TEST_FUNC(CompareVersions);
 TEST_FUNC(ReadHeaderFromPath);
+TEST_FUNC(ReadHeaderFromFile);
 TEST_FUNC(CopyHeader);
+TEST_FUNC(FindLabel);
 TEST_FUNC(ReadDatasetFromPath);
+TEST_FUNC(ReadDatasetFromPathThreaded);
+TEST_FUNC(ReadLargeDatasetFromPath);
+TEST_FUNC(ReadLegacyDatasetFromPath);
+TEST_FUNC(ReadLabelsFromPath);
+TEST_FUNC(ReadDatasetWithLabelsFromPath);
+TEST_FUNC(ReadDatasetWithStats);
+TEST_FUNC(ReadDatasetIntoArena);
+TEST_FUNC(ReadDatasetWithContext);
+TEST_FUNC(AppendDatasetToPath);
+TEST_FUNC(AppendDatasetToPathFailed);
+TEST_FUNC(ReadDatasetFromManifest);
+TEST_FUNC(VerifyPath);
+TEST_FUNC(MapDatasetFromPath);
+TEST_FUNC(ReadImageFromPath);
 TEST_FUNC(WriteDatasetToPath);
+TEST_FUNC(WriteDatasetToPipe);
+TEST_FUNC(WriteDatasetToPathThreaded);
+TEST_FUNC(WriteDatasetToPathStored);
+TEST_FUNC(WriteDatasetToPathCodecs);
+TEST_FUNC(WriteDatasetToPathFiltered);
+TEST_FUNC(WriteDatasetToPathDeduplicated);
+TEST_FUNC(GetImageView);
+TEST_FUNC(GetBatch);
 TEST_FUNC(CopyDataset);
 TEST_FUNC(AppendDataset);
+TEST_FUNC(ReadNextImage);
+TEST_FUNC(SeekReader);
+TEST_FUNC(WriteNextImage);
+TEST_FUNC(NextBatch);
+TEST_FUNC(NextBatchShuffled);
+TEST_FUNC(ConvertToFloat);
+TEST_FUNC(ConvertBitDepth);
@@ -0,0 +1,50 @@
+#include "tests.h"
+
+#include <string.h>
+
+TEST_FUNC(WriteNextImage) {
+	// Use small chunks and several threads so that both full rounds and a partial last chunk are written
+	JDXWriteOptions options = JDX_DEFAULT_WRITE_OPTIONS;
+	options.chunk_image_count = 3;
+	options.thread_count = 2;
+
+	JDXWriter *writer = NULL;
+	JDXError open_error = JDX_OpenWriterToPath(&writer, "./res/temp.jdx", example_dataset->header, &options);
+
+	if (open_error) {
+		return;
+	}
+
+	size_t image_size = JDX_GetImageSize(example_dataset->header);
+	bool writes_succeeded = true;
+
+	for (uint64_t i = 0; i < example_dataset->header->image_count && writes_succeeded; i++) {
+		writes_succeeded = JDX_WriteNextImage(
+			writer,
+			example_dataset->_raw_image_data + image_size * i,
+			example_dataset->_raw_labels[i]
+		) == JDXError_NONE;
+	}
+
+	JDXError label_error = JDX_WriteNextImage(writer, example_dataset->_raw_image_data, example_dataset->header->label_count);
+	JDXError close_error = JDX_CloseWriter(writer);
+
+	JDXDataset *read_dataset = JDX_AllocDataset();
+	JDXError read_error = JDX_ReadDatasetFromPath(read_dataset, "./res/temp.jdx");
+
+	size_t image_block_size = image_size * example_dataset->header->image_count;
+	size_t label_block_size = sizeof(JDXLabel) * example_dataset->header->image_count;
+
+	final_state = (
+		writes_succeeded
+		&& label_error == JDXError_OUT_OF_BOUNDS
+		&& close_error == JDXError_NONE
+		&& read_error == JDXError_NONE
+		&& read_dataset->header->image_count == example_dataset->header->image_count
+		&& memcmp(read_dataset->_raw_image_data, example_dataset->_raw_image_data, image_block_size) == 0
+		&& memcmp(read_dataset->_raw_labels, example_dataset->_raw_labels, label_block_size) == 0
+	) ? STATE_SUCCESS : STATE_FAILURE;
+
+	JDX_FreeDataset(read_dataset);
+	remove("./res/temp.jdx");
+}